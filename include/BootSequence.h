@@ -0,0 +1,56 @@
+#ifndef PILLOTTER_BOOT_SEQUENCE_H
+#define PILLOTTER_BOOT_SEQUENCE_H
+
+#include <stdint.h>
+
+#include "Printer.h"
+#include "Scheduler.h"
+
+// One step of bringing the board up. run() returns false when its device is
+// not ready yet (no SD card); it is then tried again after retryMs.
+struct BootPhase {
+  const char *name;
+  bool (*run)();
+  uint16_t retryMs;
+};
+
+// Runs boot phases in order, one attempt per step(), and records how long
+// each took so a slow boot can be pinned on a device. Between attempts the
+// caller is free to kick the watchdog or service anything already up.
+class BootSequence {
+ public:
+  static const uint8_t kMaxPhases = 8;
+
+  // `micros` is a free-running microsecond clock.
+  BootSequence(const BootPhase *phases, uint8_t count, ClockFn micros);
+
+  // Attempts the current phase if it is due. Returns true once all are done.
+  bool step();
+  bool done() const { return current_ == count_; }
+
+  uint8_t count() const { return count_; }
+  const char *name(uint8_t i) const { return phases_[i].name; }
+  // Time spent inside run() over all attempts, in us.
+  uint32_t phaseUs(uint8_t i) const { return spentUs_[i]; }
+  uint8_t attempts(uint8_t i) const { return attempts_[i]; }
+  // First step() to the end of the last phase, retry waits included, in us.
+  uint32_t totalUs() const { return totalUs_; }
+
+  // "boot 212 ms: serial=0 lcd=118 ...", milliseconds, with "(3 tries)"
+  // after any phase that needed more than one.
+  void print(Printer &out) const;
+
+ private:
+  const BootPhase *phases_;
+  uint8_t count_;
+  ClockFn micros_;
+  uint8_t current_;
+  bool started_;
+  uint32_t startUs_;
+  uint32_t lastTryUs_;
+  uint32_t totalUs_;
+  uint32_t spentUs_[kMaxPhases];
+  uint8_t attempts_[kMaxPhases];
+};
+
+#endif  // PILLOTTER_BOOT_SEQUENCE_H
@@ -0,0 +1,39 @@
+#ifndef PILLOTTER_CALENDAR_H
+#define PILLOTTER_CALENDAR_H
+
+#include <stdint.h>
+
+// Broken-down time for epoch seconds since 2000-01-01 00:00, the same epoch
+// as RtcDateTime::TotalSeconds(). Valid through 2099.
+struct DateTime {
+  uint16_t year;
+  uint8_t month;  // 1-12
+  uint8_t day;    // 1-31
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+};
+
+#define SECONDS_PER_DAY 86400UL
+#define MINUTES_PER_DAY 1440U
+
+// Table-driven: one 32-bit division for the day number, then compares
+// against constant tables (Calendar.cpp) instead of year/month loops.
+DateTime toDateTime(uint32_t t);
+uint32_t toEpoch(const DateTime &dt);
+
+// Midnight of the day containing `t`.
+inline uint32_t dayStart(uint32_t t) { return t - t % SECONDS_PER_DAY; }
+
+// Epoch seconds of hour:minute on the day containing `t`.
+inline uint32_t atTimeOfDay(uint32_t t, uint8_t hour, uint8_t minute) {
+  return dayStart(t) + hour * 3600UL + minute * 60UL;
+}
+
+// The latest hour:minute at or before `t`.
+inline uint32_t lastOccurrence(uint32_t t, uint8_t hour, uint8_t minute) {
+  uint32_t at = atTimeOfDay(t, hour, minute);
+  return at <= t ? at : at - SECONDS_PER_DAY;
+}
+
+#endif  // PILLOTTER_CALENDAR_H
@@ -0,0 +1,81 @@
+#ifndef PILLOTTER_CLOCK_SERVICE_H
+#define PILLOTTER_CLOCK_SERVICE_H
+
+#include <stdint.h>
+
+#include "Calendar.h"
+#include "Hal.h"
+#include "Scheduler.h"
+
+#define CLOCK_RESYNC_MS 60000UL  // read the RTC at most this often
+#define CLOCK_MAX_SLEW_S 5       // larger corrections count as a jump
+
+// Cached wall clock in front of a slow RTC (the DS1302 is bit-banged over
+// three wires). It reads the RTC once per CLOCK_RESYNC_MS, or on the next
+// now() after resync(), and in between counts forward from the millisecond
+// clock. Every read compares the RTC with the interpolated time; the
+// difference is the drift of the millisecond clock against the RTC.
+//
+// Served time never steps back by a small correction: if the RTC is up to
+// CLOCK_MAX_SLEW_S behind us we hold until it catches up. Anything larger
+// (the RTC was set, or lost power) is taken as is and counted as a jump.
+class ClockService : public Clock {
+ public:
+  ClockService(Clock &rtc, ClockFn millis);
+
+  uint32_t now();
+  // The broken-down form of now(), recomputed only when the second changes.
+  const DateTime &dateTime();
+
+  // Forces an RTC read on the next now(), after a sleep the millisecond
+  // clock could only estimate. That reading is taken as is: the estimate's
+  // error is neither drift nor a jump.
+  void resync() { synced_ = false; }
+
+  // After a sleep that stopped the millisecond clock and ended early: reads
+  // the RTC once and returns how long we were out, to the second and at most
+  // `maxMs`. The caller adds exactly that to the millisecond clock; served
+  // time carries on from the reading. Counted in reads().
+  uint32_t measureSleep(uint32_t maxMs);
+
+  uint32_t reads() const { return reads_; }
+  uint32_t served() const { return served_; }
+  uint16_t jumps() const { return jumps_; }
+  // RTC minus interpolated time at the last read, and the worst magnitude
+  // seen, in seconds.
+  int32_t lastDrift() const { return lastDrift_; }
+  uint32_t worstDrift() const { return worstDrift_; }
+  // How far the RTC has moved from the millisecond clock over the last
+  // `driftSpanMs` (since the first read, the last jump or the last sleep the
+  // millisecond clock could only estimate): drift per day is
+  // driftTotal * 86400000 / driftSpanMs.
+  int32_t driftTotal() const { return driftTotal_; }
+  uint32_t driftSpanMs() const { return driftSpanMs_; }
+
+ private:
+  uint32_t readRtc();
+  void sync(uint32_t ms);
+  void anchor(uint32_t rtc, uint32_t ms);
+
+  Clock &rtc_;
+  ClockFn millis_;
+  bool synced_;
+  uint32_t baseEpoch_;  // RTC seconds at baseMs_
+  uint32_t baseMs_;
+  uint32_t last_;  // last value served
+  uint32_t cachedAt_;
+  DateTime cached_;
+
+  uint32_t reads_;
+  uint32_t served_;
+  uint16_t jumps_;
+  int32_t lastDrift_;
+  uint32_t worstDrift_;
+  bool anchored_;
+  uint32_t anchorEpoch_;
+  uint32_t anchorMs_;
+  int32_t driftTotal_;
+  uint32_t driftSpanMs_;
+};
+
+#endif  // PILLOTTER_CLOCK_SERVICE_H
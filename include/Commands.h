@@ -0,0 +1,54 @@
+#ifndef PILLOTTER_COMMANDS_H
+#define PILLOTTER_COMMANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Text.h"
+
+// A console command: the leading letters of a line select the entry and the
+// rest ("1" in "med1", "x y" in "log x y") is passed as `args`. `ctx` is
+// whatever the caller handed to dispatchCommand().
+typedef void (*CommandFn)(void *ctx, StrView args);
+
+struct Command {
+  const char *name;
+  CommandFn fn;
+};
+
+// Binary search over `table`, which must be sorted by strcmp() on name.
+inline const Command *findCommand(const Command *table, uint8_t count,
+                                  StrView word) {
+  uint8_t lo = 0, hi = count;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    const char *name = table[mid].name;
+    int cmp = strncmp(name, word.data(), word.size());
+    if (cmp == 0 && name[word.size()] != '\0') cmp = 1;
+    if (cmp == 0) return &table[mid];
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return NULL;
+}
+
+// Splits `line` into its command word and arguments and runs the match.
+// Returns false for an unknown command.
+inline bool dispatchCommand(const Command *table, uint8_t count,
+                            StrView line, void *ctx = NULL) {
+  size_t n = 0;
+  while (n < line.size() && ((line[n] >= 'a' && line[n] <= 'z') ||
+                             (line[n] >= 'A' && line[n] <= 'Z'))) {
+    n++;
+  }
+  const Command *cmd = findCommand(table, count, line.substr(0, n));
+  if (!cmd) return false;
+  cmd->fn(ctx, line.substr(n).trim());
+  return true;
+}
+
+#endif  // PILLOTTER_COMMANDS_H
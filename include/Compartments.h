@@ -0,0 +1,101 @@
+#ifndef PILLOTTER_COMPARTMENTS_H
+#define PILLOTTER_COMPARTMENTS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Per-compartment schedule. Plain data, no String: 16 bytes per compartment
+// on the ATmega2560 plus its slot in the name pool.
+struct Compartment {
+  uint32_t nextDue;    // epoch seconds (since 2000-01-01) of the next dose
+  uint16_t interval;   // minutes between doses; >= 1440 repeats every N days
+  uint8_t iterations;  // doses per daily course
+  uint8_t baseHour;    // scheduled base time (from app)
+  uint8_t baseMinute;
+  uint8_t nextHour;  // next dispensing time, mirrors nextDue
+  uint8_t nextMinute;
+  uint8_t lastDispensedHour;
+  uint8_t lastDispensedMinute;
+  uint8_t dosesTaken;  // doses given in the current course
+  uint8_t nameSlot;    // index into the name pool
+  bool active;
+};
+
+// Fixed pool of medicine names. Identical names share a slot, so the pool
+// never needs more slots than there are compartments.
+template <uint8_t Slots, uint8_t Len>
+class NamePool {
+ public:
+  static const uint8_t kNone = 0xFF;
+
+  NamePool() { clear(); }
+
+  void clear() {
+    for (uint8_t i = 0; i < Slots; i++) names_[i][0] = '\0';
+    used_ = 0;
+  }
+
+  // Returns the slot holding `name` (truncated to Len - 1 chars), adding it
+  // if needed, or kNone when the pool is full.
+  uint8_t intern(const char *name) {
+    for (uint8_t i = 0; i < used_; i++) {
+      if (strncmp(names_[i], name, Len - 1) == 0) return i;
+    }
+    if (used_ == Slots) return kNone;
+    strncpy(names_[used_], name, Len - 1);
+    names_[used_][Len - 1] = '\0';
+    return used_++;
+  }
+
+  const char *get(uint8_t slot) const {
+    return slot < used_ ? names_[slot] : "";
+  }
+
+ private:
+  char names_[Slots][Len];
+  uint8_t used_;
+};
+
+// Compile-time sized compartment table. Scans are O(N) over a flat array and
+// nothing in here touches the heap.
+template <uint8_t N>
+class ScheduleTable {
+ public:
+  static const uint8_t kCount = N;
+  static const uint8_t kNameLen = 16;
+
+  ScheduleTable() { clear(); }
+
+  void clear() {
+    memset(slots_, 0, sizeof(slots_));
+    for (uint8_t i = 0; i < N; i++) slots_[i].nameSlot = Pool::kNone;
+    names_.clear();
+  }
+
+  Compartment &operator[](uint8_t i) { return slots_[i]; }
+  const Compartment &operator[](uint8_t i) const { return slots_[i]; }
+
+  const char *name(uint8_t i) const { return names_.get(slots_[i].nameSlot); }
+
+  // Renaming re-packs the pool so replaced names do not leak slots.
+  void setName(uint8_t i, const char *name) {
+    char keep[N][kNameLen];
+    for (uint8_t j = 0; j < N; j++) {
+      strncpy(keep[j], j == i ? name : this->name(j), kNameLen - 1);
+      keep[j][kNameLen - 1] = '\0';
+    }
+    names_.clear();
+    for (uint8_t j = 0; j < N; j++) {
+      slots_[j].nameSlot =
+          (keep[j][0] != '\0' || j == i) ? names_.intern(keep[j]) : Pool::kNone;
+    }
+  }
+
+ private:
+  typedef NamePool<N, kNameLen> Pool;
+
+  Compartment slots_[N];
+  Pool names_;
+};
+
+#endif  // PILLOTTER_COMPARTMENTS_H
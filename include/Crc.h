@@ -0,0 +1,14 @@
+#ifndef PILLOTTER_CRC_H
+#define PILLOTTER_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF). Pass a previous result as
+// `crc` to checksum data in pieces.
+uint16_t crc16(const void *data, size_t len, uint16_t crc = 0xFFFF);
+
+// CRC-8 (poly 0x07, init 0x00) for small records.
+uint8_t crc8(const void *data, size_t len, uint8_t crc = 0);
+
+#endif  // PILLOTTER_CRC_H
@@ -0,0 +1,280 @@
+#ifndef PILLOTTER_DISPENSER_H
+#define PILLOTTER_DISPENSER_H
+
+#include <stdint.h>
+
+#include "Commands.h"
+#include "Compartments.h"
+#include "DoseTimeline.h"
+#include "EventLog.h"
+#include "GsmModem.h"
+#include "Histogram.h"
+#include "Hal.h"
+#include "HotState.h"
+#include "LcdFrame.h"
+#include "LineReader.h"
+#include "PickupDetector.h"
+#include "Printer.h"
+#include "Provision.h"
+#include "ScheduleStore.h"
+#include "Scheduler.h"
+#include "ServoMotion.h"
+#include "Text.h"
+
+// Compartment i is "med<i+1>" on the serial console and in the app.
+static const uint8_t kCompartments = 2;
+
+// Everything the dispenser touches outside its own memory. main.cpp wires in
+// the AVR peripherals; src/native/ wires in fakes.
+struct DispenserIo {
+  ClockFn millis;  // scheduler time; keeps counting while the MCU sleeps
+  Clock &rtc;
+  Display &lcd;
+  Actuator *servos[kCompartments];
+  Indicator &buzzer;
+  Indicator &led;
+  PresenceSensor &pickup;
+  FileStore &files;  // SD card
+  Eeprom &eeprom;
+  ByteStream &console;    // USB serial
+  ByteStream &bluetooth;  // app link
+  ByteStream &gsm;        // modem UART
+  RestartFn restart;
+};
+
+// Doses in flight, as of their last phase or escalation change. The board
+// keeps this where a watchdog reset leaves it alone (.noinit RAM) so the
+// dispenser can pick a dose up where it was instead of dispensing it again.
+struct RunCheckpoint {
+  uint16_t magic;
+  uint16_t generation;  // schedule it belongs to
+  struct Dose {
+    uint8_t phase;  // Dispenser::DosePhase
+    uint8_t stage;  // next escalation step
+    uint32_t dueAt;
+    uint32_t startedAt;
+    uint32_t waitStartAt;  // epoch seconds the pill dropped
+  } doses[kCompartments];
+  uint16_t crc;  // CRC-16 over everything before this field
+};
+
+// Called for every dose event as it is logged; host builds use it to trace
+// simulated runs. `at` and `latency` are in seconds.
+typedef void (*DoseEventFn)(void *ctx, uint8_t compartment, DoseEvent type,
+                            uint32_t at, uint32_t latency);
+
+// The dispenser application: provisioning, the dose schedule, persistence,
+// alerts and the serial console. It owns no hardware and never blocks; the
+// board calls begin() once and loop() forever, and may sleep for
+// idleBudget() between calls.
+class Dispenser {
+ public:
+  enum State { SETUP = 0, DISPENSE = 1 };
+
+  explicit Dispenser(const DispenserIo &io);
+
+  // Registers the tasks and loads the saved schedule. Returns true if one
+  // was found and the dispenser went straight to DISPENSE.
+  bool begin();
+  void loop();
+
+  State state() const { return state_; }
+
+  // Milliseconds until the next task is due (Scheduler::idleBudget()).
+  uint32_t idleBudget() const { return sched_.idleBudget(); }
+  // False while a dose is in flight or the modem is mid-send: both need
+  // timers and UARTs running.
+  bool canPowerDown() const;
+  // Writes staged dose-log records out, e.g. before a deliberate reset.
+  void flushLogs() { eventLog_.flush(); }
+
+  // Board-specific console commands tried after the built-in ones (sorted,
+  // as for dispatchCommand()).
+  void setExtraCommands(const Command *table, uint8_t count, void *ctx);
+  void setDoseObserver(DoseEventFn fn, void *ctx);
+  // Where to keep the RunCheckpoint. Call before begin(), which resumes any
+  // dose it holds for the loaded schedule; from then on it is rewritten on
+  // every change.
+  void setCheckpoint(RunCheckpoint *cp) { checkpoint_ = cp; }
+  // True if the checkpoint holds valid state, i.e. RAM survived the reset.
+  bool hasCheckpoint() const;
+
+  // Read access for host builds and board-level reporting.
+  const ScheduleTable<kCompartments> &schedule() const { return meds_; }
+  const Scheduler &scheduler() const { return sched_; }
+  const GsmModem &modem() const { return modem_; }
+  const HotStateLog &hotState() const { return hotState_; }
+  const LcdFrame &lcd() const { return lcd_; }
+  const PickupDetector &pickupDetector() const { return pickup_; }
+  const ServoMotion &motion() const { return motion_; }
+  const Log2Histogram<12> &pickupLatency() const { return pickupLatency_; }
+  EventLog &eventLog() { return eventLog_; }
+
+ private:
+  enum DosePhase { DOSE_IDLE = 0, DOSE_DISPENSING = 1, DOSE_WAITING = 2 };
+
+  // One in-flight dose per compartment.
+  struct DoseRun {
+    Dispenser *owner;
+    uint8_t index;  // compartment
+    DosePhase phase;
+    uint32_t dueAt;      // epoch seconds the dose was due
+    uint32_t startedAt;  // epoch seconds the dose was started
+    uint32_t waitStart;  // millis when the pill dropped
+    uint8_t stage;       // next kEscalation step (Dispenser.cpp)
+    Scheduler::TaskId task;
+  };
+
+  // The buzzer is driven by buzzerTask_: `togglesLeft` on/off edges spaced
+  // `beepMs` apart, then either silent or held on (continuous alarm).
+  struct BuzzerPattern {
+    uint8_t togglesLeft;
+    uint16_t beepMs;
+    bool holdAfter;
+    bool on;
+  };
+
+  // Older apps answer "NewInstance" with one line per field; see
+  // legacyProvisionLine().
+  enum LegacyField {
+    LF_CONTACT,
+    LF_ACTIVE_FIRST,
+    LF_NAME,
+    LF_INTERVAL,
+    LF_ITERATIONS,
+    LF_BASE_HOUR,
+    LF_BASE_MINUTE,
+    LF_NEXT_HOUR,
+    LF_NEXT_MINUTE,
+    LF_ACTIVE_LATE,
+    LF_LAST_HOUR,
+    LF_LAST_MINUTE,
+    LF_IDLE
+  };
+
+  static const uint8_t kLineLen = 48;
+  static const Command kBluetoothCommands[];
+  static const Command kConsoleCommands[];
+
+  // Scheduler task entry points; `self` is the Dispenser (or DoseRun).
+  static void clockStep(void *self);
+  static void checkStep(void *self);
+  static void buzzerStep(void *self);
+  static void gsmStep(void *self);
+  static void eepromStep(void *self);
+  static void logStep(void *self);
+  static void pickupStep(void *self);
+  static void motionStep(void *self);
+  static void doseStep(void *dose);
+
+  // Dose log
+  void logDoseEvent(uint8_t index, DoseEvent type, uint32_t dueAt,
+                    uint32_t at);
+
+  // Buzzer, servo
+  void stepBuzzer();
+  void beepBuzzer(uint8_t times, uint16_t duration, bool holdAfter = false);
+  void continuousBuzzer();
+  void stopBuzzer();
+  void dispensePill(DoseRun &dose);
+  void stepMotion();
+
+  // Persistence
+  bool saveSched();
+  uint16_t schedGeneration() const;
+  void persistDose(uint8_t index);
+  void restoreHotState();
+  void saveCheckpoint();
+  void resumeDoses();
+  bool loadLegacyCsv();
+  bool loadUser();
+  void clearUser();
+
+  // Schedule
+  void setNextDue(uint8_t index, uint32_t due);
+  void rebuildTimeline();
+  void updateSchedule(uint8_t index, uint32_t dueAt, uint32_t startedAt);
+  bool anyDoseWaiting() const;
+  bool anyDoseActive() const;
+  void finishDose(DoseRun &dose);
+  void missDose(DoseRun &dose);
+  void escalate(DoseRun &dose);
+  void restoreAlarm(const DoseRun &dose);
+  DoseRun *oldestWaitingDose();
+  void pollPickup();
+  void checkPickup();
+  void stepDose(DoseRun &dose);
+  void startDose(DoseRun &dose, uint32_t now);
+  void checkAndDispense();
+  void updateClock();
+  void enterDispense();
+
+  // Provisioning
+  void finishLegacyProvisioning();
+  void beginLegacyCompartment(uint8_t i);
+  void startLegacyProvisioning();
+  void legacyProvisionLine(StrView v);
+  void replyFrame(FrameType type, NakReason code);
+  void applyProvisionFrame();
+
+  // Alerts
+  void sendAlert(const char *msg);
+  void stepGsm();
+
+  // Serial input and console reports
+  void bluetoothLine(StrView line);
+  void pollBluetooth();
+  void pollConsole();
+  void printCompartment(int i);
+  void printStoreStats();
+  void printAdherence();
+  void printSchedStats();
+  void printGsmStats();
+  void printLcdStats();
+  void printPickupStats();
+  void printServoStats();
+  void printProfile();
+
+  DispenserIo io_;
+  Printer out_;  // console
+  Printer bt_;   // Bluetooth
+  State state_;
+  LcdFrame lcd_;  // all drawing goes through here, never io_.lcd directly
+
+  ScheduleTable<kCompartments> meds_;
+  DoseTimeline<kCompartments> timeline_;  // active compartments by due time
+  FixedStr<kContactLen> contact_;         // For GSM alerts
+
+  ScheduleStore<kCompartments> schedStore_;
+  HotStateLog hotState_;
+  EventLog eventLog_;
+  GsmModem modem_;
+  Scheduler sched_;
+  Scheduler::TaskId clockTask_, checkTask_, buzzerTask_, gsmTask_,
+      eepromTask_, logTask_, pickupTask_, motionTask_;
+  uint32_t worstLoopMs_;  // longest single loop() pass
+
+  DoseRun doses_[kCompartments];
+  ServoMotion motion_;
+  PickupDetector pickup_;
+  Log2Histogram<12> pickupLatency_;  // beam broken -> dose finished, ms
+  bool pickupPending_;  // confirmed while the servo was still open
+  uint16_t strayPickups_;  // confirmed with no dose in flight
+  BuzzerPattern buzzer_;
+
+  LineReader<kLineLen> consoleLine_;  // USB serial
+  LineReader<kLineLen> btLine_;       // Bluetooth
+  FrameParser provisionParser_;
+  LegacyField legacyField_;
+  uint8_t legacyIndex_;  // compartment being received
+  uint32_t legacyLastLineMs_;
+
+  const Command *extraCommands_;
+  uint8_t extraCommandCount_;
+  void *extraCommandCtx_;
+  DoseEventFn doseObserver_;
+  void *doseObserverCtx_;
+  RunCheckpoint *checkpoint_;
+};
+
+#endif  // PILLOTTER_DISPENSER_H
@@ -0,0 +1,107 @@
+#ifndef PILLOTTER_DOSE_TIMELINE_H
+#define PILLOTTER_DOSE_TIMELINE_H
+
+#include <stdint.h>
+
+// Binary min-heap of absolute due times (epoch seconds), one entry per
+// compartment. The dispense check only ever looks at the head, catches
+// overdue doses with >= instead of matching an exact minute, and tells the
+// caller exactly how long nothing can become due.
+template <uint8_t N>
+class DoseTimeline {
+ public:
+  static const uint8_t kNone = 0xFF;
+  static const uint32_t kNever = 0xFFFFFFFFUL;
+
+  DoseTimeline() { clear(); }
+
+  void clear() {
+    size_ = 0;
+    for (uint8_t i = 0; i < N; i++) pos_[i] = kNone;
+  }
+
+  // Inserts compartment `c` or moves it to its new due time.
+  void set(uint8_t c, uint32_t due) {
+    if (c >= N) return;
+    due_[c] = due;
+    if (pos_[c] == kNone) {
+      pos_[c] = size_;
+      heap_[size_++] = c;
+      siftUp(pos_[c]);
+    } else {
+      siftUp(pos_[c]);
+      siftDown(pos_[c]);
+    }
+  }
+
+  void remove(uint8_t c) {
+    if (c >= N || pos_[c] == kNone) return;
+    uint8_t i = pos_[c];
+    pos_[c] = kNone;
+    if (i == --size_) return;
+    heap_[i] = heap_[size_];
+    pos_[heap_[i]] = i;
+    siftDown(i);
+    siftUp(i);
+  }
+
+  bool contains(uint8_t c) const { return c < N && pos_[c] != kNone; }
+  bool empty() const { return size_ == 0; }
+  uint8_t size() const { return size_; }
+  uint8_t head() const { return size_ ? heap_[0] : kNone; }
+  uint32_t due(uint8_t c) const { return contains(c) ? due_[c] : kNever; }
+
+  // Removes and returns the earliest compartment if it is due at `now`,
+  // otherwise kNone.
+  uint8_t popDue(uint32_t now) {
+    if (size_ == 0 || now < due_[heap_[0]]) return kNone;
+    uint8_t c = heap_[0];
+    remove(c);
+    return c;
+  }
+
+  // Seconds until the head is due: 0 if already overdue, kNever if empty.
+  uint32_t secondsUntilNext(uint32_t now) const {
+    if (size_ == 0) return kNever;
+    uint32_t d = due_[heap_[0]];
+    return d > now ? d - now : 0;
+  }
+
+ private:
+  void swap(uint8_t i, uint8_t j) {
+    uint8_t t = heap_[i];
+    heap_[i] = heap_[j];
+    heap_[j] = t;
+    pos_[heap_[i]] = i;
+    pos_[heap_[j]] = j;
+  }
+
+  void siftUp(uint8_t i) {
+    while (i > 0) {
+      uint8_t parent = (i - 1) / 2;
+      if (due_[heap_[parent]] <= due_[heap_[i]]) break;
+      swap(i, parent);
+      i = parent;
+    }
+  }
+
+  void siftDown(uint8_t i) {
+    for (;;) {
+      uint8_t best = i;
+      uint8_t l = 2 * i + 1;
+      uint8_t r = l + 1;
+      if (l < size_ && due_[heap_[l]] < due_[heap_[best]]) best = l;
+      if (r < size_ && due_[heap_[r]] < due_[heap_[best]]) best = r;
+      if (best == i) break;
+      swap(i, best);
+      i = best;
+    }
+  }
+
+  uint32_t due_[N];  // indexed by compartment
+  uint8_t heap_[N];  // compartments ordered by due_
+  uint8_t pos_[N];   // heap index per compartment, kNone if absent
+  uint8_t size_;
+};
+
+#endif  // PILLOTTER_DOSE_TIMELINE_H
@@ -0,0 +1,93 @@
+#ifndef PILLOTTER_EVENT_LOG_H
+#define PILLOTTER_EVENT_LOG_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+#include "LogWriter.h"
+
+// Binary dose-event log split into one segment file per day.
+//
+// Each segment is "Dnnnnn.BIN" (nnnnn = days since 2000-01-01) holding a
+// 32-byte index header followed by fixed 8-byte records. The header keeps
+// per-type counts, so an adherence query over a date range reads one header
+// per day and never scans records unless a segment was cut short before its
+// header caught up.
+enum DoseEvent {
+  EVENT_DISPENSED = 0,
+  EVENT_TAKEN = 1,
+  EVENT_MISSED = 2,
+  EVENT_LATE = 3,  // taken, but past the late threshold
+  EVENT_KINDS = 4,
+};
+
+static const uint32_t kEventMagic = 0x5645504FUL;  // "OPEV"
+static const uint8_t kEventVersion = 1;
+
+struct __attribute__((packed)) EventRecord {
+  uint32_t offset;   // seconds since the segment's midnight
+  uint8_t compartment;
+  uint8_t type;      // DoseEvent
+  uint16_t latency;  // seconds after the scheduled time, saturating
+};
+
+struct __attribute__((packed)) SegmentHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t recordSize;
+  uint16_t count;     // records covered by byType
+  uint32_t dayStart;  // epoch seconds of the segment's midnight
+  uint16_t byType[EVENT_KINDS];
+  uint16_t crc;  // CRC-16 over the bytes before this field
+  uint8_t reserved[10];
+};
+
+struct EventTotals {
+  uint32_t byType[EVENT_KINDS];
+  uint16_t days;     // segments found in the range
+  uint16_t scanned;  // segments whose header was stale and had to be scanned
+};
+
+class EventLog {
+ public:
+  static const uint8_t kPathLen = 11;  // "D12345.BIN" + NUL
+  static const uint32_t kSecondsPerDay = 86400UL;
+
+  EventLog(FileStore &fs, ClockFn clock, uint32_t maxAgeMs);
+
+  // Stages an event; opens the segment for `when`'s day if needed.
+  bool record(uint32_t when, uint8_t compartment, DoseEvent type,
+              uint32_t latency);
+
+  // Writes staged records and brings the segment header up to date.
+  bool flush();
+
+  // Timer hook: flushes when the staged records get too old. Returns the
+  // delay until the next poll or Scheduler::kNever.
+  uint32_t poll();
+
+  // Sums events over days [firstDay, lastDay] (days since 2000-01-01).
+  void totals(uint16_t firstDay, uint16_t lastDay, EventTotals &out);
+
+  uint16_t staged() const { return writer_.staged(); }
+  uint32_t flushes() const { return writer_.flushes(); }
+
+  static void segmentPath(uint16_t day, char *path);
+
+ private:
+  bool open(uint16_t day);
+  bool writeHeader();
+  void syncHeader();  // rewrite the header after the writer flushed
+
+  FileStore &fs_;
+  char path_[kPathLen];
+  LogWriter writer_;
+  uint16_t day_;
+  bool open_;
+  SegmentHeader header_;
+  uint32_t seenFlushes_;
+};
+
+bool validSegmentHeader(const SegmentHeader &h);
+
+#endif  // PILLOTTER_EVENT_LOG_H
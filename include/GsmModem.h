@@ -0,0 +1,95 @@
+#ifndef PILLOTTER_GSM_MODEM_H
+#define PILLOTTER_GSM_MODEM_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+#include "Scheduler.h"
+
+// Outbound SMS pipeline for a SIM800-style modem.
+//
+// Messages are copied into a fixed ring buffer and sent by an AT-command
+// state machine that waits on the modem's real responses (OK, the '>' body
+// prompt, +CMGS/ERROR) instead of fixed sleeps. poll() never blocks; it reads
+// whatever the modem has sent, advances at most one step and returns how long
+// the caller may wait before polling again.
+class GsmModem {
+ public:
+  static const uint8_t kQueueLen = 4;
+  static const uint8_t kMaxText = 64;     // SMS body incl. terminator
+  static const uint8_t kMaxNumber = 20;   // recipient incl. terminator
+  static const uint8_t kMaxAttempts = 3;  // per message
+  static const uint32_t kPollMs = 20;
+  static const uint32_t kCommandTimeoutMs = 2000;
+  static const uint32_t kPromptTimeoutMs = 5000;
+  static const uint32_t kSendTimeoutMs = 60000;  // network delivery report
+  static const uint32_t kRetryBackoffMs = 3000;
+
+  GsmModem(ByteStream &port, ClockFn clock);
+
+  void setRecipient(const char *number);
+
+  // Queues `text`. Identical messages already pending are not queued twice.
+  // Returns false only if the queue is full.
+  bool enqueue(const char *text);
+
+  // Advances the state machine. Returns the delay until the next poll, or
+  // Scheduler::kNever when there is nothing left to do.
+  uint32_t poll();
+
+  bool busy() const { return count_ > 0; }
+  uint8_t pending() const { return count_; }
+
+  uint16_t sent() const { return sent_; }
+  uint16_t failed() const { return failed_; }
+  uint16_t dropped() const { return dropped_; }
+  uint16_t deduped() const { return deduped_; }
+  uint16_t retries() const { return retries_; }
+  uint32_t busyMs() const { return busyMs_; }  // total time spent sending
+
+ private:
+  enum Stage {
+    IDLE,
+    WAIT_CMGF,    // AT+CMGF=1 -> OK
+    WAIT_PROMPT,  // AT+CMGS="..." -> '>'
+    WAIT_RESULT,  // body + Ctrl+Z -> +CMGS: n / OK
+    BACKOFF,
+  };
+
+  struct Message {
+    char text[kMaxText];
+    uint8_t attempts;
+  };
+
+  bool readLine();  // true when a complete response line is in line_
+  bool lineIs(const char *s) const;
+  bool lineStarts(const char *s) const;
+  void begin();
+  void sendCmgs();
+  void succeed();
+  void fail();
+  void enter(Stage stage, uint32_t timeoutMs);
+
+  ByteStream &port_;
+  ClockFn clock_;
+  char recipient_[kMaxNumber];
+  Message queue_[kQueueLen];
+  uint8_t head_;
+  uint8_t count_;
+  Stage stage_;
+  uint32_t stageDeadline_;
+  uint32_t startedAt_;
+  bool textMode_;  // AT+CMGF=1 acknowledged since the last error
+  bool gotRef_;    // +CMGS: seen for the current message
+  char line_[24];
+  uint8_t lineLen_;
+
+  uint16_t sent_;
+  uint16_t failed_;
+  uint16_t dropped_;
+  uint16_t deduped_;
+  uint16_t retries_;
+  uint32_t busyMs_;
+};
+
+#endif  // PILLOTTER_GSM_MODEM_H
@@ -0,0 +1,110 @@
+#ifndef PILLOTTER_HAL_H
+#define PILLOTTER_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Minimal byte-stream link (GSM modem UART, Bluetooth UART, ...). The AVR
+// build wraps an Arduino Stream; host builds plug in scripted fakes.
+class ByteStream {
+ public:
+  virtual ~ByteStream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;  // -1 when nothing is buffered
+  virtual size_t write(const uint8_t *buf, size_t len) = 0;
+  // False when output is known to go nowhere, so routine chatter need not
+  // even be formatted. A UART cannot tell and always says true.
+  virtual bool listening() { return true; }
+
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+};
+
+// File storage (SD card on the AVR build). write() starts at byte 0,
+// overwrites in place and never truncates, so a fixed-size file can be
+// rewritten without ever deleting it first. Logs use append().
+class FileStore {
+ public:
+  virtual ~FileStore() {}
+  virtual bool exists(const char *path) = 0;
+  virtual bool remove(const char *path) = 0;
+  // Returns the number of bytes read, or -1 if the file cannot be opened.
+  virtual int readAt(const char *path, uint32_t offset, void *buf,
+                     uint16_t len) = 0;
+  int read(const char *path, void *buf, uint16_t len) {
+    return readAt(path, 0, buf, len);
+  }
+  // Returns the number of bytes written, or -1 if the file cannot be opened.
+  virtual int write(const char *path, const void *buf, uint16_t len) = 0;
+  // Appends at the end of the file, creating it if needed.
+  virtual int append(const char *path, const void *buf, uint16_t len) = 0;
+  // File size in bytes, 0 if it does not exist.
+  virtual uint32_t size(const char *path) = 0;
+};
+
+// Byte-addressed EEPROM. write() only starts a byte write; callers poll
+// ready() between bytes so a multi-byte update never blocks the loop.
+// Implementations skip writes that would not change the cell.
+class Eeprom {
+ public:
+  virtual ~Eeprom() {}
+  virtual uint16_t size() = 0;
+  virtual uint8_t read(uint16_t addr) = 0;
+  virtual bool ready() = 0;
+  virtual void write(uint16_t addr, uint8_t value) = 0;
+};
+
+// Wall clock in seconds since 2000-01-01 00:00 (the DS1302 RTC on the AVR
+// build). Millisecond timing goes through a ClockFn instead (Scheduler.h).
+class Clock {
+ public:
+  virtual ~Clock() {}
+  virtual uint32_t now() = 0;
+};
+
+// Character display (16x2 LCD on the AVR build).
+class Display {
+ public:
+  virtual ~Display() {}
+  virtual void clear() = 0;
+  virtual void setCursor(uint8_t col, uint8_t row) = 0;
+  virtual void print(const char *text) = 0;
+};
+
+// Positional actuator: one compartment's servo, angle in degrees. write()
+// drives it (attaching it if needed); detach() stops the drive so an idle
+// servo draws no holding current.
+class Actuator {
+ public:
+  virtual ~Actuator() {}
+  virtual void write(uint8_t angle) = 0;
+  virtual void detach() = 0;
+};
+
+// On/off output: buzzer, LED.
+class Indicator {
+ public:
+  virtual ~Indicator() {}
+  virtual void set(bool on) = 0;
+};
+
+// One level change of the pickup sensor, timestamped in ClockFn millis.
+// `active` is true while the beam is broken (a pill is being taken).
+struct SensorEdge {
+  uint32_t at;
+  bool active;
+};
+
+// Pickup sensor under the tray (IR on the AVR build). Edges are captured as
+// they happen (by an interrupt on the board) and handed over in order.
+class PresenceSensor {
+ public:
+  virtual ~PresenceSensor() {}
+  virtual bool nextEdge(SensorEdge &edge) = 0;
+};
+
+// Reboots the board. Does not return on hardware.
+typedef void (*RestartFn)();
+
+#endif  // PILLOTTER_HAL_H
@@ -0,0 +1,67 @@
+#ifndef PILLOTTER_HISTOGRAM_H
+#define PILLOTTER_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Duration histogram (ms or us) with power-of-two buckets: bucket 0 counts
+// values below 2, bucket i counts [2^i, 2^(i+1)), and the last bucket takes
+// everything above. Fixed size, no division on record(). Counts are 32-bit so
+// a point timed every loop pass cannot saturate one bucket and skew the
+// percentiles against total().
+template <uint8_t Buckets>
+class Log2Histogram {
+ public:
+  Log2Histogram() { reset(); }
+
+  void reset() {
+    for (uint8_t i = 0; i < Buckets; i++) counts_[i] = 0;
+    total_ = 0;
+    sum_ = 0;
+    min_ = 0xFFFFFFFFUL;
+    max_ = 0;
+  }
+
+  void record(uint32_t v) {
+    uint8_t b = 0;
+    for (uint32_t x = v >> 1; x && b < Buckets - 1; x >>= 1) b++;
+    counts_[b]++;
+    total_++;
+    sum_ += v;
+    if (v < min_) min_ = v;
+    if (v > max_) max_ = v;
+  }
+
+  uint8_t buckets() const { return Buckets; }
+  uint32_t count(uint8_t bucket) const { return counts_[bucket]; }
+  // Lower edge of a bucket.
+  static uint32_t floor(uint8_t bucket) { return bucket ? 1UL << bucket : 0; }
+
+  uint32_t total() const { return total_; }
+  uint32_t min() const { return total_ ? min_ : 0; }
+  uint32_t max() const { return max_; }
+  uint32_t mean() const { return total_ ? sum_ / total_ : 0; }
+
+  // Upper edge of the bucket holding the p-th percentile (0-100), capped at
+  // max(): an upper bound, good to a factor of two.
+  uint32_t percentile(uint8_t p) const {
+    uint32_t rank = ((uint64_t)total_ * p + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i + 1 < Buckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank && seen) {
+        uint32_t top = floor(i + 1) - 1;
+        return top < max_ ? top : max_;
+      }
+    }
+    return max_;
+  }
+
+ private:
+  uint32_t counts_[Buckets];
+  uint32_t total_;
+  uint64_t sum_;  // microsecond samples add up fast
+  uint32_t min_;
+  uint32_t max_;
+};
+
+#endif  // PILLOTTER_HISTOGRAM_H
@@ -0,0 +1,109 @@
+#ifndef PILLOTTER_HOT_STATE_H
+#define PILLOTTER_HOT_STATE_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+
+// Per-dose mutable state, the only part of the schedule that changes after
+// provisioning.
+struct HotRecord {
+  uint32_t nextDue;
+  uint8_t dosesTaken;
+  uint8_t lastDispensedHour;
+  uint8_t lastDispensedMinute;
+  uint8_t inFlight;  // nextDue has been dispensed and is not finished yet
+};
+
+// Wear-leveled ring of small fixed records in EEPROM.
+//
+// Every save appends one 16-byte record (sequence, config generation,
+// compartment, HotRecord, CRC-8) at the next ring slot, so each cell is
+// rewritten once per `slots` saves. The newest valid record per compartment
+// wins on boot; records written under an older schedule generation are
+// ignored. Bytes are written one at a time from pump() whenever the EEPROM is
+// ready, so save() itself costs microseconds.
+//
+// A compartment that saves rarely (a dose every few days) would see its only
+// record lapped by the others. The head never overwrites a compartment's
+// newest record: one about to be reached is copied into the slot ahead of it
+// first, so it keeps moving with the ring and its sequence stays recent.
+class HotStateLog {
+ public:
+  static const uint8_t kRecordSize = 16;
+  static const uint8_t kMaxPending = 4;
+  // Compartments whose newest record is kept alive (see above).
+  static const uint8_t kMaxCompartments = 4;
+
+  HotStateLog(Eeprom &ee, uint16_t base, uint16_t bytes);
+
+  // Scans the ring for the write position. Call once before save().
+  void begin();
+
+  // Newest record for compartment `c` written under `generation`.
+  bool latest(uint8_t c, uint16_t generation, HotRecord &out);
+
+  // Queues a record, plus a copy of any newest record the head is about to
+  // reach. Returns false if they do not all fit in the kMaxPending queue.
+  bool save(uint8_t c, uint16_t generation, const HotRecord &rec);
+
+  // Writes queued bytes while the EEPROM is ready. Returns true while there
+  // is still something left to write.
+  bool pump();
+  bool busy() const { return pendingCount_ > 0; }
+
+  // Highest schedule generation any record in the ring was written under,
+  // 0 if there are none. A new schedule must be numbered above it.
+  uint16_t highestGeneration() const { return highestGeneration_; }
+
+  uint16_t slots() const { return slots_; }
+  uint32_t recordsWritten() const { return recordsWritten_; }
+  uint32_t bytesWritten() const { return bytesWritten_; }
+
+ private:
+  struct __attribute__((packed)) Raw {
+    uint8_t magic;  // written last, cleared first
+    uint8_t compartment;
+    uint16_t sequence;
+    uint16_t generation;
+    uint32_t nextDue;
+    uint8_t dosesTaken;
+    uint8_t lastDispensedHour;
+    uint8_t lastDispensedMinute;
+    uint8_t inFlight;  // was reserved (zero) in older records
+    uint8_t reserved;
+    uint8_t crc;  // CRC-8 over every byte before this one except magic
+  };
+
+  static const uint16_t kNoSlot = 0xFFFF;
+
+  bool readSlot(uint16_t slot, Raw &raw);
+  uint16_t addr(uint16_t slot) const { return base_ + slot * kRecordSize; }
+  uint16_t next(uint16_t slot) const {
+    return slot + 1 < slots_ ? slot + 1 : 0;
+  }
+  // Compartment whose newest record under `generation` is in `slot`, or
+  // kMaxCompartments.
+  uint8_t liveOwner(uint16_t slot, uint16_t generation) const;
+  void enqueue(Raw &raw);
+
+  Eeprom &ee_;
+  uint16_t base_;
+  uint16_t slots_;
+  uint16_t head_;  // next slot to write
+  uint16_t nextSequence_;
+  uint16_t highestGeneration_;
+  uint16_t liveSlot_[kMaxCompartments];  // newest record, or kNoSlot
+  uint16_t liveGeneration_[kMaxCompartments];
+
+  Raw pending_[kMaxPending];
+  uint16_t pendingSlot_[kMaxPending];
+  uint8_t pendingHead_;
+  uint8_t pendingCount_;
+  uint8_t pendingByte_;  // progress through pending_[pendingHead_]
+
+  uint32_t recordsWritten_;
+  uint32_t bytesWritten_;
+};
+
+#endif  // PILLOTTER_HOT_STATE_H
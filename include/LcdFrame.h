@@ -0,0 +1,50 @@
+#ifndef PILLOTTER_LCD_FRAME_H
+#define PILLOTTER_LCD_FRAME_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+// The I2C backpack drives the HD44780 in 4-bit mode: each byte is two
+// nibbles, and each nibble is a data write plus an enable pulse (high, low).
+#define LCD_I2C_WRITES_PER_BYTE 6
+
+// Shadow framebuffer for the 16x2 LCD. Callers compose the whole screen in
+// RAM, then flush() sends only the cells that differ from what the panel is
+// showing: one cursor move per run of changed cells, then the characters.
+// clear() on the panel costs ~2 ms and blanks it visibly, so the frame never
+// uses it after reset().
+class LcdFrame {
+ public:
+  explicit LcdFrame(Display &lcd);
+
+  // Clears the panel and resyncs the shadow. Call once at boot, or if
+  // something else has written to the display.
+  void reset();
+
+  // Blanks the frame (RAM only).
+  void clear();
+  // Writes `text` at (col, row), clipped to the row.
+  void print(uint8_t col, uint8_t row, const char *text);
+  // Replaces a whole row: `text` from column 0, blank-padded to the end.
+  void printRow(uint8_t row, const char *text);
+
+  // Pushes the differences to the panel. Returns the bytes sent.
+  uint16_t flush();
+
+  // Bytes (commands + characters) sent to the panel so far.
+  uint32_t bytesSent() const { return bytes_; }
+  uint32_t i2cWrites() const { return bytes_ * LCD_I2C_WRITES_PER_BYTE; }
+  uint32_t flushes() const { return flushes_; }
+
+ private:
+  Display &lcd_;
+  char frame_[LCD_ROWS][LCD_COLS];
+  char shown_[LCD_ROWS][LCD_COLS];
+  uint32_t bytes_;
+  uint32_t flushes_;
+};
+
+#endif  // PILLOTTER_LCD_FRAME_H
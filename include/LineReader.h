@@ -0,0 +1,65 @@
+#ifndef PILLOTTER_LINE_READER_H
+#define PILLOTTER_LINE_READER_H
+
+#include <stdint.h>
+
+#include "Text.h"
+
+// Assembles newline-terminated lines one byte at a time, so a half-received
+// line never stalls the caller. Lines longer than N - 1 bytes are discarded
+// up to their newline and counted.
+template <uint8_t N>
+class LineReader {
+ public:
+  LineReader() : len_(0), ready_(false), overflow_(false), overflows_(0) {}
+
+  // Adds one byte. Returns true when it completed a line, which stays
+  // available from line() until the next push().
+  bool push(uint8_t b) {
+    if (ready_) {
+      len_ = 0;
+      ready_ = false;
+    }
+    if (b == '\n') {
+      bool dropped = overflow_;
+      overflow_ = false;
+      if (dropped) {
+        len_ = 0;
+        return false;
+      }
+      buf_[len_] = '\0';
+      ready_ = true;
+      return true;
+    }
+    if (len_ == N - 1) {
+      if (!overflow_) overflows_++;
+      overflow_ = true;
+    } else {
+      buf_[len_++] = (char)b;
+    }
+    return false;
+  }
+
+  // Trimmed view of the completed line.
+  StrView line() const { return StrView(buf_, len_).trim(); }
+
+  // True when no partial line is buffered.
+  bool empty() const { return ready_ || (len_ == 0 && !overflow_); }
+
+  void clear() {
+    len_ = 0;
+    ready_ = false;
+    overflow_ = false;
+  }
+
+  uint16_t overflows() const { return overflows_; }
+
+ private:
+  char buf_[N];
+  uint8_t len_;
+  bool ready_;
+  bool overflow_;
+  uint16_t overflows_;
+};
+
+#endif  // PILLOTTER_LINE_READER_H
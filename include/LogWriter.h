@@ -0,0 +1,60 @@
+#ifndef PILLOTTER_LOG_WRITER_H
+#define PILLOTTER_LOG_WRITER_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+#include "Scheduler.h"
+
+// Append-only log with a RAM staging buffer of one SD sector.
+//
+// Bytes are staged and only reach the card when the buffer completes a
+// sector of the file, when the oldest staged byte is older than `maxAgeMs`,
+// or on an explicit flush() (before a reset). Flushes are sized so every
+// write after the first ends on a 512-byte file boundary, i.e. each flush
+// touches exactly one data sector. A power cut loses at most one sector or
+// `maxAgeMs` worth of entries, whichever comes first.
+class LogWriter {
+ public:
+  static const uint16_t kSectorSize = 512;
+
+  LogWriter(FileStore &fs, const char *path, ClockFn clock, uint32_t maxAgeMs);
+
+  // Learns the current file size so flushes stay sector-aligned.
+  void begin();
+
+  // Stages `len` bytes, flushing whenever a sector fills up.
+  bool write(const void *data, uint16_t len);
+  bool print(const char *s);
+
+  bool flush();
+
+  // Flushes if the staged data is too old. Returns the delay until it will
+  // be, or Scheduler::kNever when nothing is staged.
+  uint32_t poll();
+
+  uint16_t staged() const { return used_; }
+  uint32_t flushes() const { return flushes_; }
+  uint32_t bytesLogged() const { return bytes_; }
+  uint32_t dropped() const { return dropped_; }
+  uint16_t failures() const { return failures_; }
+
+ private:
+  uint16_t room() const;  // bytes until the next sector boundary
+
+  FileStore &fs_;
+  const char *path_;
+  ClockFn clock_;
+  uint32_t maxAgeMs_;
+  uint32_t fileSize_;
+  uint32_t oldestAt_;  // clock when the first staged byte arrived
+  uint16_t used_;
+  uint8_t buf_[kSectorSize];
+
+  uint32_t flushes_;
+  uint32_t bytes_;
+  uint32_t dropped_;
+  uint16_t failures_;
+};
+
+#endif  // PILLOTTER_LOG_WRITER_H
@@ -0,0 +1,96 @@
+#ifndef PILLOTTER_PICKUP_DETECTOR_H
+#define PILLOTTER_PICKUP_DETECTOR_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+
+#define PICKUP_DEBOUNCE_MS 30  // gaps and pulses shorter than this are noise
+#define PICKUP_HOLD_MS 150     // the beam must stay broken this long
+
+// Single-producer, single-consumer ring of timestamped sensor edges: the
+// sampling interrupt pushes, the main loop pops. Capacity must be a power of
+// two. push() fails when full; the producer should then keep its old level
+// so the edge is retried (with a later timestamp) instead of lost.
+template <uint8_t Capacity>
+class EdgeQueue {
+ public:
+  EdgeQueue() : head_(0), tail_(0), overflows_(0) {}
+
+  bool push(uint32_t at, bool active) {
+    uint8_t next = (head_ + 1) & (Capacity - 1);
+    if (next == tail_) {
+      overflows_++;
+      return false;
+    }
+    at_[head_] = at;
+    active_[head_] = active;
+    head_ = next;  // publish after the slot is written
+    return true;
+  }
+
+  bool pop(SensorEdge &edge) {
+    if (tail_ == head_) return false;
+    edge.at = at_[tail_];
+    edge.active = active_[tail_];
+    tail_ = (tail_ + 1) & (Capacity - 1);
+    return true;
+  }
+
+  uint16_t overflows() const { return overflows_; }
+
+ private:
+  volatile uint32_t at_[Capacity];
+  volatile bool active_[Capacity];
+  volatile uint8_t head_;
+  volatile uint8_t tail_;
+  volatile uint16_t overflows_;
+};
+
+// Turns raw sensor edges into pickups:
+//
+//   WAITING --active--> DETECTED --held PICKUP_HOLD_MS--> CONFIRMED
+//      ^                   |                                  |
+//      +------- clear for PICKUP_DEBOUNCE_MS -----------------+
+//
+// A gap shorter than the debounce time is ridden out in either state, so a
+// bouncing signal confirms once and a bounce after confirming does not
+// count a second pickup; a pulse that never lasts the hold time never
+// confirms. All decisions use edge timestamps, so the result does not
+// depend on how late the main loop gets to the queue.
+class PickupDetector {
+ public:
+  enum State { WAITING = 0, DETECTED = 1, CONFIRMED = 2 };
+  static const uint32_t kNever = 0xFFFFFFFFUL;
+
+  explicit PickupDetector(uint16_t debounceMs = PICKUP_DEBOUNCE_MS,
+                          uint16_t holdMs = PICKUP_HOLD_MS);
+
+  // Feeds one edge, in timestamp order.
+  void edge(uint32_t at, bool active);
+  // Applies the time-based transitions due by `now`.
+  void advance(uint32_t now);
+
+  // True once per confirmed pickup; `at` is when the beam first broke.
+  bool take(uint32_t &at);
+
+  // Milliseconds until advance() could change anything, or kNever.
+  uint32_t msUntilChange(uint32_t now) const;
+
+  State state() const { return state_; }
+  uint16_t rejected() const { return rejected_; }  // pulses that never held
+  uint16_t bounces() const { return bounces_; }    // short gaps ridden out
+
+ private:
+  uint16_t debounceMs_;
+  uint16_t holdMs_;
+  State state_;
+  bool releasing_;  // beam clear since releasedAt_, within the debounce
+  bool ready_;      // confirmed and not taken yet
+  uint32_t detectedAt_;
+  uint32_t releasedAt_;
+  uint16_t rejected_;
+  uint16_t bounces_;
+};
+
+#endif  // PILLOTTER_PICKUP_DETECTOR_H
@@ -0,0 +1,40 @@
+#ifndef PILLOTTER_POWER_STATS_H
+#define PILLOTTER_POWER_STATS_H
+
+#include <stdint.h>
+
+// Where the MCU spent its time, with a rough charge estimate from nominal
+// ATmega2560 supply currents at 16 MHz / 5 V (board peripherals excluded).
+struct PowerStats {
+  enum Wake { WAKE_WATCHDOG = 0, WAKE_SERIAL = 1, WAKE_OTHER = 2, WAKE_KINDS };
+
+  static const uint16_t kActiveUa = 14000;
+  static const uint16_t kIdleUa = 6000;
+  static const uint16_t kPowerDownUa = 60;  // watchdog running
+
+  uint32_t activeMs;
+  uint32_t idleMs;       // SLEEP_MODE_IDLE, timer0 still ticking
+  uint32_t powerDownMs;  // SLEEP_MODE_PWR_DOWN
+  uint32_t wakes[WAKE_KINDS];
+
+  void reset() {
+    activeMs = idleMs = powerDownMs = 0;
+    for (uint8_t i = 0; i < WAKE_KINDS; i++) wakes[i] = 0;
+  }
+
+  uint32_t totalWakes() const {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < WAKE_KINDS; i++) n += wakes[i];
+    return n;
+  }
+
+  // Estimated charge in microamp-hours.
+  uint32_t chargeUah() const {
+    // ms * uA / 3.6e6 = uAh; split to stay inside 32 bits.
+    return (activeMs / 1000UL) * kActiveUa / 3600UL +
+           (idleMs / 1000UL) * kIdleUa / 3600UL +
+           (powerDownMs / 1000UL) * kPowerDownUa / 3600UL;
+  }
+};
+
+#endif  // PILLOTTER_POWER_STATS_H
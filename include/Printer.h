@@ -0,0 +1,66 @@
+#ifndef PILLOTTER_PRINTER_H
+#define PILLOTTER_PRINTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Hal.h"
+#include "Text.h"
+
+// Arduino-style print()/println() on top of a ByteStream, so the same
+// reporting code runs against a UART on the board and a fake on the host.
+class Printer {
+ public:
+  explicit Printer(ByteStream &out) : out_(out) {}
+
+  void print(const char *s) { out_.write(s); }
+  void print(StrView s) { out_.write((const uint8_t *)s.data(), s.size()); }
+  void print(char c) { out_.write((uint8_t)c); }
+  void print(int v) { print((long)v); }
+  void print(unsigned int v) { print((unsigned long)v); }
+  void print(long v);
+  void print(unsigned long v);
+
+  void println() { out_.write("\r\n"); }
+  template <typename T>
+  void println(T v) {
+    print(v);
+    println();
+  }
+
+  ByteStream &stream() { return out_; }
+
+ private:
+  ByteStream &out_;
+};
+
+// Fixed-capacity, NUL-terminated text sink. Output past the end is dropped.
+template <uint16_t N>
+class TextBuffer : public ByteStream {
+ public:
+  TextBuffer() : len_(0) { buf_[0] = '\0'; }
+
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(const uint8_t *buf, size_t len) {
+    size_t room = N - 1 - len_;
+    if (len > room) len = room;
+    for (size_t i = 0; i < len; i++) buf_[len_++] = (char)buf[i];
+    buf_[len_] = '\0';
+    return len;
+  }
+  using ByteStream::write;
+
+  const char *c_str() const { return buf_; }
+  uint16_t length() const { return len_; }
+  void clear() {
+    len_ = 0;
+    buf_[0] = '\0';
+  }
+
+ private:
+  char buf_[N];
+  uint16_t len_;
+};
+
+#endif  // PILLOTTER_PRINTER_H
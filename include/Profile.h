@@ -0,0 +1,62 @@
+#ifndef PILLOTTER_PROFILE_H
+#define PILLOTTER_PROFILE_H
+
+#include <stdint.h>
+
+#include "Histogram.h"
+#include "Printer.h"
+#include "Scheduler.h"
+
+// Hot-path timers. With -DPILLOTTER_PROFILE each PROFILE_SCOPE(point) times
+// the rest of its block with the microsecond clock given to
+// Profiler::setClock() and adds it to that point's histogram; without it the
+// macro is empty, Profiler has no storage and the firmware is unchanged.
+enum ProfilePoint {
+  PROF_LOOP,        // one Dispenser::loop() pass
+  PROF_SD_WRITE,    // a FileStore write or append: open, write, close
+  PROF_RTC_READ,    // one read of the hardware clock
+  PROF_LCD_FLUSH,   // LcdFrame::flush()
+  PROF_GSM_POLL,    // one GsmModem::poll() step, UART writes included
+  PROF_SERVO_STEP,  // one ServoMotion::step()
+  PROF_POINTS
+};
+
+// Microseconds; the last bucket takes everything from about a second up.
+typedef Log2Histogram<21> ProfileHistogram;
+
+class Profiler {
+ public:
+  static void setClock(ClockFn micros);
+  static uint32_t now();
+  static void record(ProfilePoint point, uint32_t us);
+  static void reset();
+
+  static const char *name(ProfilePoint point);
+  static const ProfileHistogram &histogram(ProfilePoint point);
+
+  // One line per point that has samples: count, min, avg, p99, max in us.
+  static void print(Printer &out);
+  // The same counters as one JSON object keyed by point name.
+  static void printJson(Printer &out);
+};
+
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfilePoint point)
+      : point_(point), start_(Profiler::now()) {}
+  ~ProfileScope() { Profiler::record(point_, Profiler::now() - start_); }
+
+ private:
+  ProfilePoint point_;
+  uint32_t start_;
+};
+
+#ifdef PILLOTTER_PROFILE
+#define PROFILE_SCOPE(point) ProfileScope profileScope_##point(point)
+#else
+#define PROFILE_SCOPE(point) \
+  do {                       \
+  } while (0)
+#endif
+
+#endif  // PILLOTTER_PROFILE_H
@@ -0,0 +1,138 @@
+#ifndef PILLOTTER_PROVISION_H
+#define PILLOTTER_PROVISION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ScheduleFile.h"
+
+// Framed messages on the Bluetooth link. The app sends the whole schedule in
+// one FRAME_SCHEDULE and the dispenser answers FRAME_ACK or FRAME_NAK:
+//
+//   SOF  version  type  length(u16 LE)  payload[length]  crc16(u16 LE)
+//
+// The CRC-16/CCITT covers version through the end of the payload. A lost or
+// corrupted byte costs one NAK and a resend, not a desynchronized session.
+static const uint8_t kFrameSof = 0x7E;
+static const uint8_t kFrameVersion = 1;
+static const uint16_t kFrameMaxPayload = 160;
+static const uint8_t kFrameOverhead = 7;  // SOF, version, type, length, crc
+
+enum FrameType { FRAME_SCHEDULE = 1, FRAME_ACK = 2, FRAME_NAK = 3 };
+
+// One-byte payload of FRAME_ACK (NAK_NONE) and FRAME_NAK.
+enum NakReason {
+  NAK_NONE = 0,
+  NAK_CRC,      // checksum mismatch
+  NAK_VERSION,  // unknown frame version
+  NAK_LENGTH,   // payload longer than kFrameMaxPayload
+  NAK_PAYLOAD,  // frame type or schedule contents not understood
+  NAK_STORAGE,  // schedule accepted but could not be saved
+  NAK_TIMEOUT   // frame stopped arriving part way through
+};
+
+// FRAME_SCHEDULE payload: this header, then `count` CompartmentRecords.
+struct __attribute__((packed)) ProvisionHeader {
+  char contact[kContactLen];
+  uint8_t count;
+  uint8_t recordSize;  // sizeof(CompartmentRecord)
+};
+
+// Writes a complete frame to `out`, which must hold len + kFrameOverhead
+// bytes. Returns the frame size.
+size_t encodeFrame(uint8_t type, const void *payload, uint16_t len,
+                   uint8_t *out);
+
+// Byte-at-a-time frame decoder. Never blocks; feed it whatever the UART has.
+class FrameParser {
+ public:
+  enum Result { FRAME_NONE, FRAME_READY, FRAME_ERROR };
+
+  // A frame whose bytes stop arriving for byteTimeoutMs is dropped.
+  explicit FrameParser(uint32_t byteTimeoutMs = 500);
+
+  Result feed(uint8_t b, uint32_t nowMs);
+  // Drops a stalled partial frame; true if one was dropped.
+  bool expire(uint32_t nowMs);
+  void reset() { stage_ = HUNT; }
+
+  // True while waiting for a start-of-frame byte.
+  bool idle() const { return stage_ == HUNT; }
+
+  // Valid after FRAME_READY until the next feed().
+  uint8_t type() const { return type_; }
+  const uint8_t *payload() const { return buf_; }
+  uint16_t length() const { return len_; }
+  // Valid after FRAME_ERROR.
+  NakReason error() const { return error_; }
+
+  uint16_t frames() const { return frames_; }
+  uint16_t errors() const { return errors_; }
+
+ private:
+  enum Stage { HUNT, VERSION, TYPE, LEN_LO, LEN_HI, PAYLOAD, CRC_LO, CRC_HI };
+
+  Result fail(NakReason why);
+
+  uint32_t timeoutMs_;
+  uint32_t lastByteMs_;
+  Stage stage_;
+  uint8_t version_;
+  uint8_t type_;
+  uint16_t len_;
+  uint16_t pos_;
+  uint16_t crc_;
+  uint16_t rxCrc_;
+  NakReason error_;
+  uint16_t frames_;
+  uint16_t errors_;
+  uint8_t buf_[kFrameMaxPayload];
+};
+
+// Builds a FRAME_SCHEDULE payload from the first `count` compartments of
+// `table`. `out` must hold sizeof(ProvisionHeader) + count records.
+template <uint8_t N>
+uint16_t encodeProvision(const ScheduleTable<N> &table, const char *contact,
+                         uint8_t *out, uint8_t count = N) {
+  ProvisionHeader h;
+  memset(&h, 0, sizeof(h));
+  strncpy(h.contact, contact, kContactLen - 1);
+  h.count = count;
+  h.recordSize = sizeof(CompartmentRecord);
+  memcpy(out, &h, sizeof(h));
+  uint16_t len = sizeof(h);
+  for (uint8_t i = 0; i < count; i++, len += sizeof(CompartmentRecord)) {
+    CompartmentRecord r;
+    encodeRecord(table, i, r);
+    memcpy(out + len, &r, sizeof(r));
+  }
+  return len;
+}
+
+// Checks a FRAME_SCHEDULE payload and, only if it is well formed, loads it
+// into `table`. Compartments the app did not send are left inactive.
+// `contact` must hold kContactLen chars.
+template <uint8_t N>
+bool decodeProvision(const uint8_t *p, uint16_t len, ScheduleTable<N> &table,
+                     char *contact) {
+  ProvisionHeader h;
+  if (len < sizeof(h)) return false;
+  memcpy(&h, p, sizeof(h));
+  if (h.count > N || h.recordSize != sizeof(CompartmentRecord) ||
+      len != sizeof(h) + h.count * sizeof(CompartmentRecord)) {
+    return false;
+  }
+  table.clear();
+  memcpy(contact, h.contact, kContactLen);
+  contact[kContactLen - 1] = '\0';
+  p += sizeof(h);
+  for (uint8_t i = 0; i < h.count; i++, p += sizeof(CompartmentRecord)) {
+    CompartmentRecord r;
+    memcpy(&r, p, sizeof(r));
+    decodeRecord(r, table, i);
+  }
+  return true;
+}
+
+#endif  // PILLOTTER_PROVISION_H
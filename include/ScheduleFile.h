@@ -0,0 +1,244 @@
+#ifndef PILLOTTER_SCHEDULE_FILE_H
+#define PILLOTTER_SCHEDULE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Compartments.h"
+#include "Crc.h"
+#include "Printer.h"
+
+// Binary schedule image: a header followed by one fixed-size record per
+// compartment, written with a single block write and read back with a
+// single read. Layout is packed little-endian so AVR and host builds agree.
+static const uint32_t kScheduleMagic = 0x4653504FUL;  // "OPSF"
+static const uint8_t kScheduleVersion = 2;
+static const uint8_t kContactLen = 20;
+
+struct __attribute__((packed)) ScheduleHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t count;       // compartment records that follow
+  uint8_t recordSize;  // sizeof(CompartmentRecord)
+  uint8_t reserved;
+  uint16_t crc;       // CRC-16 over everything after this field
+  uint32_t sequence;  // bumped on every save; newest valid copy wins
+  char contact[kContactLen];
+};
+
+struct __attribute__((packed)) CompartmentRecord {
+  char name[ScheduleTable<1>::kNameLen];
+  uint32_t nextDue;
+  uint16_t interval;
+  uint8_t iterations;
+  uint8_t baseHour;
+  uint8_t baseMinute;
+  uint8_t nextHour;
+  uint8_t nextMinute;
+  uint8_t lastDispensedHour;
+  uint8_t lastDispensedMinute;
+  uint8_t dosesTaken;
+  uint8_t active;
+  uint8_t reserved;
+};
+
+template <uint8_t N>
+struct __attribute__((packed)) ScheduleImage {
+  ScheduleHeader header;
+  CompartmentRecord records[N];
+};
+
+inline uint16_t scheduleCrc(const ScheduleHeader &h, size_t imageSize) {
+  const uint8_t *after = reinterpret_cast<const uint8_t *>(&h.crc) + 2;
+  size_t skip = after - reinterpret_cast<const uint8_t *>(&h);
+  return crc16(after, imageSize - skip);
+}
+
+// Copies compartment i of `table` into a record, and back. Shared by the
+// SD image and the Bluetooth provisioning frame.
+template <uint8_t N>
+void encodeRecord(const ScheduleTable<N> &table, uint8_t i,
+                  CompartmentRecord &r) {
+  const Compartment &c = table[i];
+  memset(&r, 0, sizeof(r));
+  strncpy(r.name, table.name(i), sizeof(r.name) - 1);
+  r.nextDue = c.nextDue;
+  r.interval = c.interval;
+  r.iterations = c.iterations;
+  r.baseHour = c.baseHour;
+  r.baseMinute = c.baseMinute;
+  r.nextHour = c.nextHour;
+  r.nextMinute = c.nextMinute;
+  r.lastDispensedHour = c.lastDispensedHour;
+  r.lastDispensedMinute = c.lastDispensedMinute;
+  r.dosesTaken = c.dosesTaken;
+  r.active = c.active ? 1 : 0;
+}
+
+template <uint8_t N>
+void decodeRecord(const CompartmentRecord &r, ScheduleTable<N> &table,
+                  uint8_t i) {
+  Compartment &c = table[i];
+  char name[sizeof(r.name) + 1];
+  memcpy(name, r.name, sizeof(r.name));
+  name[sizeof(r.name)] = '\0';
+  table.setName(i, name);
+  c.nextDue = r.nextDue;
+  c.interval = r.interval;
+  c.iterations = r.iterations;
+  c.baseHour = r.baseHour;
+  c.baseMinute = r.baseMinute;
+  c.nextHour = r.nextHour;
+  c.nextMinute = r.nextMinute;
+  c.lastDispensedHour = r.lastDispensedHour;
+  c.lastDispensedMinute = r.lastDispensedMinute;
+  c.dosesTaken = r.dosesTaken;
+  c.active = r.active != 0;
+}
+
+template <uint8_t N>
+void encodeSchedule(const ScheduleTable<N> &table, const char *contact,
+                    uint32_t sequence, ScheduleImage<N> &img) {
+  memset(&img, 0, sizeof(img));
+  img.header.magic = kScheduleMagic;
+  img.header.version = kScheduleVersion;
+  img.header.count = N;
+  img.header.recordSize = sizeof(CompartmentRecord);
+  img.header.sequence = sequence;
+  strncpy(img.header.contact, contact, kContactLen - 1);
+  for (uint8_t i = 0; i < N; i++) encodeRecord(table, i, img.records[i]);
+  img.header.crc = scheduleCrc(img.header, sizeof(img));
+}
+
+template <uint8_t N>
+bool validSchedule(const ScheduleImage<N> &img) {
+  const ScheduleHeader &h = img.header;
+  return h.magic == kScheduleMagic && h.version == kScheduleVersion &&
+         h.count == N && h.recordSize == sizeof(CompartmentRecord) &&
+         h.crc == scheduleCrc(h, sizeof(img));
+}
+
+// Validates `img` and copies it into `table`. `contact` must hold
+// kContactLen chars.
+template <uint8_t N>
+bool decodeSchedule(const ScheduleImage<N> &img, ScheduleTable<N> &table,
+                    char *contact) {
+  const ScheduleHeader &h = img.header;
+  if (!validSchedule(img)) return false;
+  table.clear();
+  memcpy(contact, h.contact, kContactLen);
+  contact[kContactLen - 1] = '\0';
+  for (uint8_t i = 0; i < N; i++) decodeRecord(img.records[i], table, i);
+  return true;
+}
+
+// The CSV line the schedule was kept in before the binary image, in
+// USERINFO.txt. Still read once to migrate an old card, and still written to
+// USER_LOG.txt when a user is cleared:
+//   V2,contact,{active,name,interval,iterations,baseHour,baseMinute,
+//               nextHour,nextMinute,lastHour,lastMinute,nextDue} per
+//   compartment
+template <uint8_t N>
+void printScheduleCsv(Printer &out, const ScheduleTable<N> &table,
+                      const char *contact) {
+  out.print("V2,");
+  out.print(contact);
+  for (uint8_t i = 0; i < N; i++) {
+    const Compartment &c = table[i];
+    out.print(",");
+    out.print(c.active ? 1 : 0);
+    out.print(",");
+    out.print(table.name(i));
+    out.print(",");
+    out.print(c.interval);
+    out.print(",");
+    out.print(c.iterations);
+    out.print(",");
+    out.print(c.baseHour);
+    out.print(",");
+    out.print(c.baseMinute);
+    out.print(",");
+    out.print(c.nextHour);
+    out.print(",");
+    out.print(c.nextMinute);
+    out.print(",");
+    out.print(c.lastDispensedHour);
+    out.print(",");
+    out.print(c.lastDispensedMinute);
+    out.print(",");
+    out.print(c.nextDue);
+  }
+  out.println();
+}
+
+// Splits `line` in place at commas. Returns the number of fields found.
+inline uint8_t splitCsvFields(char *line, char **fields, uint8_t maxFields) {
+  uint8_t n = 0;
+  char *p = line;
+  while (n < maxFields) {
+    fields[n++] = p;
+    char *comma = strchr(p, ',');
+    if (!comma) break;
+    *comma = '\0';
+    p = comma + 1;
+  }
+  return n;
+}
+
+// Fills compartment i from `f`: name,interval,iterations,baseHour,baseMinute,
+// nextHour,nextMinute,lastHour,lastMinute[,nextDue].
+template <uint8_t N>
+void decodeCsvCompartment(char **f, bool active, bool hasDue,
+                          ScheduleTable<N> &table, uint8_t i) {
+  Compartment &c = table[i];
+  c.active = active;
+  table.setName(i, f[0]);
+  c.interval = atoi(f[1]);
+  c.iterations = atoi(f[2]);
+  c.baseHour = atoi(f[3]);
+  c.baseMinute = atoi(f[4]);
+  c.nextHour = atoi(f[5]);
+  c.nextMinute = atoi(f[6]);
+  c.lastDispensedHour = atoi(f[7]);
+  c.lastDispensedMinute = atoi(f[8]);
+  c.nextDue = hasDue ? strtoul(f[9], NULL, 10) : 0;
+}
+
+// Parses one CSV line without its line ending, in place, in either the V2
+// layout above or the original two-medicine one. `contact` must hold
+// kContactLen chars. Returns false if fields are missing.
+template <uint8_t N>
+bool decodeScheduleCsv(char *line, ScheduleTable<N> &table, char *contact) {
+  const uint8_t kFieldsPerMed = 11;
+  const uint8_t kMaxFields = 2 + N * kFieldsPerMed;
+  char *f[kMaxFields];
+  uint8_t n = splitCsvFields(line, f, kMaxFields);
+
+  table.clear();
+  const char *from;
+  if (strcmp(f[0], "V2") == 0) {
+    if (n < kMaxFields) return false;
+    from = f[1];
+    for (uint8_t i = 0; i < N; i++) {
+      char **m = f + 2 + i * kFieldsPerMed;
+      decodeCsvCompartment(m + 1, strcmp(m[0], "1") == 0, true, table, i);
+    }
+  } else {
+    // Original layout: contact, med1 (active after nextMinute), med2 active
+    // flag, then med2 without its active flag.
+    if (n < 11) return false;
+    char *m1[9] = {f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[9], f[10]};
+    from = f[0];
+    decodeCsvCompartment(m1, strcmp(f[8], "1") == 0, false, table, 0);
+    if (N > 1 && n >= 21 && strcmp(f[11], "1") == 0) {
+      decodeCsvCompartment(f + 12, true, false, table, 1);
+    }
+  }
+  strncpy(contact, from, kContactLen - 1);
+  contact[kContactLen - 1] = '\0';
+  return true;
+}
+
+#endif  // PILLOTTER_SCHEDULE_FILE_H
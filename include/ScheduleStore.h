@@ -0,0 +1,107 @@
+#ifndef PILLOTTER_SCHEDULE_STORE_H
+#define PILLOTTER_SCHEDULE_STORE_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+#include "Profile.h"
+#include "ScheduleFile.h"
+
+// Crash-safe schedule persistence with two A/B slot files.
+//
+// Every save writes the slot that does NOT hold the newest valid image, with
+// a sequence number one higher, in place. Nothing is ever deleted, so a power
+// cut at any byte of a save leaves the previous image intact; on boot the
+// valid slot with the highest sequence wins and a torn one fails its CRC.
+//
+// The sequence doubles as the generation tag of the EEPROM hot state, so it
+// must never go back: erase() remembers the last one, and after a reboot the
+// caller passes in the highest the EEPROM has seen with setFloor().
+template <uint8_t N>
+class ScheduleStore {
+ public:
+  static const uint8_t kNoSlot = 0xFF;
+
+  explicit ScheduleStore(FileStore &fs)
+      : fs_(fs), slot_(kNoSlot), sequence_(0), floor_(0), scanned_(false) {}
+
+  // Loads the newest valid slot. Returns false if neither slot is usable.
+  bool load(ScheduleTable<N> &table, char *contact) {
+    ScheduleImage<N> img;
+    scan();
+    if (slot_ == kNoSlot || !readSlot(slot_, img)) return false;
+    return decodeSchedule(img, table, contact);
+  }
+
+  bool save(const ScheduleTable<N> &table, const char *contact) {
+    if (!scanned_) scan();
+    uint8_t target = slot_ == 0 ? 1 : 0;
+    ScheduleImage<N> img;
+    uint32_t next = (sequence_ > floor_ ? sequence_ : floor_) + 1;
+    encodeSchedule(table, contact, next, img);
+    int put;
+    {
+      PROFILE_SCOPE(PROF_SD_WRITE);
+      put = fs_.write(path(target), &img, sizeof(img));
+    }
+    if (put != (int)sizeof(img)) return false;
+    slot_ = target;
+    sequence_ = next;
+    return true;
+  }
+
+  bool exists() {
+    scan();
+    return slot_ != kNoSlot;
+  }
+
+  void erase() {
+    fs_.remove(path(0));
+    fs_.remove(path(1));
+    if (sequence_ > floor_) floor_ = sequence_;
+    slot_ = kNoSlot;
+    sequence_ = 0;
+    scanned_ = true;
+  }
+
+  // The next save is numbered above `floor` even with no slot on the card.
+  void setFloor(uint32_t floor) {
+    if (floor > floor_) floor_ = floor;
+  }
+
+  uint8_t activeSlot() const { return slot_; }
+  uint32_t sequence() const { return sequence_; }
+
+  static const char *path(uint8_t slot) {
+    return slot == 0 ? "SCHED_A.BIN" : "SCHED_B.BIN";
+  }
+
+ private:
+  bool readSlot(uint8_t slot, ScheduleImage<N> &img) {
+    return fs_.read(path(slot), &img, sizeof(img)) == (int)sizeof(img) &&
+           validSchedule(img);
+  }
+
+  // Finds the newest valid slot without decoding it.
+  void scan() {
+    ScheduleImage<N> img;
+    slot_ = kNoSlot;
+    sequence_ = 0;
+    for (uint8_t s = 0; s < 2; s++) {
+      if (readSlot(s, img) &&
+          (slot_ == kNoSlot || img.header.sequence > sequence_)) {
+        slot_ = s;
+        sequence_ = img.header.sequence;
+      }
+    }
+    scanned_ = true;
+  }
+
+  FileStore &fs_;
+  uint8_t slot_;
+  uint32_t sequence_;
+  uint32_t floor_;  // highest sequence an erased schedule had
+  bool scanned_;
+};
+
+#endif  // PILLOTTER_SCHEDULE_STORE_H
@@ -0,0 +1,80 @@
+#ifndef PILLOTTER_SCHEDULER_H
+#define PILLOTTER_SCHEDULER_H
+
+#include <stdint.h>
+
+// Cooperative, millis()-based task scheduler.
+//
+// Every task is a plain function that does a small slice of work and returns;
+// long-running jobs (servo moves, buzzer patterns, GSM sends) keep their own
+// state in `ctx` and re-arm themselves instead of calling delay(). Pending
+// deadlines live in a fixed-size binary min-heap, so runDue() only ever looks
+// at the earliest one. The clock is injected so the same code can be driven by
+// a fake clock on a host build.
+typedef uint32_t (*ClockFn)();
+typedef void (*TaskFn)(void *ctx);
+
+class Scheduler {
+ public:
+  typedef uint8_t TaskId;
+  static const uint8_t kMaxTasks = 16;
+  static const TaskId kNoTask = 0xFF;
+  static const uint32_t kNever = 0xFFFFFFFFUL;
+
+  explicit Scheduler(ClockFn clock);
+
+  // Registers a task. It is not armed until schedule() is called, unless
+  // `delayMs` is given. A non-zero `periodMs` re-arms it after every run.
+  TaskId add(TaskFn fn, void *ctx, uint32_t periodMs = 0,
+             uint32_t delayMs = kNever);
+
+  // (Re)arms a task to run `delayMs` from now. Re-arming an already pending
+  // task moves its deadline.
+  void schedule(TaskId id, uint32_t delayMs);
+  void cancel(TaskId id);
+  bool pending(TaskId id) const;
+
+  // Runs every task whose deadline has passed. Returns the number run.
+  uint8_t runDue();
+
+  // Milliseconds until the earliest deadline: 0 if something is already due,
+  // kNever if nothing is armed.
+  uint32_t idleBudget() const;
+
+  uint32_t now() const { return clock_(); }
+
+  // Latency accounting. `lateness` is how far past its deadline a task ran;
+  // `pass` is the wall time of one runDue() call, i.e. the worst case any
+  // other task (or the serial console) can be held off.
+  uint32_t worstLatenessMs() const { return worstLateness_; }
+  uint32_t worstPassMs() const { return worstPass_; }
+  uint32_t runs() const { return runs_; }
+  void resetStats();
+
+ private:
+  struct Task {
+    TaskFn fn;
+    void *ctx;
+    uint32_t deadline;
+    uint32_t period;
+    uint8_t heapPos;  // kNoTask when not armed
+  };
+
+  bool before(TaskId a, TaskId b) const;
+  void swap(uint8_t i, uint8_t j);
+  void siftUp(uint8_t i);
+  void siftDown(uint8_t i);
+  void push(TaskId id);
+  void remove(TaskId id);
+
+  ClockFn clock_;
+  Task tasks_[kMaxTasks];
+  TaskId heap_[kMaxTasks];
+  uint8_t taskCount_;
+  uint8_t heapSize_;
+  uint32_t worstLateness_;
+  uint32_t worstPass_;
+  uint32_t runs_;
+};
+
+#endif  // PILLOTTER_SCHEDULER_H
@@ -0,0 +1,68 @@
+#ifndef PILLOTTER_SERVO_MOTION_H
+#define PILLOTTER_SERVO_MOTION_H
+
+#include <stdint.h>
+
+#include "Hal.h"
+#include "Histogram.h"
+
+// One dispense: ramp from closed to open, hold, ramp back, then let the
+// servo settle before its pulse is switched off.
+struct MotionProfile {
+  uint8_t closedAngle;
+  uint8_t openAngle;
+  uint16_t rampMs;    // each way
+  uint16_t holdMs;    // fully open
+  uint16_t settleMs;  // closed, still driven, before detaching
+  uint8_t stepMs;     // interval between commanded angles while ramping
+};
+
+// Steps every compartment's servo along its trajectory from one scheduler
+// task, so any number can be in flight at once and nothing waits on a move.
+// Idle servos are detached: no holding current, no jitter from pulse noise.
+class ServoMotion {
+ public:
+  static const uint8_t kMaxServos = 4;
+  static const uint32_t kNever = 0xFFFFFFFFUL;
+
+  ServoMotion(Actuator *const *servos, uint8_t count,
+              const MotionProfile &profile);
+
+  // Drives every servo closed, detaching each once it has settled.
+  void begin(uint32_t now);
+  // Starts a dispense on servo `i`; ignored if it is already moving.
+  void start(uint8_t i, uint32_t now);
+  // Advances every servo in flight. Returns ms until the next call is due,
+  // or kNever when all are idle.
+  uint32_t step(uint32_t now);
+  // Hands out, one per call, each servo that has closed since the last call:
+  // the pill has dropped into the tray.
+  bool takeClosed(uint8_t &i);
+
+  bool busy() const;
+  bool moving(uint8_t i) const { return i < count_ && phase_[i] != IDLE; }
+
+  // Start-to-closed time of each dispense, in ms.
+  const Log2Histogram<14> &durations() const { return durations_; }
+  uint16_t detaches() const { return detaches_; }
+
+ private:
+  enum Phase { IDLE = 0, OPENING, HOLDING, CLOSING, SETTLING };
+
+  void moveTo(uint8_t i, uint8_t angle);
+  void enter(uint8_t i, Phase phase, uint32_t now);
+  uint8_t rampAngle(uint8_t from, uint8_t to, uint32_t elapsed) const;
+
+  Actuator *servos_[kMaxServos];
+  uint8_t count_;
+  MotionProfile profile_;
+  Phase phase_[kMaxServos];
+  uint32_t phaseStart_[kMaxServos];
+  uint32_t startedAt_[kMaxServos];
+  uint8_t angle_[kMaxServos];  // last commanded
+  uint8_t closed_;             // bit per servo, see takeClosed()
+  Log2Histogram<14> durations_;
+  uint16_t detaches_;
+};
+
+#endif  // PILLOTTER_SERVO_MOTION_H
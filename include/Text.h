@@ -0,0 +1,107 @@
+#ifndef PILLOTTER_TEXT_H
+#define PILLOTTER_TEXT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Heap-free text helpers: a non-owning string view, a fixed-capacity string
+// and in-place integer parsing. Nothing here allocates.
+class StrView {
+ public:
+  StrView() : p_(""), len_(0) {}
+  StrView(const char *s) : p_(s), len_(strlen(s)) {}
+  StrView(const char *s, size_t len) : p_(s), len_(len) {}
+
+  const char *data() const { return p_; }
+  size_t size() const { return len_; }
+  bool empty() const { return len_ == 0; }
+  char operator[](size_t i) const { return p_[i]; }
+
+  bool equals(StrView o) const {
+    return len_ == o.len_ && memcmp(p_, o.p_, len_) == 0;
+  }
+  bool operator==(const char *s) const { return equals(StrView(s)); }
+  bool operator!=(const char *s) const { return !equals(StrView(s)); }
+
+  bool startsWith(StrView o) const {
+    return len_ >= o.len_ && memcmp(p_, o.p_, o.len_) == 0;
+  }
+
+  StrView substr(size_t from, size_t n = (size_t)-1) const {
+    if (from > len_) from = len_;
+    if (n > len_ - from) n = len_ - from;
+    return StrView(p_ + from, n);
+  }
+
+  // Strips leading/trailing whitespace (space, tab, CR, LF).
+  StrView trim() const {
+    size_t b = 0, e = len_;
+    while (b < e && isSpace(p_[b])) b++;
+    while (e > b && isSpace(p_[e - 1])) e--;
+    return StrView(p_ + b, e - b);
+  }
+
+  // Parses an optionally signed decimal integer spanning the whole view.
+  bool toLong(long &out) const {
+    size_t i = 0;
+    bool neg = false;
+    if (i < len_ && (p_[i] == '-' || p_[i] == '+')) neg = p_[i++] == '-';
+    if (i == len_) return false;
+    long v = 0;
+    for (; i < len_; i++) {
+      if (p_[i] < '0' || p_[i] > '9') return false;
+      v = v * 10 + (p_[i] - '0');
+    }
+    out = neg ? -v : v;
+    return true;
+  }
+
+  // Like Arduino's String::toInt(): 0 when the text is not a number.
+  long toInt() const {
+    long v = 0;
+    return toLong(v) ? v : 0;
+  }
+
+ private:
+  static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  const char *p_;
+  size_t len_;
+};
+
+// Fixed-capacity, always NUL-terminated string. Excess input is truncated.
+template <uint8_t N>
+class FixedStr {
+ public:
+  FixedStr() : len_(0) { buf_[0] = '\0'; }
+  FixedStr(const char *s) { assign(StrView(s)); }
+
+  FixedStr &operator=(const char *s) {
+    assign(StrView(s));
+    return *this;
+  }
+  FixedStr &operator=(StrView v) {
+    assign(v);
+    return *this;
+  }
+
+  void assign(StrView v) {
+    len_ = v.size() < N - 1 ? v.size() : N - 1;
+    memcpy(buf_, v.data(), len_);
+    buf_[len_] = '\0';
+  }
+
+  const char *c_str() const { return buf_; }
+  uint8_t length() const { return len_; }
+  StrView view() const { return StrView(buf_, len_); }
+  operator const char *() const { return buf_; }
+
+ private:
+  char buf_[N];
+  uint8_t len_;
+};
+
+#endif  // PILLOTTER_TEXT_H
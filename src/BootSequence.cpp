@@ -0,0 +1,60 @@
+#include "BootSequence.h"
+
+BootSequence::BootSequence(const BootPhase *phases, uint8_t count,
+                           ClockFn micros)
+    : phases_(phases),
+      count_(count < kMaxPhases ? count : kMaxPhases),
+      micros_(micros),
+      current_(0),
+      started_(false),
+      startUs_(0),
+      lastTryUs_(0),
+      totalUs_(0) {
+  for (uint8_t i = 0; i < kMaxPhases; i++) {
+    spentUs_[i] = 0;
+    attempts_[i] = 0;
+  }
+}
+
+bool BootSequence::step() {
+  if (done()) return true;
+  uint32_t now = micros_();
+  if (!started_) {
+    started_ = true;
+    startUs_ = now;
+  }
+  const BootPhase &phase = phases_[current_];
+  if (attempts_[current_] > 0 &&
+      now - lastTryUs_ < (uint32_t)phase.retryMs * 1000UL) {
+    return false;
+  }
+
+  lastTryUs_ = now;
+  if (attempts_[current_] < 0xFF) attempts_[current_]++;
+  bool ok = phase.run();
+  uint32_t end = micros_();
+  spentUs_[current_] += end - now;
+  if (!ok) return false;
+
+  current_++;
+  totalUs_ = end - startUs_;
+  return done();
+}
+
+void BootSequence::print(Printer &out) const {
+  out.print("boot ");
+  out.print(totalUs_ / 1000);
+  out.print(" ms:");
+  for (uint8_t i = 0; i < current_; i++) {
+    out.print(' ');
+    out.print(phases_[i].name);
+    out.print('=');
+    out.print(spentUs_[i] / 1000);
+    if (attempts_[i] > 1) {
+      out.print(" (");
+      out.print((unsigned int)attempts_[i]);
+      out.print(" tries)");
+    }
+  }
+  out.println();
+}
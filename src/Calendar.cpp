@@ -0,0 +1,74 @@
+#include "Calendar.h"
+
+// 2000-2099: every fourth year is a leap year, 2000 included, so the calendar
+// repeats every 1461 days starting with a leap year.
+#define DAYS_PER_CYCLE 1461U
+
+static constexpr uint8_t monthLength(uint8_t month, bool leap) {
+  return month == 2 ? (leap ? 29 : 28)
+                    : (month == 4 || month == 6 || month == 9 || month == 11)
+                          ? 30
+                          : 31;
+}
+
+static constexpr uint16_t daysBefore(uint8_t month, bool leap) {
+  return month <= 1 ? 0 : daysBefore(month - 1, leap) +
+                              monthLength(month - 1, leap);
+}
+
+// Day of the year (0-based) on which each month starts; [12] is the year
+// length.
+static constexpr uint16_t kMonthStart[2][13] = {
+    {daysBefore(1, false), daysBefore(2, false), daysBefore(3, false),
+     daysBefore(4, false), daysBefore(5, false), daysBefore(6, false),
+     daysBefore(7, false), daysBefore(8, false), daysBefore(9, false),
+     daysBefore(10, false), daysBefore(11, false), daysBefore(12, false),
+     daysBefore(13, false)},
+    {daysBefore(1, true), daysBefore(2, true), daysBefore(3, true),
+     daysBefore(4, true), daysBefore(5, true), daysBefore(6, true),
+     daysBefore(7, true), daysBefore(8, true), daysBefore(9, true),
+     daysBefore(10, true), daysBefore(11, true), daysBefore(12, true),
+     daysBefore(13, true)}};
+
+// Day of the cycle on which each of its four years starts.
+static constexpr uint16_t kYearStart[5] = {0, 366, 731, 1096, DAYS_PER_CYCLE};
+
+static_assert(kMonthStart[0][12] == 365 && kMonthStart[1][12] == 366,
+              "month table must cover the year");
+static_assert(kYearStart[1] == kMonthStart[1][12] &&
+                  kYearStart[4] - kYearStart[3] == kMonthStart[0][12],
+              "cycle table must match the month table");
+
+DateTime toDateTime(uint32_t t) {
+  DateTime dt;
+  uint16_t days = t / SECONDS_PER_DAY;
+  uint32_t secs = t - days * SECONDS_PER_DAY;
+  uint16_t mins = secs / 60;
+  dt.second = secs - mins * 60UL;
+  dt.hour = mins / 60;
+  dt.minute = mins - dt.hour * 60;
+
+  uint8_t cycle = days / DAYS_PER_CYCLE;
+  uint16_t d = days - cycle * DAYS_PER_CYCLE;
+  uint8_t y = 0;
+  while (d >= kYearStart[y + 1]) y++;
+  d -= kYearStart[y];
+  dt.year = 2000 + cycle * 4 + y;
+
+  // Months are 28-31 days, so day/32 is the month or the one before it.
+  const uint16_t *start = kMonthStart[y == 0];
+  uint8_t m = d >> 5;
+  if (d >= start[m + 1]) m++;
+  dt.month = m + 1;
+  dt.day = d - start[m] + 1;
+  return dt;
+}
+
+uint32_t toEpoch(const DateTime &dt) {
+  uint8_t years = dt.year - 2000;
+  uint8_t y = years & 3;
+  uint16_t days = (years >> 2) * DAYS_PER_CYCLE + kYearStart[y] +
+                  kMonthStart[y == 0][dt.month - 1] + dt.day - 1;
+  return days * SECONDS_PER_DAY + dt.hour * 3600UL + dt.minute * 60UL +
+         dt.second;
+}
@@ -0,0 +1,98 @@
+#include "ClockService.h"
+
+#include "Profile.h"
+
+ClockService::ClockService(Clock &rtc, ClockFn millis)
+    : rtc_(rtc),
+      millis_(millis),
+      synced_(false),
+      baseEpoch_(0),
+      baseMs_(0),
+      last_(0),
+      cachedAt_(0xFFFFFFFFUL),
+      reads_(0),
+      served_(0),
+      jumps_(0),
+      lastDrift_(0),
+      worstDrift_(0),
+      anchored_(false),
+      anchorEpoch_(0),
+      anchorMs_(0),
+      driftTotal_(0),
+      driftSpanMs_(0) {}
+
+uint32_t ClockService::readRtc() {
+  PROFILE_SCOPE(PROF_RTC_READ);
+  reads_++;
+  return rtc_.now();
+}
+
+void ClockService::sync(uint32_t ms) {
+  uint32_t rtc = readRtc();
+  bool restart = !anchored_ || !synced_;  // first read, or after resync()
+  if (!restart) {
+    uint32_t expected = baseEpoch_ + (ms - baseMs_) / 1000;
+    int32_t drift = (int32_t)(rtc - expected);
+    uint32_t size = drift < 0 ? -drift : drift;
+    if (size > CLOCK_MAX_SLEW_S) {
+      jumps_++;
+      restart = true;
+    } else {
+      lastDrift_ = drift;
+      if (size > worstDrift_) worstDrift_ = size;
+    }
+  }
+  // Only whole seconds are visible, so a single reading is +-1 s. Long-term
+  // drift is measured from a fixed anchor instead of summing per-read
+  // corrections, which would round to zero.
+  if (restart || ms - anchorMs_ > 0x7FFFFFFFUL) anchor(rtc, ms);  // or wraps soon
+  driftSpanMs_ = ms - anchorMs_;
+  driftTotal_ = (int32_t)(rtc - anchorEpoch_ - driftSpanMs_ / 1000);
+  baseEpoch_ = rtc;
+  baseMs_ = ms;
+  synced_ = true;
+}
+
+uint32_t ClockService::now() {
+  uint32_t ms = millis_();
+  if (!synced_ || ms - baseMs_ >= CLOCK_RESYNC_MS) sync(ms);
+  uint32_t t = baseEpoch_ + (ms - baseMs_) / 1000;
+  if (t < last_ && last_ - t <= CLOCK_MAX_SLEW_S) t = last_;
+  last_ = t;
+  served_++;
+  return t;
+}
+
+// The interpolated time is where the millisecond clock stopped, so the RTC's
+// lead over it is the time asleep. Not a drift sample: the millisecond clock
+// did not run.
+uint32_t ClockService::measureSleep(uint32_t maxMs) {
+  uint32_t ms = millis_();
+  uint32_t rtc = readRtc();
+  uint32_t before = synced_ ? baseEpoch_ + (ms - baseMs_) / 1000 : rtc;
+  uint32_t slept = rtc > before ? (rtc - before) * 1000UL : 0;
+  if (slept > maxMs) slept = maxMs;
+  anchor(rtc, ms + slept);
+  baseEpoch_ = rtc;
+  baseMs_ = ms + slept;
+  synced_ = true;
+  return slept;
+}
+
+// Restarts the long-term drift measurement from this reading.
+void ClockService::anchor(uint32_t rtc, uint32_t ms) {
+  anchored_ = true;
+  anchorEpoch_ = rtc;
+  anchorMs_ = ms;
+  driftSpanMs_ = 0;
+  driftTotal_ = 0;
+}
+
+const DateTime &ClockService::dateTime() {
+  uint32_t t = now();
+  if (t != cachedAt_) {
+    cached_ = toDateTime(t);
+    cachedAt_ = t;
+  }
+  return cached_;
+}
@@ -0,0 +1,23 @@
+#include "Crc.h"
+
+uint16_t crc16(const void *data, size_t len, uint16_t crc) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  while (len--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+uint8_t crc8(const void *data, size_t len, uint8_t crc) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,1201 @@
+#include "Dispenser.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Calendar.h"
+#include "Crc.h"
+#include "Profile.h"
+
+#define LEGACY_FILE "USERINFO.txt"  // old CSV schedule, migrated on load
+#define USER_LOG_FILE "USER_LOG.txt"
+
+// The SD slots hold the provisioned schedule; the per-dose state that changes
+// after every dose (nextDue, dosesTaken, last dispensed time) goes to a
+// wear-leveled ring in EEPROM instead of a full SD rewrite.
+#define HOT_STATE_BASE 0
+#define HOT_STATE_BYTES 1536  // 96 records
+static_assert(kCompartments <= HotStateLog::kMaxCompartments,
+              "every compartment's newest hot-state record must be kept");
+
+// Marks a RunCheckpoint as written by this firmware rather than left over
+// from power-on RAM.
+#define CHECKPOINT_MAGIC 0x5043
+
+// Nothing in the DISPENSE state may block: servo moves, buzzer patterns, dose
+// escalation, the LCD clock and GSM sends are all tasks that do a slice of work
+// and re-arm themselves.
+#define CLOCK_REFRESH_MS 1000      // LCD/serial clock redraw
+#define DOSE_CHECK_MAX_MS 60000UL  // longest sleep between schedule checks
+#define SERVO_HOLD_MS 3000         // servo stays open this long
+#define SERVO_RAMP_MS 300          // closed <-> open, each way
+#define SERVO_SETTLE_MS 250        // driven closed this long, then detached
+#define SERVO_STEP_MS 20           // one commanded angle per servo frame
+
+// Dose events go to per-day binary segments (see EventLog.h) through a
+// sector-sized staging buffer. A power cut loses at most LOG_MAX_AGE_MS of
+// events (or one 512-byte sector); the log is also flushed before any
+// deliberate reset.
+#define LOG_MAX_AGE_MS 60000UL
+#define LATE_AFTER_S 1800UL  // pickups later than this are logged as late
+
+// Escalation while a pill waits in the tray, in ms after it dropped: see
+// kEscalation. At ESCALATE_MISSED_MS the dose is logged as missed and the
+// compartment moves on to its next dose.
+#define ESCALATE_SMS_MS 10000UL
+#define ESCALATE_REPEAT_SMS_MS 900000UL
+#define ESCALATE_MISSED_MS 3600000UL
+
+// Both UARTs are read a byte at a time into line buffers; whole lines are
+// dispatched through sorted command tables. At most SERIAL_POLL_BYTES are
+// taken per loop() so a burst of input cannot hold up the scheduler.
+#define SERIAL_POLL_BYTES 32
+#define LEGACY_TIMEOUT_MS 300000UL
+
+#define COMMAND_COUNT(table) (sizeof(table) / sizeof(table[0]))
+
+static Dispenser &self(void *ctx) { return *static_cast<Dispenser *>(ctx); }
+
+static const MotionProfile kDispenseMotion = {
+    0, 90, SERVO_RAMP_MS, SERVO_HOLD_MS, SERVO_SETTLE_MS, SERVO_STEP_MS};
+
+Dispenser::Dispenser(const DispenserIo &io)
+    : io_(io),
+      out_(io.console),
+      bt_(io.bluetooth),
+      state_(SETUP),
+      lcd_(io.lcd),
+      contact_("+639915176440"),
+      schedStore_(io.files),
+      hotState_(io.eeprom, HOT_STATE_BASE, HOT_STATE_BYTES),
+      eventLog_(io.files, io.millis, LOG_MAX_AGE_MS),
+      modem_(io.gsm, io.millis),
+      sched_(io.millis),
+      clockTask_(Scheduler::kNoTask),
+      checkTask_(Scheduler::kNoTask),
+      buzzerTask_(Scheduler::kNoTask),
+      gsmTask_(Scheduler::kNoTask),
+      eepromTask_(Scheduler::kNoTask),
+      logTask_(Scheduler::kNoTask),
+      pickupTask_(Scheduler::kNoTask),
+      motionTask_(Scheduler::kNoTask),
+      worstLoopMs_(0),
+      motion_(io.servos, kCompartments, kDispenseMotion),
+      pickupPending_(false),
+      strayPickups_(0),
+      legacyField_(LF_IDLE),
+      legacyIndex_(0),
+      legacyLastLineMs_(0),
+      extraCommands_(NULL),
+      extraCommandCount_(0),
+      extraCommandCtx_(NULL),
+      doseObserver_(NULL),
+      doseObserverCtx_(NULL),
+      checkpoint_(NULL) {
+  buzzer_.togglesLeft = 0;
+  buzzer_.beepMs = 0;
+  buzzer_.holdAfter = false;
+  buzzer_.on = false;
+}
+
+bool Dispenser::begin() {
+  clockTask_ = sched_.add(clockStep, this);
+  checkTask_ = sched_.add(checkStep, this);
+  buzzerTask_ = sched_.add(buzzerStep, this);
+  gsmTask_ = sched_.add(gsmStep, this);
+  eepromTask_ = sched_.add(eepromStep, this);
+  logTask_ = sched_.add(logStep, this);
+  pickupTask_ = sched_.add(pickupStep, this);
+  motionTask_ = sched_.add(motionStep, this);
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    doses_[i].owner = this;
+    doses_[i].index = i;
+    doses_[i].phase = DOSE_IDLE;
+    doses_[i].dueAt = 0;
+    doses_[i].startedAt = 0;
+    doses_[i].waitStart = 0;
+    doses_[i].stage = 0;
+    doses_[i].task = sched_.add(doseStep, &doses_[i]);
+  }
+
+  // Load the saved schedule (binary, or an old CSV to migrate) if present.
+  hotState_.begin();
+  // EEPROM records outlive a clear; a new schedule must not pick up the
+  // generation, and with it the doses, of the one before.
+  schedStore_.setFloor(hotState_.highestGeneration());
+  lcd_.reset();
+  motion_.begin(io_.millis());
+  sched_.schedule(motionTask_, 0);
+  if (loadUser()) {
+    lcd_.clear();
+    lcd_.printRow(0, "User Data Loaded");
+    lcd_.flush();
+    enterDispense();
+    resumeDoses();
+    return true;
+  }
+  out_.println("No saved data found. Proceeding to setup...");
+  lcd_.printRow(0, "   PillOtter");
+  lcd_.printRow(1, "Connect 2 setup");
+  lcd_.flush();
+  state_ = SETUP;
+  saveCheckpoint();
+  return false;
+}
+
+void Dispenser::loop() {
+  PROFILE_SCOPE(PROF_LOOP);
+  uint32_t loopStart = io_.millis();
+  switch (state_) {
+    case SETUP:
+      // Provisioning frames, or the text commands older apps send.
+      pollBluetooth();
+      break;
+
+    case DISPENSE:
+      pollPickup();
+      sched_.runDue();
+      pollConsole();
+      break;
+  }
+  uint32_t loopMs = io_.millis() - loopStart;
+  if (loopMs > worstLoopMs_) worstLoopMs_ = loopMs;
+}
+
+bool Dispenser::canPowerDown() const {
+  return !anyDoseActive() && !motion_.busy() && !modem_.busy();
+}
+
+void Dispenser::setExtraCommands(const Command *table, uint8_t count,
+                                 void *ctx) {
+  extraCommands_ = table;
+  extraCommandCount_ = count;
+  extraCommandCtx_ = ctx;
+}
+
+void Dispenser::setDoseObserver(DoseEventFn fn, void *ctx) {
+  doseObserver_ = fn;
+  doseObserverCtx_ = ctx;
+}
+
+// ! SCHEDULER TASKS
+void Dispenser::clockStep(void *ctx) { self(ctx).updateClock(); }
+void Dispenser::checkStep(void *ctx) { self(ctx).checkAndDispense(); }
+void Dispenser::buzzerStep(void *ctx) { self(ctx).stepBuzzer(); }
+void Dispenser::gsmStep(void *ctx) { self(ctx).stepGsm(); }
+
+void Dispenser::eepromStep(void *ctx) {
+  Dispenser &d = self(ctx);
+  if (d.hotState_.pump()) d.sched_.schedule(d.eepromTask_, 4);  // ~3.3 ms/B
+}
+
+void Dispenser::logStep(void *ctx) {
+  Dispenser &d = self(ctx);
+  uint32_t next = d.eventLog_.poll();
+  if (next != Scheduler::kNever) d.sched_.schedule(d.logTask_, next);
+}
+
+void Dispenser::pickupStep(void *ctx) { self(ctx).checkPickup(); }
+
+void Dispenser::motionStep(void *ctx) { self(ctx).stepMotion(); }
+
+void Dispenser::doseStep(void *ctx) {
+  DoseRun &dose = *static_cast<DoseRun *>(ctx);
+  dose.owner->stepDose(dose);
+}
+
+// ! HELPER FUNCTION: Format epoch seconds as "YYYY-MM-DD HH:MM"
+// `buf` must hold 17 chars.
+static void formatDateTime(uint32_t t, char *buf) {
+  DateTime dt = toDateTime(t);
+  sprintf(buf, "%04d-%02d-%02d %02d:%02d", dt.year, dt.month, dt.day, dt.hour,
+          dt.minute);
+}
+
+// ! LOG DOSE EVENT: records what happened to a dose, `at` seconds, against
+// the time it was due.
+void Dispenser::logDoseEvent(uint8_t index, DoseEvent type, uint32_t dueAt,
+                             uint32_t at) {
+  uint32_t latency = at > dueAt ? at - dueAt : 0;
+  if (!eventLog_.record(at, index, type, latency)) {
+    out_.println("Error writing dose log.");
+  }
+  if (!sched_.pending(logTask_)) sched_.schedule(logTask_, LOG_MAX_AGE_MS);
+  if (doseObserver_) doseObserver_(doseObserverCtx_, index, type, at, latency);
+  char when[17];
+  formatDateTime(at, when);
+  out_.print("Logged event ");
+  out_.print(type);
+  out_.print(" for Med");
+  out_.print(index + 1);
+  out_.print(" at ");
+  out_.print(when);
+  out_.print(", ");
+  out_.print(latency);
+  out_.println("s after schedule");
+}
+
+// ! Functions for buzzer control
+void Dispenser::stepBuzzer() {
+  if (buzzer_.togglesLeft > 0) {
+    buzzer_.on = !buzzer_.on;
+    io_.buzzer.set(buzzer_.on);
+    buzzer_.togglesLeft--;
+    sched_.schedule(buzzerTask_, buzzer_.beepMs);
+    return;
+  }
+  buzzer_.on = buzzer_.holdAfter;
+  io_.buzzer.set(buzzer_.on);
+}
+
+void Dispenser::beepBuzzer(uint8_t times, uint16_t duration, bool holdAfter) {
+  buzzer_.togglesLeft = times * 2;
+  buzzer_.beepMs = duration;
+  buzzer_.holdAfter = holdAfter;
+  buzzer_.on = false;
+  sched_.schedule(buzzerTask_, 0);
+}
+
+void Dispenser::continuousBuzzer() {
+  sched_.cancel(buzzerTask_);
+  buzzer_.togglesLeft = 0;
+  buzzer_.holdAfter = true;
+  buzzer_.on = true;
+  io_.buzzer.set(true);
+}
+
+void Dispenser::stopBuzzer() {
+  sched_.cancel(buzzerTask_);
+  buzzer_.togglesLeft = 0;
+  buzzer_.holdAfter = false;
+  buzzer_.on = false;
+  io_.buzzer.set(false);
+}
+
+// ! Dispense Pill Function using servo motor
+// Starts the open-hold-close move; stepMotion() moves the dose on to
+// waiting once the compartment has closed and the pill is in the tray.
+void Dispenser::dispensePill(DoseRun &dose) {
+  motion_.start(dose.index, io_.millis());
+  dose.phase = DOSE_DISPENSING;
+  sched_.schedule(motionTask_, 0);
+}
+
+void Dispenser::stepMotion() {
+  uint32_t wait = motion_.step(io_.millis());
+  uint8_t closed;
+  while (motion_.takeClosed(closed)) {
+    if (doses_[closed].phase == DOSE_DISPENSING) stepDose(doses_[closed]);
+  }
+  if (wait == ServoMotion::kNever) {
+    sched_.cancel(motionTask_);
+  } else {
+    sched_.schedule(motionTask_, wait);
+  }
+}
+
+// ! PERSISTENCE
+// saveSched(): writes the whole schedule as one binary image (header with
+// magic/version/sequence/CRC plus a fixed record per compartment) into the
+// older of the two A/B slots, so the last good copy is never touched.
+bool Dispenser::saveSched() {
+  if (schedStore_.save(meds_, contact_)) {
+    out_.print("Schedule saved to slot ");
+    out_.println(schedStore_.activeSlot() == 0 ? "A." : "B.");
+    return true;
+  }
+  out_.println("Failed to write schedule slot.");
+  return false;
+}
+
+// Generation tag for EEPROM records: they only apply to the SD image they
+// were written against.
+uint16_t Dispenser::schedGeneration() const {
+  return (uint16_t)schedStore_.sequence();
+}
+
+// Persists compartment `index`'s per-dose state to EEPROM. Falls back to a
+// full SD save if the EEPROM queue is backed up.
+void Dispenser::persistDose(uint8_t index) {
+  const Compartment &med = meds_[index];
+  HotRecord rec = {med.nextDue, med.dosesTaken, med.lastDispensedHour,
+                   med.lastDispensedMinute, doses_[index].phase != DOSE_IDLE};
+  if (!hotState_.save(index, schedGeneration(), rec)) {
+    saveSched();
+    return;
+  }
+  sched_.schedule(eepromTask_, 0);
+}
+
+// Applies the newest EEPROM state on top of a freshly loaded SD schedule.
+void Dispenser::restoreHotState() {
+  HotRecord rec;
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    if (!hotState_.latest(i, schedGeneration(), rec)) continue;
+    Compartment &med = meds_[i];
+    med.nextDue = rec.nextDue;
+    med.dosesTaken = rec.dosesTaken;
+    med.lastDispensedHour = rec.lastDispensedHour;
+    med.lastDispensedMinute = rec.lastDispensedMinute;
+  }
+}
+
+bool Dispenser::hasCheckpoint() const {
+  return checkpoint_ && checkpoint_->magic == CHECKPOINT_MAGIC &&
+         checkpoint_->crc == crc16(checkpoint_, offsetof(RunCheckpoint, crc));
+}
+
+// Called on every dose phase or escalation change; cheap enough (a few
+// dozen bytes of RAM and a CRC) to keep it exact.
+void Dispenser::saveCheckpoint() {
+  if (!checkpoint_) return;
+  RunCheckpoint &cp = *checkpoint_;
+  uint32_t now = io_.rtc.now();
+  uint32_t ms = io_.millis();
+  cp.magic = CHECKPOINT_MAGIC;
+  cp.generation = state_ == DISPENSE ? schedGeneration() : 0;
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    const DoseRun &d = doses_[i];
+    RunCheckpoint::Dose &c = cp.doses[i];
+    c.phase = d.phase;
+    c.stage = d.stage;
+    c.dueAt = d.dueAt;
+    c.startedAt = d.startedAt;
+    c.waitStartAt =
+        d.phase == DOSE_WAITING ? now - (ms - d.waitStart) / 1000 : 0;
+  }
+  cp.crc = crc16(&cp, offsetof(RunCheckpoint, crc));
+}
+
+// After a reset, takes back every dose that was already out rather than
+// dispensing it again. A checkpoint that survived in RAM gives the exact
+// escalation state; after a power cut only the EEPROM flag is left, so the
+// reminder starts over. A dose cut off mid-move counts as dropped: the servo
+// closes from begin(), and opening it again could drop a second pill.
+void Dispenser::resumeDoses() {
+  bool warm = hasCheckpoint() && checkpoint_->generation == schedGeneration();
+  uint32_t now = io_.rtc.now();
+  uint32_t ms = io_.millis();
+  HotRecord rec;
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    const RunCheckpoint::Dose *saved = warm ? &checkpoint_->doses[i] : NULL;
+    if (warm) {
+      if (saved->phase == DOSE_IDLE || saved->dueAt != meds_[i].nextDue) {
+        continue;
+      }
+    } else if (!hotState_.latest(i, schedGeneration(), rec) || !rec.inFlight) {
+      continue;
+    }
+    bool waiting = saved && saved->phase == DOSE_WAITING;
+    uint32_t waitStartAt = waiting ? saved->waitStartAt : now;
+    DoseRun &dose = doses_[i];
+    timeline_.remove(i);
+    dose.phase = DOSE_WAITING;
+    dose.dueAt = meds_[i].nextDue;
+    dose.startedAt = saved ? saved->startedAt : dose.dueAt;
+    dose.stage = waiting ? saved->stage : 0;
+    dose.waitStart =
+        ms - (now > waitStartAt ? (now - waitStartAt) * 1000UL : 0);
+    restoreAlarm(dose);
+    sched_.schedule(dose.task, 0);
+    out_.print("Resumed dose of Med");
+    out_.println(i + 1);
+  }
+  saveCheckpoint();
+}
+
+// Loads the old CSV schedule: one line in either the V2 layout or the
+// original two-medicine layout.
+bool Dispenser::loadLegacyCsv() {
+  char line[24 + kCompartments * 72];
+  int got = io_.files.read(LEGACY_FILE, line, sizeof(line) - 1);
+  if (got < 0) {
+    out_.println("Failed to open " LEGACY_FILE " for reading.");
+    return false;
+  }
+  out_.println("Loading user data...");
+  uint16_t len = 0;
+  for (int i = 0; i < got && line[i] != '\n'; i++) {
+    if (line[i] != '\r') line[len++] = line[i];
+  }
+  line[len] = '\0';
+  if (len == 0) {
+    out_.println(LEGACY_FILE " is empty.");
+    return false;
+  }
+  char contact[kContactLen];
+  if (!decodeScheduleCsv(line, meds_, contact)) {
+    out_.println("Corrupt or incomplete data in " LEGACY_FILE ".");
+    return false;
+  }
+  contact_ = contact;
+  return true;
+}
+
+// Reads the newest valid A/B slot, or migrates an old CSV file into the
+// slots. Returns false if there is no usable schedule.
+bool Dispenser::loadUser() {
+  out_.println("Loading user data...");
+  char contact[kContactLen];
+  if (schedStore_.load(meds_, contact)) {
+    contact_ = contact;
+    restoreHotState();
+    out_.print("User data loaded from slot ");
+    out_.println(schedStore_.activeSlot() == 0 ? "A." : "B.");
+    return true;
+  }
+  if (io_.files.exists(LEGACY_FILE) && loadLegacyCsv()) {
+    saveSched();
+    io_.files.remove(LEGACY_FILE);
+    out_.println("Migrated " LEGACY_FILE " to schedule slots.");
+    return true;
+  }
+  return false;
+}
+
+// Saves the current schedule to USER_LOG.txt, deletes it and restarts.
+void Dispenser::clearUser() {
+  out_.println("Saving current data to " USER_LOG_FILE "...");
+  TextBuffer<24 + kCompartments * 72> csv;
+  Printer csvOut(csv);
+  printScheduleCsv(csvOut, meds_, contact_.c_str());
+  if (io_.files.append(USER_LOG_FILE, csv.c_str(), csv.length()) ==
+      (int)csv.length()) {
+    out_.println("User data saved to log.");
+  } else {
+    out_.println("ERROR: Failed to open " USER_LOG_FILE ".");
+  }
+  schedStore_.erase();
+  io_.files.remove(LEGACY_FILE);
+  out_.println("Schedule deleted.");
+  eventLog_.flush();
+  out_.println("Restarting Arduino...");
+  io_.restart();
+}
+
+// ! SCHEDULE
+// First hour:minute at or after `t`; the current minute still counts.
+static uint32_t nextOccurrence(uint32_t t, uint8_t hour, uint8_t minute) {
+  uint32_t due = atTimeOfDay(t, hour, minute);
+  if (due + 59 < t) due += SECONDS_PER_DAY;
+  return due;
+}
+
+void Dispenser::setNextDue(uint8_t index, uint32_t due) {
+  Compartment &med = meds_[index];
+  DateTime at = toDateTime(due);
+  med.nextDue = due;
+  med.nextHour = at.hour;
+  med.nextMinute = at.minute;
+  if (med.active) {
+    timeline_.set(index, due);
+  } else {
+    timeline_.remove(index);
+  }
+}
+
+// Puts every active compartment on the timeline. Schedules that only carry
+// nextHour/nextMinute (fresh from the app or an old file) get the next
+// occurrence of that time.
+void Dispenser::rebuildTimeline() {
+  uint32_t now = io_.rtc.now();
+  timeline_.clear();
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    Compartment &med = meds_[i];
+    if (med.nextDue == 0) {
+      med.nextDue = nextOccurrence(now, med.nextHour, med.nextMinute);
+    }
+    setNextDue(i, med.nextDue);
+  }
+}
+
+// Works out the next dose after the one due at `dueAt` went out at
+// `startedAt`. Doses come in daily courses: `iterations` doses `interval`
+// minutes apart from the base time, which may run past midnight but never
+// into the next course. An interval of a day or more is a multi-day
+// schedule instead: one dose every `interval`, at the same time of day.
+void Dispenser::updateSchedule(uint8_t index, uint32_t dueAt,
+                               uint32_t startedAt) {
+  out_.println("Updating schedule...");
+  Compartment &med = meds_[index];
+  uint32_t interval = med.interval * 60UL;
+  uint32_t due;
+
+  if (med.interval >= MINUTES_PER_DAY) {
+    // Skip whole cycles missed while the unit was off.
+    due = dueAt + interval;
+    while (due <= startedAt) due += interval;
+    med.dosesTaken = 0;
+  } else {
+    // The course started at the last base time at or before this dose.
+    uint32_t nextCourse =
+        lastOccurrence(dueAt, med.baseHour, med.baseMinute) + SECONDS_PER_DAY;
+    med.dosesTaken++;
+    due = startedAt + interval;
+    if (med.dosesTaken >= med.iterations || interval == 0 ||
+        due >= nextCourse) {
+      med.dosesTaken = 0;
+      due = nextCourse;
+      while (due <= startedAt) due += SECONDS_PER_DAY;
+    }
+  }
+
+  // Update last dispensed time
+  DateTime started = toDateTime(startedAt);
+  med.lastDispensedHour = started.hour;
+  med.lastDispensedMinute = started.minute;
+  setNextDue(index, due);
+
+  // Debugging Output
+  out_.print("Next dose for ");
+  out_.print(meds_.name(index));
+  out_.print(" at ");
+  out_.print(med.nextHour);
+  out_.print(":");
+  out_.println(med.nextMinute);
+
+  persistDose(index);  // Save per-dose state to EEPROM
+}
+
+bool Dispenser::anyDoseWaiting() const {
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    if (doses_[i].phase == DOSE_WAITING) return true;
+  }
+  return false;
+}
+
+bool Dispenser::anyDoseActive() const {
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    if (doses_[i].phase != DOSE_IDLE) return true;
+  }
+  return false;
+}
+
+// ! ESCALATION
+// What happens while a pill waits in the tray, in order. Each compartment
+// walks the table on its own task, so back-to-back doses escalate
+// independently.
+enum EscalationAction { ESC_BEEPS, ESC_LED, ESC_SMS, ESC_MISSED };
+
+struct EscalationStep {
+  uint32_t afterMs;  // since the pill dropped
+  EscalationAction action;
+  const char *text;  // ESC_SMS
+};
+
+static const EscalationStep kEscalation[] = {
+    {0, ESC_BEEPS, NULL},  // two beeps, then the continuous alarm
+    {0, ESC_LED, NULL},
+    {ESCALATE_SMS_MS, ESC_SMS, "Ayaw uminom ni patient maamsir"},
+    {ESCALATE_REPEAT_SMS_MS, ESC_SMS, "Ayaw uminom ni patient maamsir"},
+    {ESCALATE_MISSED_MS, ESC_MISSED, NULL},
+};
+
+static const uint8_t kEscalationSteps =
+    sizeof(kEscalation) / sizeof(kEscalation[0]);
+
+// Runs every step that is due, then sleeps until the next one.
+void Dispenser::escalate(DoseRun &dose) {
+  uint32_t waited = io_.millis() - dose.waitStart;
+  while (dose.stage < kEscalationSteps &&
+         kEscalation[dose.stage].afterMs <= waited) {
+    const EscalationStep &step = kEscalation[dose.stage++];
+    switch (step.action) {
+      case ESC_BEEPS:
+        beepBuzzer(2, 200, true);
+        break;
+      case ESC_LED:
+        io_.led.set(true);
+        break;
+      case ESC_SMS:
+        sendAlert(step.text);
+        break;
+      case ESC_MISSED:
+        missDose(dose);
+        return;
+    }
+  }
+  if (dose.stage < kEscalationSteps) {
+    sched_.schedule(dose.task, kEscalation[dose.stage].afterMs - waited);
+  }
+  saveCheckpoint();
+}
+
+// Puts back what the steps before `dose.stage` left switched on after a
+// reset. Messages already sent are not sent again.
+void Dispenser::restoreAlarm(const DoseRun &dose) {
+  for (uint8_t s = 0; s < dose.stage; s++) {
+    if (kEscalation[s].action == ESC_BEEPS) continuousBuzzer();
+    if (kEscalation[s].action == ESC_LED) io_.led.set(true);
+  }
+}
+
+// Pill has been taken (pickup sensor triggered): wrap up the dose.
+void Dispenser::finishDose(DoseRun &dose) {
+  dose.phase = DOSE_IDLE;
+  sched_.cancel(dose.task);
+  if (!anyDoseWaiting()) {
+    stopBuzzer();
+    io_.led.set(false);
+  }
+  sendAlert("Nakainom na si patient mo beh!");
+
+  // Log scheduled and actual intake times
+  uint32_t takenAt = io_.rtc.now();
+  logDoseEvent(dose.index,
+               takenAt > dose.dueAt + LATE_AFTER_S ? EVENT_LATE : EVENT_TAKEN,
+               dose.dueAt, takenAt);
+  updateSchedule(dose.index, dose.dueAt, dose.startedAt);
+  saveCheckpoint();
+}
+
+// Nobody picked the pill up in time: log it and release the compartment for
+// its next dose. The pill stays in the tray.
+void Dispenser::missDose(DoseRun &dose) {
+  dose.phase = DOSE_IDLE;
+  sched_.cancel(dose.task);
+  if (!anyDoseWaiting()) {
+    stopBuzzer();
+    io_.led.set(false);
+  }
+  out_.print("Missed dose of Med");
+  out_.println(dose.index + 1);
+  logDoseEvent(dose.index, EVENT_MISSED, dose.dueAt, io_.rtc.now());
+  updateSchedule(dose.index, dose.dueAt, dose.startedAt);
+  saveCheckpoint();
+}
+
+// Dose state machine, run by each DoseRun's task:
+// DISPENSING (servo moving, see stepMotion()) -> WAITING (escalating, see
+// kEscalation) -> IDLE.
+// The pickup itself arrives through checkPickup().
+void Dispenser::stepDose(DoseRun &dose) {
+  switch (dose.phase) {
+    case DOSE_DISPENSING:
+      dose.phase = DOSE_WAITING;
+      dose.waitStart = io_.millis();
+      dose.stage = 0;
+      if (pickupPending_) {
+        pickupPending_ = false;
+        finishDose(dose);
+        break;
+      }
+      escalate(dose);
+      break;
+
+    case DOSE_WAITING:
+      escalate(dose);
+      break;
+
+    case DOSE_IDLE:
+      break;
+  }
+}
+
+// ! PILL PICKUP
+// The sensor captures edges as they happen; loop() drains them into the
+// detector on every pass, and pickupTask_ wakes for the detector's hold and
+// debounce deadlines in between.
+void Dispenser::pollPickup() {
+  SensorEdge e;
+  bool any = false;
+  while (io_.pickup.nextEdge(e)) {
+    pickup_.edge(e.at, e.active);
+    any = true;
+  }
+  if (any) checkPickup();
+}
+
+// One tray serves every compartment, so a pickup goes to the dose that has
+// waited longest.
+Dispenser::DoseRun *Dispenser::oldestWaitingDose() {
+  DoseRun *oldest = NULL;
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    DoseRun &d = doses_[i];
+    if (d.phase != DOSE_WAITING) continue;
+    if (!oldest || (int32_t)(d.waitStart - oldest->waitStart) < 0) oldest = &d;
+  }
+  return oldest;
+}
+
+void Dispenser::checkPickup() {
+  uint32_t now = io_.millis();
+  pickup_.advance(now);
+  uint32_t at;
+  if (pickup_.take(at)) {
+    pickupLatency_.record(now - at);
+    DoseRun *dose = oldestWaitingDose();
+    if (dose) {
+      finishDose(*dose);
+    } else if (anyDoseActive()) {
+      pickupPending_ = true;
+    } else {
+      strayPickups_++;
+    }
+  }
+  uint32_t wait = pickup_.msUntilChange(now);
+  if (wait == PickupDetector::kNever) {
+    sched_.cancel(pickupTask_);
+  } else {
+    sched_.schedule(pickupTask_, wait);
+  }
+}
+
+void Dispenser::startDose(DoseRun &dose, uint32_t now) {
+  sched_.schedule(clockTask_, 0);  // switch the clock to per-second ticks
+  out_.print("Dispensing Med");
+  out_.print(dose.index + 1);
+  out_.println("...");
+  dose.dueAt = meds_[dose.index].nextDue;
+  dose.startedAt = now;
+  logDoseEvent(dose.index, EVENT_DISPENSED, dose.dueAt, now);
+  beepBuzzer(2, 200, anyDoseWaiting());  // back to the alarm if one waits
+  dispensePill(dose);
+  // Marks the dose as out, so a reset from here on cannot dispense it twice.
+  persistDose(dose.index);
+  saveCheckpoint();
+}
+
+// ! Check and Dispense: run by checkTask_ in DISPENSE state. Pops every dose
+// that is due (or overdue after a stall) off the timeline, then sleeps until
+// the next one is due.
+void Dispenser::checkAndDispense() {
+  uint32_t now = io_.rtc.now();
+
+  // A compartment is off the timeline while its dose is in flight and goes
+  // back on from updateSchedule(), so whatever pops here is idle.
+  uint8_t due;
+  while ((due = timeline_.popDue(now)) != DoseTimeline<kCompartments>::kNone) {
+    startDose(doses_[due], now);
+  }
+
+  uint32_t wait = timeline_.secondsUntilNext(now);
+  if (wait > DOSE_CHECK_MAX_MS / 1000) wait = DOSE_CHECK_MAX_MS / 1000;
+  sched_.schedule(checkTask_, wait * 1000UL);
+}
+
+// Redraws the clock. While a dose is in flight it ticks every second;
+// otherwise it shows HH:MM and only wakes on the next minute boundary so the
+// MCU can stay asleep.
+void Dispenser::updateClock() {
+  DateTime now = toDateTime(io_.rtc.now());
+  bool busy = anyDoseActive();
+  if (io_.console.listening()) {
+    out_.print("Current time: ");
+    out_.print(now.hour);
+    out_.print(":");
+    out_.println(now.minute);
+  }
+  // Fixed width and zero-padded, so a tick only changes the last digit or two
+  // on the panel.
+  char text[12];
+  if (busy) {
+    sprintf(text, "%02u:%02u:%02u", now.hour, now.minute, now.second);
+  } else {
+    sprintf(text, "%02u:%02u", now.hour, now.minute);
+  }
+  lcd_.printRow(0, "Current Time: ");
+  lcd_.printRow(1, text);
+  lcd_.flush();
+  sched_.schedule(clockTask_, busy ? CLOCK_REFRESH_MS
+                                   : (60UL - now.second) * 1000UL);
+}
+
+// Arms the periodic DISPENSE tasks. Called once we have a schedule.
+void Dispenser::enterDispense() {
+  state_ = DISPENSE;
+  rebuildTimeline();
+  sched_.schedule(clockTask_, 0);
+  sched_.schedule(checkTask_, 0);
+}
+
+// ! LEGACY PROVISIONING
+// Older apps answer "NewInstance" with one line per field: the contact, then
+// per compartment name, interval, iterations, base/next times, active flag
+// and last dispensed time. Compartment 1 sends its active flag after its
+// times; every later one sends it up front and stops there when it is "0".
+// Each line advances this state machine, so loop() never waits on the app.
+void Dispenser::finishLegacyProvisioning() {
+  legacyField_ = LF_IDLE;
+  saveSched();  // Save the schedule to SD
+  out_.println("Setup Successful");
+  enterDispense();
+  bt_.println(1);
+  lcd_.clear();
+  lcd_.printRow(0, "Setup Successful");
+  lcd_.flush();
+}
+
+// Moves to compartment `i`, or finishes once every compartment is in.
+void Dispenser::beginLegacyCompartment(uint8_t i) {
+  if (i == kCompartments) {
+    finishLegacyProvisioning();
+    return;
+  }
+  legacyIndex_ = i;
+  legacyField_ = i > 0 ? LF_ACTIVE_FIRST : LF_NAME;
+  out_.print("Waiting for Med");
+  out_.print(i + 1);
+  out_.println(i > 0 ? " Active State..." : " schedule...");
+}
+
+void Dispenser::startLegacyProvisioning() {
+  bt_.println("1");
+  out_.println("Waiting for Med Contact...");
+  meds_.clear();
+  legacyField_ = LF_CONTACT;
+  legacyLastLineMs_ = io_.millis();
+}
+
+void Dispenser::legacyProvisionLine(StrView v) {
+  legacyLastLineMs_ = io_.millis();
+  Compartment &med = meds_[legacyIndex_];
+  switch (legacyField_) {
+    case LF_CONTACT:
+      contact_ = v;
+      beginLegacyCompartment(0);
+      return;
+    case LF_ACTIVE_FIRST:
+      med.active = v == "1";
+      if (!med.active) {
+        beginLegacyCompartment(legacyIndex_ + 1);
+        return;
+      }
+      out_.print("Waiting for Med");
+      out_.print(legacyIndex_ + 1);
+      out_.println(" schedule...");
+      break;
+    case LF_NAME: {
+      FixedStr<ScheduleTable<kCompartments>::kNameLen> name;
+      name = v;
+      meds_.setName(legacyIndex_, name);
+      break;
+    }
+    case LF_INTERVAL:
+      med.interval = v.toInt();
+      break;
+    case LF_ITERATIONS:
+      med.iterations = v.toInt();
+      break;
+    case LF_BASE_HOUR:
+      med.baseHour = v.toInt();
+      break;
+    case LF_BASE_MINUTE:
+      med.baseMinute = v.toInt();
+      break;
+    case LF_NEXT_HOUR:
+      med.nextHour = v.toInt();
+      break;
+    case LF_NEXT_MINUTE:
+      med.nextMinute = v.toInt();
+      if (legacyIndex_ > 0) legacyField_ = LF_ACTIVE_LATE;  // skipped
+      break;
+    case LF_ACTIVE_LATE:
+      med.active = v == "1";
+      break;
+    case LF_LAST_HOUR:
+      med.lastDispensedHour = v.toInt();
+      break;
+    case LF_LAST_MINUTE:
+      med.lastDispensedMinute = v.toInt();
+      med.dosesTaken = 0;
+      beginLegacyCompartment(legacyIndex_ + 1);
+      return;
+    case LF_IDLE:
+      return;
+  }
+  legacyField_ = (LegacyField)(legacyField_ + 1);
+}
+
+// ! FRAMED PROVISIONING
+// Current app versions send the whole schedule as one CRC-checked frame (see
+// Provision.h) instead of the line-per-field NewInstance exchange, which is
+// kept for older apps.
+void Dispenser::replyFrame(FrameType type, NakReason code) {
+  uint8_t frame[kFrameOverhead + 1];
+  uint8_t reason = code;
+  io_.bluetooth.write(frame, encodeFrame(type, &reason, 1, frame));
+}
+
+void Dispenser::applyProvisionFrame() {
+  char contact[kContactLen];
+  if (provisionParser_.type() != FRAME_SCHEDULE ||
+      !decodeProvision(provisionParser_.payload(), provisionParser_.length(),
+                       meds_, contact)) {
+    out_.println("Provisioning frame rejected.");
+    replyFrame(FRAME_NAK, NAK_PAYLOAD);
+    return;
+  }
+  contact_ = contact;
+  if (!saveSched()) {
+    replyFrame(FRAME_NAK, NAK_STORAGE);
+    return;
+  }
+  replyFrame(FRAME_ACK, NAK_NONE);
+  out_.println("Setup Successful");
+  lcd_.clear();
+  lcd_.printRow(0, "Setup Successful");
+  lcd_.flush();
+  enterDispense();
+}
+
+// ! GSM alerts
+// sendAlert() only queues the message; stepGsm() polls the modem state
+// machine, which waits on the modem's own responses instead of fixed delays.
+void Dispenser::sendAlert(const char *msg) {
+  modem_.setRecipient(contact_);
+  if (!modem_.enqueue(msg)) {
+    out_.println("GSM queue full, dropping alert.");
+    return;
+  }
+  if (!sched_.pending(gsmTask_)) sched_.schedule(gsmTask_, 0);
+}
+
+void Dispenser::stepGsm() {
+  uint16_t sentBefore = modem_.sent();
+  uint16_t failedBefore = modem_.failed();
+  uint32_t next = modem_.poll();
+  if (modem_.sent() != sentBefore) out_.println("GSM message sent.");
+  if (modem_.failed() != failedBefore) out_.println("GSM message failed.");
+  if (next != Scheduler::kNever) sched_.schedule(gsmTask_, next);
+}
+
+// ! SERIAL INPUT (command tables: keep each sorted by strcmp on the name)
+const Command Dispenser::kBluetoothCommands[] = {
+    {"NewInstance",
+     [](void *d, StrView) { self(d).startLegacyProvisioning(); }},
+    {"check", [](void *d, StrView) { self(d).bt_.println("1"); }},
+};
+
+const Command Dispenser::kConsoleCommands[] = {
+    {"clear", [](void *d, StrView) { self(d).clearUser(); }},
+    {"gsm", [](void *d, StrView) { self(d).printGsmStats(); }},
+    {"ir", [](void *d, StrView) { self(d).printPickupStats(); }},
+    {"lcd", [](void *d, StrView) { self(d).printLcdStats(); }},
+    {"log", [](void *d, StrView) { self(d).printAdherence(); }},
+    {"med",
+     [](void *d, StrView args) { self(d).printCompartment(args.toInt() - 1); }},
+    {"sched", [](void *d, StrView) { self(d).printSchedStats(); }},
+    {"servo", [](void *d, StrView) { self(d).printServoStats(); }},
+    {"stats", [](void *d, StrView) { self(d).printProfile(); }},
+    {"store", [](void *d, StrView) { self(d).printStoreStats(); }},
+};
+
+void Dispenser::bluetoothLine(StrView line) {
+  if (legacyField_ != LF_IDLE) {
+    legacyProvisionLine(line);
+    return;
+  }
+  out_.print("RECEIVED: ");
+  out_.println(line);
+  dispatchCommand(kBluetoothCommands, COMMAND_COUNT(kBluetoothCommands), line,
+                  this);
+}
+
+// SETUP state: a start-of-frame byte outside a text line begins a
+// provisioning frame; everything else is assembled into lines.
+void Dispenser::pollBluetooth() {
+  uint32_t now = io_.millis();
+  if (provisionParser_.expire(now)) replyFrame(FRAME_NAK, NAK_TIMEOUT);
+  if (legacyField_ != LF_IDLE && now - legacyLastLineMs_ > LEGACY_TIMEOUT_MS) {
+    out_.println("Setup timed out.");
+    legacyField_ = LF_IDLE;
+  }
+  for (uint8_t n = 0; n < SERIAL_POLL_BYTES && io_.bluetooth.available();
+       n++) {
+    uint8_t b = io_.bluetooth.read();
+    if (!provisionParser_.idle() || (btLine_.empty() && b == kFrameSof)) {
+      switch (provisionParser_.feed(b, now)) {
+        case FrameParser::FRAME_READY:
+          applyProvisionFrame();
+          return;
+        case FrameParser::FRAME_ERROR:
+          replyFrame(FRAME_NAK, provisionParser_.error());
+          break;
+        case FrameParser::FRAME_NONE:
+          break;
+      }
+    } else if (btLine_.push(b)) {
+      bluetoothLine(btLine_.line());
+      if (state_ != SETUP) return;
+    }
+  }
+}
+
+// DISPENSE state: USB console commands for testing.
+void Dispenser::pollConsole() {
+  for (uint8_t n = 0; n < SERIAL_POLL_BYTES && io_.console.available(); n++) {
+    if (!consoleLine_.push(io_.console.read())) continue;
+    StrView line = consoleLine_.line();
+    if (line.empty() ||
+        dispatchCommand(kConsoleCommands, COMMAND_COUNT(kConsoleCommands),
+                        line, this) ||
+        (extraCommands_ &&
+         dispatchCommand(extraCommands_, extraCommandCount_, line,
+                         extraCommandCtx_))) {
+      continue;
+    }
+    out_.println("Unknown command.");
+  }
+}
+
+// ! CONSOLE REPORTS
+// Debug dump of one compartment for the "med<N>" console command.
+void Dispenser::printCompartment(int i) {
+  if (i < 0 || i >= kCompartments) {
+    out_.println("No such compartment.");
+    return;
+  }
+  const Compartment &med = meds_[i];
+  out_.print(meds_.name(i));
+  out_.print(",");
+  out_.print(med.interval);
+  out_.print(",");
+  out_.print(med.iterations);
+  out_.print(",");
+  out_.print(med.baseHour);
+  out_.print(",");
+  out_.print(med.baseMinute);
+  out_.print(",");
+  out_.print(med.nextHour);
+  out_.print(",");
+  out_.print(med.nextMinute);
+  out_.print(",");
+  out_.print(med.active);
+  out_.print(",");
+  out_.print(med.lastDispensedHour);
+  out_.print(",");
+  out_.print(med.lastDispensedMinute);
+  out_.print(",");
+  out_.print(med.dosesTaken);
+  out_.print(",");
+  out_.println(med.nextDue);
+}
+
+void Dispenser::printStoreStats() {
+  out_.print("store slot=");
+  out_.print(schedStore_.activeSlot() == 0 ? "A" : "B");
+  out_.print(" seq=");
+  out_.print(schedStore_.sequence());
+  out_.print(" eepromRecords=");
+  out_.print(hotState_.recordsWritten());
+  out_.print(" eepromBytes=");
+  out_.print(hotState_.bytesWritten());
+  out_.print(" ringSlots=");
+  out_.print(hotState_.slots());
+  out_.print(" logStaged=");
+  out_.print(eventLog_.staged());
+  out_.print(" logFlushes=");
+  out_.println(eventLog_.flushes());
+}
+
+// Adherence over the last seven days from the dose log segment headers.
+void Dispenser::printAdherence() {
+  uint16_t today = io_.rtc.now() / SECONDS_PER_DAY;
+  EventTotals t;
+  eventLog_.totals(today >= 6 ? today - 6 : 0, today, t);
+  out_.print("log days=");
+  out_.print(t.days);
+  out_.print(" dispensed=");
+  out_.print(t.byType[EVENT_DISPENSED]);
+  out_.print(" taken=");
+  out_.print(t.byType[EVENT_TAKEN]);
+  out_.print(" late=");
+  out_.print(t.byType[EVENT_LATE]);
+  out_.print(" missed=");
+  out_.print(t.byType[EVENT_MISSED]);
+  out_.print(" scanned=");
+  out_.println(t.scanned);
+}
+
+void Dispenser::printSchedStats() {
+  out_.print("sched runs=");
+  out_.print(sched_.runs());
+  out_.print(" worstLateMs=");
+  out_.print(sched_.worstLatenessMs());
+  out_.print(" worstPassMs=");
+  out_.print(sched_.worstPassMs());
+  out_.print(" worstLoopMs=");
+  out_.println(worstLoopMs_);
+  sched_.resetStats();
+  worstLoopMs_ = 0;
+}
+
+// Pickup counts, then the beam-break-to-dose-finished latency: the hold
+// time plus however long the loop took to get to it.
+void Dispenser::printPickupStats() {
+  out_.print("ir pickups=");
+  out_.print(pickupLatency_.total());
+  out_.print(" stray=");
+  out_.print(strayPickups_);
+  out_.print(" rejected=");
+  out_.print(pickup_.rejected());
+  out_.print(" bounces=");
+  out_.print(pickup_.bounces());
+  out_.print(" minMs=");
+  out_.print(pickupLatency_.min());
+  out_.print(" meanMs=");
+  out_.print(pickupLatency_.mean());
+  out_.print(" maxMs=");
+  out_.println(pickupLatency_.max());
+  for (uint8_t b = 0; b < pickupLatency_.buckets(); b++) {
+    if (!pickupLatency_.count(b)) continue;
+    out_.print("  >=");
+    out_.print(Log2Histogram<12>::floor(b));
+    out_.print("ms ");
+    out_.println(pickupLatency_.count(b));
+  }
+}
+
+// Hot-path timings (Profile.h).
+void Dispenser::printProfile() {
+#ifdef PILLOTTER_PROFILE
+  Profiler::print(out_);
+#else
+  out_.println("stats: build with -DPILLOTTER_PROFILE");
+#endif
+}
+
+// Start-to-closed time of each dispense.
+void Dispenser::printServoStats() {
+  const Log2Histogram<14> &d = motion_.durations();
+  out_.print("servo dispenses=");
+  out_.print(d.total());
+  out_.print(" minMs=");
+  out_.print(d.min());
+  out_.print(" meanMs=");
+  out_.print(d.mean());
+  out_.print(" maxMs=");
+  out_.print(d.max());
+  out_.print(" detaches=");
+  out_.println(motion_.detaches());
+}
+
+void Dispenser::printLcdStats() {
+  out_.print("lcd bytes=");
+  out_.print(lcd_.bytesSent());
+  out_.print(" i2c=");
+  out_.print(lcd_.i2cWrites());
+  out_.print(" flushes=");
+  out_.println(lcd_.flushes());
+}
+
+void Dispenser::printGsmStats() {
+  out_.print("gsm sent=");
+  out_.print(modem_.sent());
+  out_.print(" failed=");
+  out_.print(modem_.failed());
+  out_.print(" retries=");
+  out_.print(modem_.retries());
+  out_.print(" deduped=");
+  out_.print(modem_.deduped());
+  out_.print(" dropped=");
+  out_.print(modem_.dropped());
+  out_.print(" pending=");
+  out_.print(modem_.pending());
+  out_.print(" avgMs=");
+  uint16_t done = modem_.sent() + modem_.failed();
+  out_.println(done ? modem_.busyMs() / done : 0);
+}
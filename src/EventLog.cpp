@@ -0,0 +1,142 @@
+#include "EventLog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Crc.h"
+#include "Profile.h"
+
+static const uint16_t kHeaderCrcLen = offsetof(SegmentHeader, crc);
+
+bool validSegmentHeader(const SegmentHeader &h) {
+  return h.magic == kEventMagic && h.version == kEventVersion &&
+         h.recordSize == sizeof(EventRecord) &&
+         h.crc == crc16(&h, kHeaderCrcLen);
+}
+
+// Recounts a segment from its records, for headers that fell behind.
+static void scanSegment(FileStore &fs, const char *path, uint32_t size,
+                        SegmentHeader &h) {
+  EventRecord chunk[8];
+  h.count = 0;
+  for (uint8_t t = 0; t < EVENT_KINDS; t++) h.byType[t] = 0;
+  uint32_t offset = sizeof(SegmentHeader);
+  while (offset + sizeof(EventRecord) <= size) {
+    int got = fs.readAt(path, offset, chunk, sizeof(chunk));
+    if (got < (int)sizeof(EventRecord)) break;
+    uint8_t n = got / sizeof(EventRecord);
+    for (uint8_t i = 0; i < n; i++) {
+      if (chunk[i].type < EVENT_KINDS) h.byType[chunk[i].type]++;
+      h.count++;
+    }
+    offset += n * sizeof(EventRecord);
+  }
+}
+
+EventLog::EventLog(FileStore &fs, ClockFn clock, uint32_t maxAgeMs)
+    : fs_(fs),
+      writer_(fs, path_, clock, maxAgeMs),
+      day_(0),
+      open_(false),
+      seenFlushes_(0) {
+  path_[0] = '\0';
+  memset(&header_, 0, sizeof(header_));
+}
+
+void EventLog::segmentPath(uint16_t day, char *path) {
+  snprintf(path, kPathLen, "D%05u.BIN", (unsigned)day);
+}
+
+bool EventLog::open(uint16_t day) {
+  if (open_) flush();
+  segmentPath(day, path_);
+  day_ = day;
+  open_ = true;
+
+  uint32_t size = fs_.size(path_);
+  if (size < sizeof(SegmentHeader) ||
+      fs_.read(path_, &header_, sizeof(header_)) != (int)sizeof(header_) ||
+      !validSegmentHeader(header_)) {
+    // New (or unreadable) segment: start it with a fresh header.
+    memset(&header_, 0, sizeof(header_));
+    header_.magic = kEventMagic;
+    header_.version = kEventVersion;
+    header_.recordSize = sizeof(EventRecord);
+    header_.dayStart = (uint32_t)day * kSecondsPerDay;
+    if (size > sizeof(SegmentHeader)) {
+      scanSegment(fs_, path_, size, header_);
+    }
+    if (!writeHeader()) return false;
+  } else if (size != sizeof(SegmentHeader) +
+                        (uint32_t)header_.count * sizeof(EventRecord)) {
+    scanSegment(fs_, path_, size, header_);
+    writeHeader();
+  }
+  writer_.begin();
+  seenFlushes_ = writer_.flushes();
+  return true;
+}
+
+bool EventLog::writeHeader() {
+  header_.crc = crc16(&header_, kHeaderCrcLen);
+  PROFILE_SCOPE(PROF_SD_WRITE);
+  return fs_.write(path_, &header_, sizeof(header_)) ==
+         (int)sizeof(header_);
+}
+
+void EventLog::syncHeader() {
+  if (writer_.flushes() == seenFlushes_ || writer_.staged() != 0) return;
+  seenFlushes_ = writer_.flushes();
+  writeHeader();
+}
+
+bool EventLog::record(uint32_t when, uint8_t compartment, DoseEvent type,
+                      uint32_t latency) {
+  uint16_t day = when / kSecondsPerDay;
+  if ((!open_ || day != day_) && !open(day)) return false;
+
+  EventRecord rec;
+  rec.offset = when - header_.dayStart;
+  rec.compartment = compartment;
+  rec.type = type;
+  rec.latency = latency > 0xFFFF ? 0xFFFF : latency;
+  header_.count++;
+  header_.byType[type]++;
+  bool ok = writer_.write(&rec, sizeof(rec));
+  syncHeader();
+  return ok;
+}
+
+bool EventLog::flush() {
+  if (!open_) return true;
+  bool ok = writer_.flush();
+  syncHeader();
+  return ok;
+}
+
+uint32_t EventLog::poll() {
+  uint32_t next = writer_.poll();
+  syncHeader();
+  return next;
+}
+
+void EventLog::totals(uint16_t firstDay, uint16_t lastDay, EventTotals &out) {
+  memset(&out, 0, sizeof(out));
+  if (open_) flush();  // make the open segment's header current
+  char path[kPathLen];
+  SegmentHeader h;
+  for (uint32_t day = firstDay; day <= lastDay; day++) {
+    segmentPath(day, path);
+    uint32_t size = fs_.size(path);
+    if (size < sizeof(SegmentHeader)) continue;
+    bool valid = fs_.read(path, &h, sizeof(h)) == (int)sizeof(h) &&
+                 validSegmentHeader(h);
+    if (!valid || size != sizeof(SegmentHeader) +
+                              (uint32_t)h.count * sizeof(EventRecord)) {
+      scanSegment(fs_, path, size, h);
+      out.scanned++;
+    }
+    for (uint8_t t = 0; t < EVENT_KINDS; t++) out.byType[t] += h.byType[t];
+    out.days++;
+  }
+}
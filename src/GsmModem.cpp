@@ -0,0 +1,200 @@
+#include "GsmModem.h"
+
+#include <string.h>
+
+#include "Profile.h"
+
+GsmModem::GsmModem(ByteStream &port, ClockFn clock)
+    : port_(port),
+      clock_(clock),
+      head_(0),
+      count_(0),
+      stage_(IDLE),
+      stageDeadline_(0),
+      startedAt_(0),
+      textMode_(false),
+      gotRef_(false),
+      lineLen_(0),
+      sent_(0),
+      failed_(0),
+      dropped_(0),
+      deduped_(0),
+      retries_(0),
+      busyMs_(0) {
+  recipient_[0] = '\0';
+}
+
+void GsmModem::setRecipient(const char *number) {
+  strncpy(recipient_, number, kMaxNumber - 1);
+  recipient_[kMaxNumber - 1] = '\0';
+}
+
+bool GsmModem::enqueue(const char *text) {
+  for (uint8_t i = 0; i < count_; i++) {
+    const Message &m = queue_[(head_ + i) % kQueueLen];
+    if (strncmp(m.text, text, kMaxText - 1) == 0) {
+      deduped_++;
+      return true;
+    }
+  }
+  if (count_ == kQueueLen) {
+    dropped_++;
+    return false;
+  }
+  Message &m = queue_[(head_ + count_) % kQueueLen];
+  strncpy(m.text, text, kMaxText - 1);
+  m.text[kMaxText - 1] = '\0';
+  m.attempts = 0;
+  count_++;
+  return true;
+}
+
+uint32_t GsmModem::poll() {
+  PROFILE_SCOPE(PROF_GSM_POLL);
+  uint32_t now = clock_();
+  switch (stage_) {
+    case IDLE:
+      if (count_ == 0) return Scheduler::kNever;
+      begin();
+      break;
+
+    case WAIT_CMGF:
+      while (readLine()) {
+        if (lineIs("OK")) {
+          textMode_ = true;
+          sendCmgs();
+          break;
+        }
+        if (lineStarts("ERROR")) {
+          fail();
+          break;
+        }
+      }
+      break;
+
+    case WAIT_PROMPT:
+      // The body prompt is "> " with no line terminator, so look at raw bytes.
+      while (port_.available() > 0) {
+        int c = port_.read();
+        if (c == '>') {
+          port_.write(queue_[head_].text);
+          port_.write((uint8_t)26);  // Ctrl+Z ends the message
+          lineLen_ = 0;
+          gotRef_ = false;
+          enter(WAIT_RESULT, kSendTimeoutMs);
+          break;
+        }
+        if (c == '\n' && lineLen_ > 0) {
+          line_[lineLen_] = '\0';
+          lineLen_ = 0;
+          if (lineStarts("ERROR") || lineStarts("+CMS ERROR")) {
+            fail();
+            break;
+          }
+        } else if (c != '\r' && c != '\n' && lineLen_ < sizeof(line_) - 1) {
+          line_[lineLen_++] = (char)c;
+        }
+      }
+      break;
+
+    case WAIT_RESULT:
+      while (readLine()) {
+        if (lineStarts("+CMGS:")) {
+          gotRef_ = true;
+        } else if (lineIs("OK") && gotRef_) {
+          succeed();
+          break;
+        } else if (lineStarts("ERROR") || lineStarts("+CMS ERROR")) {
+          fail();
+          break;
+        }
+      }
+      break;
+
+    case BACKOFF:
+      if ((int32_t)(now - stageDeadline_) >= 0) begin();
+      break;
+  }
+
+  if (stage_ == IDLE) return count_ > 0 ? 0 : Scheduler::kNever;
+  if (stage_ != BACKOFF && (int32_t)(clock_() - stageDeadline_) >= 0) {
+    // The modem never answered; abort any half-entered body and retry.
+    if (stage_ == WAIT_PROMPT || stage_ == WAIT_RESULT) port_.write((uint8_t)27);
+    fail();
+  }
+  if (stage_ == BACKOFF) {
+    int32_t left = (int32_t)(stageDeadline_ - clock_());
+    return left > 0 ? (uint32_t)left : 0;
+  }
+  return kPollMs;
+}
+
+bool GsmModem::readLine() {
+  while (port_.available() > 0) {
+    int c = port_.read();
+    if (c < 0) break;
+    if (c == '\r') continue;
+    if (c == '\n') {
+      if (lineLen_ == 0) continue;  // blank lines between responses
+      line_[lineLen_] = '\0';
+      lineLen_ = 0;
+      return true;
+    }
+    if (lineLen_ < sizeof(line_) - 1) line_[lineLen_++] = (char)c;
+  }
+  return false;
+}
+
+bool GsmModem::lineIs(const char *s) const { return strcmp(line_, s) == 0; }
+
+bool GsmModem::lineStarts(const char *s) const {
+  return strncmp(line_, s, strlen(s)) == 0;
+}
+
+void GsmModem::begin() {
+  // Drop stale unsolicited output so it is not mistaken for our reply.
+  while (port_.available() > 0) port_.read();
+  lineLen_ = 0;
+  if (queue_[head_].attempts == 0) startedAt_ = clock_();
+  queue_[head_].attempts++;
+  if (textMode_) {
+    sendCmgs();
+  } else {
+    port_.write("AT+CMGF=1\r");
+    enter(WAIT_CMGF, kCommandTimeoutMs);
+  }
+}
+
+void GsmModem::sendCmgs() {
+  port_.write("AT+CMGS=\"");
+  port_.write(recipient_);
+  port_.write("\"\r");
+  enter(WAIT_PROMPT, kPromptTimeoutMs);
+}
+
+void GsmModem::succeed() {
+  sent_++;
+  busyMs_ += clock_() - startedAt_;
+  head_ = (head_ + 1) % kQueueLen;
+  count_--;
+  stage_ = IDLE;
+}
+
+void GsmModem::fail() {
+  textMode_ = false;
+  if (queue_[head_].attempts < kMaxAttempts) {
+    retries_++;
+    enter(BACKOFF, kRetryBackoffMs);
+    return;
+  }
+  failed_++;
+  busyMs_ += clock_() - startedAt_;
+  head_ = (head_ + 1) % kQueueLen;
+  count_--;
+  stage_ = IDLE;
+}
+
+void GsmModem::enter(Stage stage, uint32_t timeoutMs) {
+  stage_ = stage;
+  stageDeadline_ = clock_() + timeoutMs;
+}
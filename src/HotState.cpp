@@ -0,0 +1,189 @@
+#include "HotState.h"
+
+#include <string.h>
+
+#include "Crc.h"
+
+static const uint8_t kMagic = 0xA5;
+
+HotStateLog::HotStateLog(Eeprom &ee, uint16_t base, uint16_t bytes)
+    : ee_(ee),
+      base_(base),
+      slots_(bytes / kRecordSize),
+      head_(0),
+      nextSequence_(0),
+      highestGeneration_(0),
+      pendingHead_(0),
+      pendingCount_(0),
+      pendingByte_(0),
+      recordsWritten_(0),
+      bytesWritten_(0) {
+  for (uint8_t c = 0; c < kMaxCompartments; c++) {
+    liveSlot_[c] = kNoSlot;
+    liveGeneration_[c] = 0;
+  }
+}
+
+bool HotStateLog::readSlot(uint16_t slot, Raw &raw) {
+  uint8_t *p = reinterpret_cast<uint8_t *>(&raw);
+  for (uint8_t i = 0; i < sizeof(Raw); i++) p[i] = ee_.read(addr(slot) + i);
+  return raw.magic == kMagic && raw.crc == crc8(p + 1, sizeof(Raw) - 2);
+}
+
+// Sequences only ever move forward by one and at most `slots_` records are
+// live, so serial-number comparison is safe across uint16 wrap-around.
+static bool newer(uint16_t a, uint16_t b) { return (int16_t)(a - b) > 0; }
+
+void HotStateLog::begin() {
+  Raw raw;
+  bool found = false;
+  uint16_t newest = 0;
+  uint16_t liveSequence[kMaxCompartments];
+  head_ = 0;
+  highestGeneration_ = 0;
+  for (uint8_t c = 0; c < kMaxCompartments; c++) {
+    liveSlot_[c] = kNoSlot;
+    liveSequence[c] = 0;
+  }
+  for (uint16_t s = 0; s < slots_; s++) {
+    if (!readSlot(s, raw)) continue;
+    if (!found || newer(raw.generation, highestGeneration_)) {
+      highestGeneration_ = raw.generation;
+    }
+    if (!found || newer(raw.sequence, newest)) {
+      found = true;
+      newest = raw.sequence;
+      head_ = (s + 1) % slots_;
+    }
+    uint8_t c = raw.compartment;
+    if (c < kMaxCompartments &&
+        (liveSlot_[c] == kNoSlot || newer(raw.sequence, liveSequence[c]))) {
+      liveSlot_[c] = s;
+      liveSequence[c] = raw.sequence;
+      liveGeneration_[c] = raw.generation;
+    }
+  }
+  nextSequence_ = found ? newest + 1 : 0;
+
+  // A ring written before records were kept alive can have one right at the
+  // head; step over it; save() copies it forward when the head comes round.
+  for (uint8_t tries = 0; tries < kMaxCompartments; tries++) {
+    uint8_t c = 0;
+    while (c < kMaxCompartments && liveSlot_[c] != head_) c++;
+    if (c == kMaxCompartments) break;
+    head_ = next(head_);
+  }
+}
+
+bool HotStateLog::latest(uint8_t c, uint16_t generation, HotRecord &out) {
+  Raw raw;
+  bool found = false;
+  uint16_t newest = 0;
+  for (uint16_t s = 0; s < slots_; s++) {
+    if (!readSlot(s, raw) || raw.compartment != c ||
+        raw.generation != generation) {
+      continue;
+    }
+    if (!found || newer(raw.generation, highestGeneration_)) {
+      highestGeneration_ = raw.generation;
+    }
+    if (!found || newer(raw.sequence, newest)) {
+      found = true;
+      newest = raw.sequence;
+      out.nextDue = raw.nextDue;
+      out.dosesTaken = raw.dosesTaken;
+      out.lastDispensedHour = raw.lastDispensedHour;
+      out.lastDispensedMinute = raw.lastDispensedMinute;
+      out.inFlight = raw.inFlight;
+    }
+  }
+  return found;
+}
+
+uint8_t HotStateLog::liveOwner(uint16_t slot, uint16_t generation) const {
+  for (uint8_t c = 0; c < kMaxCompartments; c++) {
+    if (liveSlot_[c] == slot && liveGeneration_[c] == generation) return c;
+  }
+  return kMaxCompartments;
+}
+
+// Stamps `raw` with the next sequence and CRC and queues it for the head slot.
+void HotStateLog::enqueue(Raw &raw) {
+  uint8_t i = (pendingHead_ + pendingCount_) % kMaxPending;
+  raw.magic = kMagic;
+  raw.sequence = nextSequence_++;
+  raw.crc = crc8(reinterpret_cast<uint8_t *>(&raw) + 1, sizeof(Raw) - 2);
+  pending_[i] = raw;
+  pendingSlot_[i] = head_;
+  if (raw.compartment < kMaxCompartments) {
+    liveSlot_[raw.compartment] = head_;
+    liveGeneration_[raw.compartment] = raw.generation;
+  }
+  if (newer(raw.generation, highestGeneration_)) {
+    highestGeneration_ = raw.generation;
+  }
+  head_ = next(head_);
+  pendingCount_++;
+}
+
+// The head slot never holds a newest record. If the slot after it does (for
+// another compartment; `c`'s own is superseded anyway), that record is copied
+// into the head slot and the new one goes where it was. Pending records are
+// written in order, so the copy is complete before its original is touched.
+bool HotStateLog::save(uint8_t c, uint16_t generation, const HotRecord &rec) {
+  if (slots_ == 0) return false;
+  uint8_t moves = 0;
+  for (uint16_t s = next(head_); moves < kMaxCompartments; s = next(s)) {
+    uint8_t owner = liveOwner(s, generation);
+    if (owner == kMaxCompartments || owner == c) break;
+    moves++;
+  }
+  if (pendingCount_ + moves + 1 > kMaxPending) return false;
+
+  Raw raw;
+  for (;;) {
+    uint8_t owner = liveOwner(next(head_), generation);
+    if (owner == kMaxCompartments || owner == c) break;
+    if (!readSlot(liveSlot_[owner], raw)) {
+      liveSlot_[owner] = kNoSlot;  // nothing left to keep
+      continue;
+    }
+    enqueue(raw);
+  }
+
+  memset(&raw, 0, sizeof(raw));
+  raw.compartment = c;
+  raw.generation = generation;
+  raw.nextDue = rec.nextDue;
+  raw.dosesTaken = rec.dosesTaken;
+  raw.lastDispensedHour = rec.lastDispensedHour;
+  raw.lastDispensedMinute = rec.lastDispensedMinute;
+  raw.inFlight = rec.inFlight;
+  enqueue(raw);
+  return true;
+}
+
+// Write order per record: clear magic, body bytes, then magic. A record cut
+// short by a reset therefore never carries a valid magic with a stale body.
+bool HotStateLog::pump() {
+  while (pendingCount_ > 0 && ee_.ready()) {
+    const Raw &raw = pending_[pendingHead_];
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&raw);
+    uint16_t a = addr(pendingSlot_[pendingHead_]);
+    if (pendingByte_ == 0) {
+      ee_.write(a, 0);
+    } else if (pendingByte_ < sizeof(Raw)) {
+      ee_.write(a + pendingByte_, p[pendingByte_]);
+    } else {
+      ee_.write(a, p[0]);
+    }
+    bytesWritten_++;
+    if (++pendingByte_ > sizeof(Raw)) {
+      pendingByte_ = 0;
+      pendingHead_ = (pendingHead_ + 1) % kMaxPending;
+      pendingCount_--;
+      recordsWritten_++;
+    }
+  }
+  return pendingCount_ > 0;
+}
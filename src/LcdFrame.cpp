@@ -0,0 +1,62 @@
+#include "LcdFrame.h"
+
+#include <string.h>
+
+#include "Profile.h"
+
+LcdFrame::LcdFrame(Display &lcd) : lcd_(lcd), bytes_(0), flushes_(0) {
+  memset(frame_, ' ', sizeof(frame_));
+  memset(shown_, ' ', sizeof(shown_));
+}
+
+void LcdFrame::reset() {
+  lcd_.clear();
+  bytes_++;
+  memset(shown_, ' ', sizeof(shown_));
+}
+
+void LcdFrame::clear() { memset(frame_, ' ', sizeof(frame_)); }
+
+void LcdFrame::print(uint8_t col, uint8_t row, const char *text) {
+  if (row >= LCD_ROWS) return;
+  for (; *text && col < LCD_COLS; text++) frame_[row][col++] = *text;
+}
+
+void LcdFrame::printRow(uint8_t row, const char *text) {
+  if (row >= LCD_ROWS) return;
+  uint8_t col = 0;
+  for (; *text && col < LCD_COLS; text++) frame_[row][col++] = *text;
+  for (; col < LCD_COLS; col++) frame_[row][col] = ' ';
+}
+
+uint16_t LcdFrame::flush() {
+  PROFILE_SCOPE(PROF_LCD_FLUSH);
+  uint16_t sent = 0;
+  char run[LCD_COLS + 1];
+  for (uint8_t row = 0; row < LCD_ROWS; row++) {
+    uint8_t col = 0;
+    while (col < LCD_COLS) {
+      if (frame_[row][col] == shown_[row][col]) {
+        col++;
+        continue;
+      }
+      // Extend the run over short unchanged gaps: resending up to two equal
+      // characters is cheaper than another cursor move.
+      uint8_t start = col, end = col + 1;
+      for (uint8_t k = end; k < LCD_COLS && k <= end + 2; k++) {
+        if (frame_[row][k] != shown_[row][k]) end = k + 1;
+      }
+      uint8_t n = end - start;
+      memcpy(run, &frame_[row][start], n);
+      run[n] = '\0';
+      memcpy(&shown_[row][start], run, n);
+      lcd_.setCursor(start, row);
+      lcd_.print(run);
+      sent += 1 + n;
+      col = end;
+    }
+  }
+  bytes_ += sent;
+  if (sent) flushes_++;
+  return sent;
+}
@@ -0,0 +1,88 @@
+#include "LogWriter.h"
+
+#include <string.h>
+
+#include "Profile.h"
+
+LogWriter::LogWriter(FileStore &fs, const char *path, ClockFn clock,
+                     uint32_t maxAgeMs)
+    : fs_(fs),
+      path_(path),
+      clock_(clock),
+      maxAgeMs_(maxAgeMs),
+      fileSize_(0),
+      oldestAt_(0),
+      used_(0),
+      flushes_(0),
+      bytes_(0),
+      dropped_(0),
+      failures_(0) {}
+
+void LogWriter::begin() { fileSize_ = fs_.size(path_); }
+
+uint16_t LogWriter::room() const {
+  return kSectorSize - (uint16_t)((fileSize_ + used_) % kSectorSize);
+}
+
+bool LogWriter::write(const void *data, uint16_t len) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  bool ok = true;
+  if (used_ == 0 && len > 0) oldestAt_ = clock_();
+  while (len > 0) {
+    uint16_t n = room();
+    if (n > len) n = len;
+    if (used_ + n > kSectorSize) n = kSectorSize - used_;
+    memcpy(buf_ + used_, p, n);
+    used_ += n;
+    bytes_ += n;
+    p += n;
+    len -= n;
+    if ((fileSize_ + used_) % kSectorSize == 0 || used_ == kSectorSize) {
+      ok = flush() && ok;
+      if (used_ == kSectorSize) {
+        dropped_ += len;  // card keeps failing and the buffer is full
+        return false;
+      }
+      if (len > 0 && used_ == 0) oldestAt_ = clock_();
+    }
+  }
+  return ok;
+}
+
+bool LogWriter::print(const char *s) { return write(s, strlen(s)); }
+
+bool LogWriter::flush() {
+  if (used_ == 0) return true;
+  int put;
+  {
+    PROFILE_SCOPE(PROF_SD_WRITE);
+    put = fs_.append(path_, buf_, used_);
+  }
+  if (put != (int)used_) {
+    // Part of it may have made it to the card: the file size says how much.
+    // Drop that prefix and keep the rest staged for the next flush, so the
+    // retry neither repeats bytes nor shifts the records after them.
+    failures_++;
+    uint32_t size = fs_.size(path_);
+    uint32_t landed = size > fileSize_ ? size - fileSize_ : 0;
+    if (landed > used_) landed = used_;
+    memmove(buf_, buf_ + landed, used_ - landed);
+    used_ -= landed;
+    fileSize_ = size;
+    return false;
+  }
+  fileSize_ += used_;
+  used_ = 0;
+  flushes_++;
+  return true;
+}
+
+uint32_t LogWriter::poll() {
+  if (used_ == 0) return Scheduler::kNever;
+  uint32_t age = clock_() - oldestAt_;
+  if (age >= maxAgeMs_) {
+    flush();
+    return used_ == 0 ? Scheduler::kNever : maxAgeMs_;
+  }
+  return maxAgeMs_ - age;
+}
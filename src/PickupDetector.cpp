@@ -0,0 +1,66 @@
+#include "PickupDetector.h"
+
+PickupDetector::PickupDetector(uint16_t debounceMs, uint16_t holdMs)
+    : debounceMs_(debounceMs),
+      holdMs_(holdMs),
+      state_(WAITING),
+      releasing_(false),
+      ready_(false),
+      detectedAt_(0),
+      releasedAt_(0),
+      rejected_(0),
+      bounces_(0) {}
+
+void PickupDetector::advance(uint32_t now) {
+  if (state_ == WAITING) return;
+  if (releasing_) {
+    if (now - releasedAt_ < debounceMs_) return;
+    // Clear for longer than a bounce: the pulse is over. If it had not held
+    // long enough to confirm (edge() confirms first), it was noise.
+    releasing_ = false;
+    if (state_ == DETECTED) rejected_++;
+    state_ = WAITING;
+    return;
+  }
+  if (state_ == DETECTED && now - detectedAt_ >= holdMs_) {
+    state_ = CONFIRMED;
+    ready_ = true;
+  }
+}
+
+void PickupDetector::edge(uint32_t at, bool active) {
+  advance(at);
+  if (state_ == WAITING) {
+    if (active) {
+      state_ = DETECTED;
+      detectedAt_ = at;
+    }
+    return;
+  }
+  if (!active) {
+    releasing_ = true;
+    releasedAt_ = at;
+  } else if (releasing_) {
+    releasing_ = false;  // back within the debounce time
+    bounces_++;
+  }
+}
+
+bool PickupDetector::take(uint32_t &at) {
+  if (!ready_) return false;
+  ready_ = false;
+  at = detectedAt_;
+  return true;
+}
+
+uint32_t PickupDetector::msUntilChange(uint32_t now) const {
+  uint32_t deadline;
+  if (releasing_) {
+    deadline = releasedAt_ + debounceMs_;
+  } else if (state_ == DETECTED) {
+    deadline = detectedAt_ + holdMs_;
+  } else {
+    return kNever;
+  }
+  return (int32_t)(deadline - now) > 0 ? deadline - now : 0;
+}
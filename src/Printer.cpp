@@ -0,0 +1,20 @@
+#include "Printer.h"
+
+void Printer::print(long v) {
+  if (v < 0) {
+    print('-');
+    print((unsigned long)-v);
+    return;
+  }
+  print((unsigned long)v);
+}
+
+void Printer::print(unsigned long v) {
+  char buf[20];
+  uint8_t i = sizeof(buf);
+  do {
+    buf[--i] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  out_.write((const uint8_t *)buf + i, sizeof(buf) - i);
+}
@@ -0,0 +1,77 @@
+#include "Profile.h"
+
+#ifdef PILLOTTER_PROFILE
+
+// Host fleet runs give every worker thread its own counters.
+#ifdef __AVR__
+#define PROFILE_LOCAL
+#else
+#define PROFILE_LOCAL thread_local
+#endif
+
+static const char *const kPointNames[PROF_POINTS] = {
+    "loop", "sd_write", "rtc_read", "lcd_flush", "gsm_poll", "servo_step"};
+
+static PROFILE_LOCAL ClockFn clockFn = NULL;
+static PROFILE_LOCAL ProfileHistogram histograms[PROF_POINTS];
+
+void Profiler::setClock(ClockFn micros) { clockFn = micros; }
+
+uint32_t Profiler::now() { return clockFn ? clockFn() : 0; }
+
+void Profiler::record(ProfilePoint point, uint32_t us) {
+  histograms[point].record(us);
+}
+
+void Profiler::reset() {
+  for (uint8_t i = 0; i < PROF_POINTS; i++) histograms[i].reset();
+}
+
+const char *Profiler::name(ProfilePoint point) { return kPointNames[point]; }
+
+const ProfileHistogram &Profiler::histogram(ProfilePoint point) {
+  return histograms[point];
+}
+
+void Profiler::print(Printer &out) {
+  for (uint8_t i = 0; i < PROF_POINTS; i++) {
+    const ProfileHistogram &h = histograms[i];
+    if (!h.total()) continue;
+    out.print(kPointNames[i]);
+    out.print(" n=");
+    out.print(h.total());
+    out.print(" minUs=");
+    out.print(h.min());
+    out.print(" avgUs=");
+    out.print(h.mean());
+    out.print(" p99Us=");
+    out.print(h.percentile(99));
+    out.print(" maxUs=");
+    out.println(h.max());
+  }
+}
+
+// Every point is present, sampled or not, so dashboards see fixed keys.
+void Profiler::printJson(Printer &out) {
+  out.print('{');
+  for (uint8_t i = 0; i < PROF_POINTS; i++) {
+    const ProfileHistogram &h = histograms[i];
+    if (i) out.print(',');
+    out.print('"');
+    out.print(kPointNames[i]);
+    out.print("\":{\"count\":");
+    out.print(h.total());
+    out.print(",\"min_us\":");
+    out.print(h.min());
+    out.print(",\"avg_us\":");
+    out.print(h.mean());
+    out.print(",\"p99_us\":");
+    out.print(h.percentile(99));
+    out.print(",\"max_us\":");
+    out.print(h.max());
+    out.print('}');
+  }
+  out.println('}');
+}
+
+#endif  // PILLOTTER_PROFILE
@@ -0,0 +1,99 @@
+#include "Provision.h"
+
+#include "Crc.h"
+
+size_t encodeFrame(uint8_t type, const void *payload, uint16_t len,
+                   uint8_t *out) {
+  out[0] = kFrameSof;
+  out[1] = kFrameVersion;
+  out[2] = type;
+  out[3] = len & 0xFF;
+  out[4] = len >> 8;
+  memcpy(out + 5, payload, len);
+  uint16_t crc = crc16(out + 1, 4 + len);
+  out[5 + len] = crc & 0xFF;
+  out[6 + len] = crc >> 8;
+  return len + kFrameOverhead;
+}
+
+FrameParser::FrameParser(uint32_t byteTimeoutMs)
+    : timeoutMs_(byteTimeoutMs),
+      lastByteMs_(0),
+      stage_(HUNT),
+      version_(0),
+      type_(0),
+      len_(0),
+      pos_(0),
+      crc_(0),
+      rxCrc_(0),
+      error_(NAK_NONE),
+      frames_(0),
+      errors_(0) {}
+
+FrameParser::Result FrameParser::fail(NakReason why) {
+  error_ = why;
+  errors_++;
+  stage_ = HUNT;
+  return FRAME_ERROR;
+}
+
+bool FrameParser::expire(uint32_t nowMs) {
+  if (stage_ == HUNT || nowMs - lastByteMs_ < timeoutMs_) return false;
+  stage_ = HUNT;
+  errors_++;
+  return true;
+}
+
+FrameParser::Result FrameParser::feed(uint8_t b, uint32_t nowMs) {
+  // A long gap means the rest of the old frame is never coming.
+  if (stage_ != HUNT && nowMs - lastByteMs_ >= timeoutMs_) {
+    stage_ = HUNT;
+    errors_++;
+  }
+  lastByteMs_ = nowMs;
+  if (stage_ != HUNT && stage_ < CRC_LO) crc_ = crc16(&b, 1, crc_);
+
+  switch (stage_) {
+    case HUNT:
+      if (b == kFrameSof) {
+        crc_ = 0xFFFF;
+        stage_ = VERSION;
+      }
+      break;
+    case VERSION:
+      version_ = b;
+      stage_ = TYPE;
+      break;
+    case TYPE:
+      type_ = b;
+      stage_ = LEN_LO;
+      break;
+    case LEN_LO:
+      len_ = b;
+      stage_ = LEN_HI;
+      break;
+    case LEN_HI:
+      len_ |= (uint16_t)b << 8;
+      if (len_ > kFrameMaxPayload) return fail(NAK_LENGTH);
+      pos_ = 0;
+      stage_ = len_ ? PAYLOAD : CRC_LO;
+      break;
+    case PAYLOAD:
+      buf_[pos_++] = b;
+      if (pos_ == len_) stage_ = CRC_LO;
+      break;
+    case CRC_LO:
+      rxCrc_ = b;
+      stage_ = CRC_HI;
+      break;
+    case CRC_HI:
+      rxCrc_ |= (uint16_t)b << 8;
+      stage_ = HUNT;
+      if (rxCrc_ != crc_) return fail(NAK_CRC);
+      // Checked last so a good frame from a newer app gets a precise NAK.
+      if (version_ != kFrameVersion) return fail(NAK_VERSION);
+      frames_++;
+      return FRAME_READY;
+  }
+  return FRAME_NONE;
+}
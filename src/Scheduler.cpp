@@ -0,0 +1,132 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler(ClockFn clock)
+    : clock_(clock),
+      taskCount_(0),
+      heapSize_(0),
+      worstLateness_(0),
+      worstPass_(0),
+      runs_(0) {}
+
+Scheduler::TaskId Scheduler::add(TaskFn fn, void *ctx, uint32_t periodMs,
+                                 uint32_t delayMs) {
+  if (taskCount_ >= kMaxTasks) return kNoTask;
+  TaskId id = taskCount_++;
+  tasks_[id].fn = fn;
+  tasks_[id].ctx = ctx;
+  tasks_[id].deadline = 0;
+  tasks_[id].period = periodMs;
+  tasks_[id].heapPos = kNoTask;
+  if (delayMs != kNever) schedule(id, delayMs);
+  return id;
+}
+
+void Scheduler::schedule(TaskId id, uint32_t delayMs) {
+  if (id >= taskCount_) return;
+  if (tasks_[id].heapPos != kNoTask) remove(id);
+  tasks_[id].deadline = clock_() + delayMs;
+  push(id);
+}
+
+void Scheduler::cancel(TaskId id) {
+  if (id < taskCount_ && tasks_[id].heapPos != kNoTask) remove(id);
+}
+
+bool Scheduler::pending(TaskId id) const {
+  return id < taskCount_ && tasks_[id].heapPos != kNoTask;
+}
+
+uint8_t Scheduler::runDue() {
+  uint32_t start = clock_();
+  uint8_t ran = 0;
+  // Bounded by kMaxTasks so a task that re-arms itself with a zero delay
+  // cannot starve the rest of loop().
+  while (heapSize_ > 0 && ran < kMaxTasks) {
+    TaskId id = heap_[0];
+    uint32_t now = clock_();
+    int32_t late = (int32_t)(now - tasks_[id].deadline);
+    if (late < 0) break;
+    remove(id);
+    if ((uint32_t)late > worstLateness_) worstLateness_ = late;
+    if (tasks_[id].period != 0) {
+      tasks_[id].deadline += tasks_[id].period;
+      // Do not try to catch up on missed periods after a long stall.
+      if ((int32_t)(now - tasks_[id].deadline) >= 0) {
+        tasks_[id].deadline = now + tasks_[id].period;
+      }
+      push(id);
+    }
+    tasks_[id].fn(tasks_[id].ctx);
+    ran++;
+    runs_++;
+  }
+  uint32_t pass = clock_() - start;
+  if (pass > worstPass_) worstPass_ = pass;
+  return ran;
+}
+
+uint32_t Scheduler::idleBudget() const {
+  if (heapSize_ == 0) return kNever;
+  int32_t left = (int32_t)(tasks_[heap_[0]].deadline - clock_());
+  return left > 0 ? (uint32_t)left : 0;
+}
+
+void Scheduler::resetStats() {
+  worstLateness_ = 0;
+  worstPass_ = 0;
+  runs_ = 0;
+}
+
+// Deadlines are compared as signed differences so the heap keeps working
+// across the 49-day millis() rollover.
+bool Scheduler::before(TaskId a, TaskId b) const {
+  return (int32_t)(tasks_[a].deadline - tasks_[b].deadline) < 0;
+}
+
+void Scheduler::swap(uint8_t i, uint8_t j) {
+  TaskId t = heap_[i];
+  heap_[i] = heap_[j];
+  heap_[j] = t;
+  tasks_[heap_[i]].heapPos = i;
+  tasks_[heap_[j]].heapPos = j;
+}
+
+void Scheduler::siftUp(uint8_t i) {
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!before(heap_[i], heap_[parent])) break;
+    swap(i, parent);
+    i = parent;
+  }
+}
+
+void Scheduler::siftDown(uint8_t i) {
+  for (;;) {
+    uint8_t smallest = i;
+    uint8_t l = 2 * i + 1;
+    uint8_t r = l + 1;
+    if (l < heapSize_ && before(heap_[l], heap_[smallest])) smallest = l;
+    if (r < heapSize_ && before(heap_[r], heap_[smallest])) smallest = r;
+    if (smallest == i) break;
+    swap(i, smallest);
+    i = smallest;
+  }
+}
+
+void Scheduler::push(TaskId id) {
+  uint8_t i = heapSize_++;
+  heap_[i] = id;
+  tasks_[id].heapPos = i;
+  siftUp(i);
+}
+
+void Scheduler::remove(TaskId id) {
+  uint8_t i = tasks_[id].heapPos;
+  uint8_t last = --heapSize_;
+  tasks_[id].heapPos = kNoTask;
+  if (i == last) return;
+  heap_[i] = heap_[last];
+  tasks_[heap_[i]].heapPos = i;
+  siftDown(i);
+  siftUp(i);
+}
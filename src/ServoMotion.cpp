@@ -0,0 +1,121 @@
+#include "ServoMotion.h"
+
+#include "Profile.h"
+
+ServoMotion::ServoMotion(Actuator *const *servos, uint8_t count,
+                         const MotionProfile &profile)
+    : count_(count < kMaxServos ? count : kMaxServos),
+      profile_(profile),
+      closed_(0),
+      detaches_(0) {
+  for (uint8_t i = 0; i < count_; i++) {
+    servos_[i] = servos[i];
+    phase_[i] = IDLE;
+    phaseStart_[i] = 0;
+    startedAt_[i] = 0;
+    angle_[i] = profile.closedAngle;
+  }
+}
+
+void ServoMotion::begin(uint32_t now) {
+  for (uint8_t i = 0; i < count_; i++) {
+    servos_[i]->write(profile_.closedAngle);
+    angle_[i] = profile_.closedAngle;
+    enter(i, SETTLING, now);
+  }
+}
+
+void ServoMotion::start(uint8_t i, uint32_t now) {
+  if (i >= count_ || phase_[i] != IDLE) return;
+  startedAt_[i] = now;
+  enter(i, OPENING, now);
+}
+
+bool ServoMotion::busy() const {
+  for (uint8_t i = 0; i < count_; i++) {
+    if (phase_[i] != IDLE) return true;
+  }
+  return false;
+}
+
+bool ServoMotion::takeClosed(uint8_t &i) {
+  for (i = 0; i < count_; i++) {
+    if (closed_ & (1 << i)) {
+      closed_ &= ~(1 << i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ServoMotion::moveTo(uint8_t i, uint8_t angle) {
+  if (angle == angle_[i]) return;
+  servos_[i]->write(angle);  // re-attaches a detached servo
+  angle_[i] = angle;
+}
+
+void ServoMotion::enter(uint8_t i, Phase phase, uint32_t now) {
+  phase_[i] = phase;
+  phaseStart_[i] = now;
+}
+
+// Linear in time; integer math only.
+uint8_t ServoMotion::rampAngle(uint8_t from, uint8_t to,
+                               uint32_t elapsed) const {
+  if (elapsed >= profile_.rampMs) return to;
+  int16_t span = (int16_t)to - from;
+  return from + (int16_t)((int32_t)span * (int32_t)elapsed /
+                         (int32_t)profile_.rampMs);
+}
+
+uint32_t ServoMotion::step(uint32_t now) {
+  PROFILE_SCOPE(PROF_SERVO_STEP);
+  uint32_t next = kNever;
+  for (uint8_t i = 0; i < count_; i++) {
+    uint32_t elapsed = now - phaseStart_[i];
+    uint32_t wait = kNever;
+    switch (phase_[i]) {
+      case IDLE:
+        break;
+      case OPENING:
+        moveTo(i, rampAngle(profile_.closedAngle, profile_.openAngle, elapsed));
+        if (elapsed < profile_.rampMs) {
+          wait = profile_.stepMs;
+          break;
+        }
+        enter(i, HOLDING, now);
+        wait = profile_.holdMs;
+        break;
+      case HOLDING:
+        if (elapsed < profile_.holdMs) {
+          wait = profile_.holdMs - elapsed;
+          break;
+        }
+        enter(i, CLOSING, now);
+        wait = profile_.stepMs;
+        break;
+      case CLOSING:
+        moveTo(i, rampAngle(profile_.openAngle, profile_.closedAngle, elapsed));
+        if (elapsed < profile_.rampMs) {
+          wait = profile_.stepMs;
+          break;
+        }
+        closed_ |= 1 << i;
+        durations_.record(now - startedAt_[i]);
+        enter(i, SETTLING, now);
+        wait = profile_.settleMs;
+        break;
+      case SETTLING:
+        if (elapsed < profile_.settleMs) {
+          wait = profile_.settleMs - elapsed;
+          break;
+        }
+        servos_[i]->detach();
+        detaches_++;
+        enter(i, IDLE, now);
+        break;
+    }
+    if (wait < next) next = wait;
+  }
+  return next;
+}
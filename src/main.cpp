@@ -6,721 +6,551 @@
 #include <SoftwareSerial.h>
 #include <ThreeWire.h>
 #include <Wire.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
 #include <avr/wdt.h>
+#include <string.h>
+#include <util/atomic.h>
+
+#include "BootSequence.h"
+#include "ClockService.h"
+#include "Dispenser.h"
+#include "Hal.h"
+#include "PickupDetector.h"
+#include "PowerStats.h"
+#include "Profile.h"
+
+// Board wiring for the ATmega2560 build: the Dispenser (src/Dispenser.cpp)
+// holds the application; this file adapts the Arduino peripherals to the
+// interfaces in Hal.h and owns sleep and reset.
 
 // ! OBJECTS DEFINITIONS
 LiquidCrystal_I2C lcd(0x27, 16, 2);
 ThreeWire myWire(7, 6, 8);  // DAT, CLK, RST for RTC DS1302
 RtcDS1302<ThreeWire> Rtc(myWire);
 
-// Two servo motors for dispensing pills
-Servo servo1;  // for med1
-Servo servo2;  // for med2
-
 // Define additional hardware pins
 #define CSpin 53       // SD card chip select
 #define IR_PIN 4       // IR sensor input pin (reads LOW when pill is taken)
+// Pin 4 is PG5: no pin-change or external interrupt, so it is sampled from
+// the Timer0 compare interrupt instead (see IR SAMPLING).
+#define IR_PORT_IN PING
+#define IR_PORT_BIT 5
 #define BUZZER_PIN A7  // Buzzer output pin
 #define LED_PIN 3
-#define servo1pin 32
-#define servo2pin 38
-
-// ! VARIABLES, DEFINITIONS AND STRUCTURES
-enum State { SETUP = 0, DISPENSE = 1 };
-State currentState = SETUP;
-
-struct Medicine {
-  String name;
-  int interval;    // in minutes (from hours)
-  int iterations;  // doses per day (not used in this snippet)
-  int baseHour;    // scheduled base hour (from app)
-  int baseMinute;  // scheduled base minute
-  int nextHour;    // next dispensing hour
-  int nextMinute;  // next dispensing minute
-  bool active;     // true if medicine is active
-  int lastDispensedHour;
-  int lastDispensedMinute;
-  bool dispensed;  // flag to indicate if the medicine has been dispensed
-  int dosesTaken;  // doses taken today
-};
-
-Medicine med1, med2;
-String MedContact = "+639915176440";  // For GSM alerts
-
-// ! FUNCTIONS
-
-void resetFunc() {
-  Serial.println("Resetting Arduino...");
-  wdt_enable(WDTO_15MS);  // Enable the watchdog timer with a 15ms timeout
-  while (1);              // Wait for the reset
-  lcd.clear();
-  lcd.print("Resetting...");
-}
 
-// Receive data from Serial1 (Bluetooth/GSM) with optional integer expectation.
-// This function returns a String (even when expecting a number, which you then
-// convert).
-String receiveData(bool expectInt = false) {
-  unsigned long startTime = millis();
-  while (millis() - startTime < 300000) {  // 5-minute timeout
-    if (Serial1.available()) {
-      String buffer = Serial1.readStringUntil('\n');
-      buffer.trim();
-      if (expectInt) {
-        // Return the integer value as a String
-        return String(buffer.toInt());
-      } else {
-        return buffer;
-      }
-    }
+// One servo motor per compartment for dispensing pills
+const uint8_t servoPins[kCompartments] = {32, 38};
+Servo servos[kCompartments];
+
+// ! PERIPHERAL ADAPTERS
+// SD card behind the FileStore interface. Files are opened without O_APPEND
+// or O_TRUNC so fixed-size images are overwritten in place.
+class SdFileStore : public FileStore {
+ public:
+  bool exists(const char *path) { return SD.exists(path); }
+  bool remove(const char *path) { return SD.remove(path); }
+
+  int readAt(const char *path, uint32_t offset, void *buf, uint16_t len) {
+    File f = SD.open(path, FILE_READ);
+    if (!f) return -1;
+    int got = f.seek(offset) ? f.read(buf, len) : 0;
+    f.close();
+    return got;
   }
-  return "";  // Return empty string if timeout
-}
-
-// ! HELPER FUNCTION: Format DateTime into "YYYY-MM-DD HH:MM"
-String formatDateTime(const RtcDateTime &dt) {
-  char buf[18];
-  sprintf(buf, "%04d-%02d-%02d %02d:%02d", dt.Year(), dt.Month(), dt.Day(),
-          dt.Hour(), dt.Minute());
-  return String(buf);
-}
 
-// ! LOG SCHED FUNCTION: Logs scheduled and actual intake times
-void logSched(Medicine &med, const RtcDateTime &scheduled,
-              const RtcDateTime &actual) {
-  String schedStr = formatDateTime(scheduled);
-  String actualStr = formatDateTime(actual);
-  File logFile = SD.open("schedlog.txt", FILE_WRITE);
-  if (logFile) {
-    logFile.println(schedStr + "," + actualStr);
-    logFile.close();
-    Serial.println("Logged schedule: " + schedStr + " , " + actualStr);
-  } else {
-    Serial.println("Error opening schedlog.txt for writing.");
+  int write(const char *path, const void *buf, uint16_t len) {
+    File f = SD.open(path, O_READ | O_WRITE | O_CREAT);
+    if (!f) return -1;
+    int put = f.write((const uint8_t *)buf, len);
+    f.close();  // flushes the data and directory entry
+    return put;
   }
-}
 
-// ! Functions for buzzer control
-void beepBuzzer(int times, int duration) {
-  for (int i = 0; i < times; i++) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(duration);
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(duration);
+  int append(const char *path, const void *buf, uint16_t len) {
+    File f = SD.open(path, FILE_WRITE);
+    if (!f) return -1;
+    int put = f.write((const uint8_t *)buf, len);
+    f.close();
+    return put;
   }
-}
-
-void continuousBuzzer() { digitalWrite(BUZZER_PIN, HIGH); }
 
-void stopBuzzer() { digitalWrite(BUZZER_PIN, LOW); }
-
-// ! Dispense Pill Function using servo motor
-void dispensePill(int compartment) {
-  if (compartment == 1) {
-    servo1.write(90);
-    delay(3000);
-    servo1.write(0);
-  } else if (compartment == 2) {
-    servo2.write(90);
-    delay(3000);
-    servo2.write(0);
-  }
-}
-
-// ! Update Schedule: Adds the interval (in hours) to the actual dispensing
-// time.
-// Updated saveSched() function: removes the old file and rewrites new schedule
-void saveSched() {
-  // Remove the old schedule file if it exists.
-  if (SD.exists("USERINFO.txt")) {
-    SD.remove("USERINFO.txt");
+  uint32_t size(const char *path) {
+    File f = SD.open(path, FILE_READ);
+    if (!f) return 0;
+    uint32_t n = f.size();
+    f.close();
+    return n;
   }
+};
 
-  File schedF = SD.open("USERINFO.txt", FILE_WRITE);
-  if (schedF) {
-    schedF.print(MedContact);
-    schedF.print(",");
-    if (med1.active) {
-      schedF.print(med1.name);
-      schedF.print(",");
-      schedF.print(med1.interval);
-      schedF.print(",");
-      schedF.print(med1.iterations);
-      schedF.print(",");
-      schedF.print(med1.baseHour);
-      schedF.print(",");
-      schedF.print(med1.baseMinute);
-      schedF.print(",");
-      schedF.print(med1.nextHour);
-      schedF.print(",");
-      schedF.print(med1.nextMinute);
-      schedF.print(",");
-      schedF.print(med1.active);
-      schedF.print(",");
-      schedF.print(med1.lastDispensedHour);
-      schedF.print(",");
-      schedF.print(med1.lastDispensedMinute);
-      schedF.print(",");
-      schedF.print(med2.active);
-    }
-
-    if (med2.active) {
-      schedF.print(",");
-      schedF.print(med2.name);
-      schedF.print(",");
-      schedF.print(med2.interval);
-      schedF.print(",");
-      schedF.print(med2.iterations);
-      schedF.print(",");
-      schedF.print(med2.baseHour);
-      schedF.print(",");
-      schedF.print(med2.baseMinute);
-      schedF.print(",");
-      schedF.print(med2.nextHour);
-      schedF.print(",");
-      schedF.print(med2.nextMinute);
-      schedF.print(",");
-      schedF.print(med2.lastDispensedHour);
-      schedF.print(",");
-      schedF.print(med2.lastDispensedMinute);
+// Internal EEPROM through avr-libc: eeprom_write_byte() only blocks while a
+// previous write is still in progress, which ready() rules out.
+class AvrEeprom : public Eeprom {
+ public:
+  uint16_t size() { return E2END + 1; }
+  uint8_t read(uint16_t addr) { return eeprom_read_byte((uint8_t *)addr); }
+  bool ready() { return eeprom_is_ready(); }
+  void write(uint16_t addr, uint8_t value) {
+    if (eeprom_read_byte((uint8_t *)addr) != value) {
+      eeprom_write_byte((uint8_t *)addr, value);
     }
-    schedF.println();
-    schedF.close();
-    Serial.println("Schedule saved to SD.");
-  } else {
-    Serial.println("Failed to open USERINFO.txt for writing.");
   }
-}
-
-// Updated updateSchedule() function: updates the Medicine struct and then
-// rewrites USERINFO.txt
-// void updateSchedule(Medicine &med, int actualHour, int actualMinute) {
-//   Serial.println("Updating schedule...");
-
-//   int actualMins = actualHour * 60 + actualMinute;
-//   int intervalMins = med.interval * 60;
-
-//   // Increase the count of doses taken today
-//   med.dosesTaken++;
-
-//   // Check if we need another dose today
-//   if (med.dosesTaken < med.iterations) {
-//     // Schedule next dose today
-//     int newTime = actualMins + intervalMins;
-//     med.nextHour = (newTime / 60) % 24;
-//     med.nextMinute = newTime % 60;
-//   } else {
-//     // Reset for the next day
-//     med.dosesTaken = 0;
-//     med.nextHour = med.baseHour;
-//     med.nextMinute = med.baseMinute;
-//   }
-
-//   // Update last dispensed time
-//   med.lastDispensedHour = actualHour;
-//   med.lastDispensedMinute = actualMinute;
-//   med.dispensed = false;  // Ready for next cycle
-
-//   // Debugging Output
-//   Serial.print("Next dose for ");
-//   Serial.print(med.name);
-//   Serial.print(" at ");
-//   Serial.print(med.nextHour);
-//   Serial.print(":");
-//   Serial.println(med.nextMinute);
-
-//   saveSched();  // Save updated schedule to SD
-// }
-
-void updateSchedule(Medicine &med, int actualHour, int actualMinute) {
-  Serial.println("Updating schedule...");
-
-  int actualMins =
-      actualHour * 60 + actualMinute;  // Convert current time to minutes
-  int intervalMins = med.interval;     // Interval is already in minutes
-
-  // Increase the count of doses taken today
-  med.dosesTaken++;
-
-  // Check if we need another dose today
-  if (med.dosesTaken < med.iterations) {
-    // Schedule next dose today
-    int newTime = actualMins + intervalMins;  // Add interval to current time
-    med.nextHour = (newTime / 60) % 24;       // Convert back to hours
-    med.nextMinute = newTime % 60;            // Convert back to minutes
-  } else {
-    // Reset for the next day
-    med.dosesTaken = 0;
-    med.nextHour = med.baseHour;
-    med.nextMinute = med.baseMinute;
-  }
-
-  // Update last dispensed time
-  med.lastDispensedHour = actualHour;
-  med.lastDispensedMinute = actualMinute;
-  med.dispensed = false;  // Ready for next cycle
-
-  // Debugging Output
-  Serial.print("Next dose for ");
-  Serial.print(med.name);
-  Serial.print(" at ");
-  Serial.print(med.nextHour);
-  Serial.print(":");
-  Serial.println(med.nextMinute);
-
-  saveSched();  // Save updated schedule to SD
-  // resetFunc();
-}
+};
 
-void resetDailyDoses() {
-  RtcDateTime now = Rtc.GetDateTime();
-  if (now.Hour() == 0 && now.Minute() == 0) {  // Midnight Reset
-    med1.dosesTaken = 0;
-    med2.dosesTaken = 0;
-    Serial.println("Daily doses reset!");
-  }
-}
+class RtcClock : public Clock {
+ public:
+  uint32_t now() { return Rtc.GetDateTime().TotalSeconds(); }
+};
 
-// ! Check and Dispense: Called every 10 seconds in DISPENSE state.
-void checkAndDispense() {
-  // Get current time from RTC
-  RtcDateTime now = Rtc.GetDateTime();
-  int currentHour = now.Hour();
-  int currentMinute = now.Minute();
+class LcdDisplay : public Display {
+ public:
+  void clear() { lcd.clear(); }
+  void setCursor(uint8_t col, uint8_t row) { lcd.setCursor(col, row); }
+  void print(const char *text) { lcd.print(text); }
+};
 
-  if (med1.active && currentHour == med1.nextHour &&
-      currentMinute == med1.nextMinute) {
-    med1.dispensed = false;  // Reset the flag for the next schedule
-  }
-  if (med2.active && currentHour == med2.nextHour &&
-      currentMinute == med2.nextMinute) {
-    med2.dispensed = false;  // Reset the flag for the next schedule
+class ServoActuator : public Actuator {
+ public:
+  ServoActuator(Servo &servo, uint8_t pin) : servo_(servo), pin_(pin) {}
+  // The angle is set before attaching, so the first pulse already has it.
+  void write(uint8_t angle) {
+    servo_.write(angle);
+    if (!servo_.attached()) servo_.attach(pin_);
   }
+  void detach() { servo_.detach(); }
 
-  // Process Med1 if active, scheduled time matches, and not yet dispensed
-  if (med1.active && currentHour == med1.nextHour &&
-      currentMinute == med1.nextMinute && !med1.dispensed) {
-    Serial.println("Dispensing Med1...");
-    beepBuzzer(2, 200);
-    digitalWrite(LED_PIN, HIGH);
-    Serial.println("LED HIGHHH");
-    dispensePill(1);
-    Serial.println("servo doneee");
-    beepBuzzer(2, 200);
-    continuousBuzzer();
-    Serial.println("BUZZZ CONTINUOS");
-    // Keep buzzing until IR sensor indicates pill taken (IR sensor reads LOW)
-    // Wait for the IR sensor to detect that the pill has been taken
-    unsigned long previousMillis =
-        0;  // Stores the last time the IR sensor was checked
-    const long interval =
-        500;  // Interval for checking the IR sensor (1 second)
-    bool texted = false;
-
-    while (digitalRead(IR_PIN) != LOW) {  // Wait for LOW (pill detected)
-      unsigned long currentMillis = millis();
-
-      // Check the IR sensor and update the display every second
-      if (currentMillis - previousMillis >= interval) {
-        previousMillis =
-            currentMillis;  // Save the last time you checked the IR sensor
-
-        RtcDateTime now = Rtc.GetDateTime();
-        int currentHour = now.Hour();
-        int currentMinute = now.Minute();
-        int currentSecond = now.Second();
-        Serial.print("Current time: ");
-        Serial.print(currentHour);
-        Serial.print(":");
-        Serial.println(currentMinute);
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Current Time: ");
-        lcd.setCursor(0, 1);
-        lcd.print(currentHour);
-        lcd.print(":");
-        lcd.print(currentMinute);
-        lcd.print(":");
-        lcd.print(currentSecond);
-
-        // Send alert if the pill is not taken within the specified time
-        static unsigned long alertStartTime =
-            currentMillis;  // Track when the alert timer started
-        if (currentMillis - alertStartTime >= 10000 &&
-            !texted) {  // 18 seconds (for testing)
-          sendAlert("Ayaw uminom ni patient maamsir");
-          texted = true;
-        }
-      }
-
-      // Add a small delay to avoid overwhelming the loop
-      delay(10);
-    }
-
-    // Pill has been taken (IR sensor reads HIGH)
-    stopBuzzer();
-    digitalWrite(LED_PIN, LOW);
-    Serial.println("LED LOWWW");
-    sendAlert("Nakainom na si patient mo beh!");
-    stopBuzzer();
-    digitalWrite(LED_PIN, LOW);
-    Serial.println("LED LOWWW");
-    sendAlert("Nakainom na si patient mo beh!");
-
-    // Log scheduled and actual intake times
-    RtcDateTime scheduledTime(now.Year(), now.Month(), now.Day(), med1.nextHour,
-                              med1.nextMinute, 0);
-    RtcDateTime actualTime = Rtc.GetDateTime();
-    logSched(med1, scheduledTime, actualTime);
-    updateSchedule(med1, currentHour, currentMinute);
-    med1.dispensed = true;
-  }
-}
+ private:
+  Servo &servo_;
+  uint8_t pin_;
+};
 
-// NewInstance function to receive new data via Serial1 (Bluetooth/GSM) and
-// update medicine data.
-int NewInstance() {
-  Serial1.println("1");
+class PinIndicator : public Indicator {
+ public:
+  explicit PinIndicator(uint8_t pin) : pin_(pin) {}
+  void set(bool on) { digitalWrite(pin_, on ? HIGH : LOW); }
 
-  Serial.println("Waiting for Med Contact...");
-  MedContact = receiveData();
+ private:
+  uint8_t pin_;
+};
 
-  Serial.println("Waiting for Med1 Name...");
-  med1.name = receiveData();
+// Filled by the IR sampling interrupt below.
+EdgeQueue<16> irEdges;
 
-  Serial.println("Waiting for Med1 Interval...");
-  med1.interval = receiveData(true).toInt();
+class IrSensor : public PresenceSensor {
+ public:
+  bool nextEdge(SensorEdge &edge) { return irEdges.pop(edge); }
+};
 
-  Serial.println("Waiting for Med1 Iterations...");
-  med1.iterations = receiveData(true).toInt();
+class StreamLink : public ByteStream {
+ public:
+  explicit StreamLink(Stream &s) : s_(s) {}
+  int available() { return s_.available(); }
+  int read() { return s_.read(); }
+  size_t write(const uint8_t *buf, size_t len) { return s_.write(buf, len); }
 
-  Serial.println("Waiting for Med1 Base Hour...");
-  med1.baseHour = receiveData(true).toInt();
+ private:
+  Stream &s_;
+};
 
-  Serial.println("Waiting for Med1 Base Minute...");
-  med1.baseMinute = receiveData(true).toInt();
+// millis() stops while the MCU is powered down, so the scheduler clock adds
+// the time spent asleep. The IR sampling ISR reads it through clockMillis(),
+// so both sides go through an atomic block: four bytes are not one load.
+volatile uint32_t sleptMs = 0;
+uint32_t clockMillis() {
+  uint32_t slept;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { slept = sleptMs; }
+  return millis() + slept;
+}
+uint32_t clockMicros() { return micros(); }  // boot and profile timing only
+
+// ! WATCHDOG AND WARM RESTART
+// Once setup() is done the watchdog runs in reset mode and loop() kicks it on
+// every pass, so a pass stuck for WATCHDOG_TIMEOUT (a wedged I2C bus, an SD
+// card that stops answering) resets the board. The Dispenser keeps its
+// in-flight dose state in .noinit RAM, which that reset leaves alone, so the
+// dose carries on where it was.
+// powerDown() borrows the watchdog as its wake timer and hands it back.
+#define WATCHDOG_TIMEOUT WDTO_2S
+#define BOOT_WATCHDOG_TIMEOUT WDTO_8S  // SD.begin() alone may take 2 s
+
+RunCheckpoint runState __attribute__((section(".noinit")));
+uint16_t warmBoots __attribute__((section(".noinit")));
+uint16_t watchdogResets __attribute__((section(".noinit")));
+uint8_t resetFlags __attribute__((section(".noinit")));  // MCUSR at reset
+uint32_t bootMs = 0;  // reset to the end of setup()
+bool warmBoot = false;
+
+// Runs before the C runtime. A watchdog reset leaves the watchdog enabled at
+// its shortest timeout, which would fire again long before setup().
+void captureResetFlags() __attribute__((naked, used, section(".init3")));
+void captureResetFlags() {
+  resetFlags = MCUSR;
+  MCUSR = 0;
+  wdt_disable();
+}
 
-  Serial.println("Waiting for Med1 Next Hour...");
-  med1.nextHour = receiveData(true).toInt();
+void superviseLoop() { wdt_enable(WATCHDOG_TIMEOUT); }
 
-  Serial.println("Waiting for Med1 Next Minute...");
-  med1.nextMinute = receiveData(true).toInt();
+// A full reset through the watchdog: unlike "jmp 0" it also resets the
+// peripherals. A requested restart always boots cold.
+void softReset() {
+  memset(&runState, 0, sizeof(runState));
+  wdt_enable(WDTO_15MS);
+  while (1);
+}
 
-  Serial.println("Waiting for Med1 Active State...");
-  med1.active = (receiveData() == "1");
+SdFileStore sdStore;
+AvrEeprom avrEeprom;
+RtcClock rtcClock;
+ClockService wallClock(rtcClock, clockMillis);  // everyone reads this one
+LcdDisplay lcdDisplay;
+ServoActuator servoActuators[kCompartments] = {
+    ServoActuator(servos[0], servoPins[0]),
+    ServoActuator(servos[1], servoPins[1])};
+PinIndicator buzzerOut(BUZZER_PIN);
+PinIndicator ledOut(LED_PIN);
+IrSensor irSensor;
+StreamLink consoleLink(Serial);
+StreamLink bluetoothLink(Serial1);
+StreamLink gsmLink(Serial2);
+
+const DispenserIo io = {clockMillis,
+                        wallClock,
+                        lcdDisplay,
+                        {&servoActuators[0], &servoActuators[1]},
+                        buzzerOut,
+                        ledOut,
+                        irSensor,
+                        sdStore,
+                        avrEeprom,
+                        consoleLink,
+                        bluetoothLink,
+                        gsmLink,
+                        softReset};
+Dispenser dispenser(io);
+
+// ! LOW POWER IDLE
+// Between events the MCU sleeps. With a dose in flight (IR polling, servo
+// PWM) or work due within SLEEP_MIN_MS it only enters SLEEP_MODE_IDLE, which
+// keeps timer0 and the UARTs alive. Otherwise it powers down in watchdog
+// chunks of up to 8 s; a falling edge on RX1 (Bluetooth, INT2) or RX0 (USB
+// console, PCINT8) wakes it early. The first byte that arrives while powered
+// down is lost, which both line protocols tolerate.
+#define SLEEP_MIN_MS 1000
+#define RX1_PIN 19
+
+PowerStats power;
+volatile uint8_t wakeSource = PowerStats::WAKE_OTHER;
+
+ISR(WDT_vect) { wakeSource = PowerStats::WAKE_WATCHDOG; }
+
+// ! IR SAMPLING
+// Timer0 already runs for millis() (overflow every 1.024 ms); its compare A
+// match is free, as pin 13 PWM is unused, and fires once per timer cycle
+// too. Each sample compares the pin with the last level pushed and queues a
+// timestamped edge on a change. If the queue is full the level is left
+// alone, so the edge is retried on the next sample rather than lost.
+volatile bool irLevel = false;  // true while the beam is broken
+
+ISR(TIMER0_COMPA_vect) {
+  bool active = !(IR_PORT_IN & _BV(IR_PORT_BIT));
+  if (active != irLevel && irEdges.push(clockMillis(), active)) {
+    irLevel = active;
+  }
+}
 
-  Serial.println("Waiting for Med1 Last Dispensed Hour...");
-  med1.lastDispensedHour = receiveData(true).toInt();
+void startIrSampling() {
+  OCR0A = 128;  // mid-cycle, clear of the millis() overflow
+  TIMSK0 |= _BV(OCIE0A);
+}
 
-  Serial.println("Waiting for Med1 Last Dispensed Minute...");
-  med1.lastDispensedMinute = receiveData(true).toInt();
+void onSerialWake() { wakeSource = PowerStats::WAKE_SERIAL; }
 
-  // Check if Med2 is active
-  Serial.println("Waiting for Med2 Active State...");
-  med2.active = (receiveData() == "1");
+ISR(PCINT1_vect) { wakeSource = PowerStats::WAKE_SERIAL; }
 
-  if (med2.active) {
-    Serial.println("Waiting for Med2 Name...");
-    med2.name = receiveData();
+// Largest watchdog period that fits in `ms`, as WDTO_* and milliseconds.
+uint8_t watchdogChunk(uint32_t ms, uint32_t &chunkMs) {
+  if (ms >= 8000) {
+    chunkMs = 8000;
+    return WDTO_8S;
+  }
+  if (ms >= 4000) {
+    chunkMs = 4000;
+    return WDTO_4S;
+  }
+  if (ms >= 2000) {
+    chunkMs = 2000;
+    return WDTO_2S;
+  }
+  chunkMs = 1000;
+  return WDTO_1S;
+}
 
-    Serial.println("Waiting for Med2 Interval...");
-    med2.interval = receiveData(true).toInt();
+// Watchdog in interrupt-only mode (WDIE without WDE): it wakes, never resets.
+void armWatchdogWake(uint8_t wdto) {
+  cli();
+  wdt_reset();
+  MCUSR &= ~_BV(WDRF);
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDIE) | (wdto & 0x07) | ((wdto & 0x08) ? _BV(WDP3) : 0);
+  sei();
+}
 
-    Serial.println("Waiting for Med2 Iterations...");
-    med2.iterations = receiveData(true).toInt();
+void powerDown(uint32_t budget) {
+  uint32_t chunkMs;
+  uint8_t wdto = watchdogChunk(budget, chunkMs);
+#ifdef LOG_FLUSH_ON_SLEEP
+  dispenser.flushLogs();  // trade log batching for durability
+#endif
+
+  Serial.flush();  // let pending output drain before the UART clock stops
+  wakeSource = PowerStats::WAKE_OTHER;
+  attachInterrupt(digitalPinToInterrupt(RX1_PIN), onSerialWake, FALLING);
+  PCMSK1 |= _BV(PCINT8);
+  PCIFR = _BV(PCIF1);
+  PCICR |= _BV(PCIE1);
+  armWatchdogWake(wdto);
+
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
+
+  superviseLoop();
+  PCICR &= ~_BV(PCIE1);
+  detachInterrupt(digitalPinToInterrupt(RX1_PIN));
+
+  // A watchdog wake means the whole chunk elapsed; for an early wake the
+  // RTC says how long we were out (to the second). The watchdog is only good
+  // to 10%, but rather than read the RTC after every chunk the wall clock is
+  // corrected once, after the last chunk of this sleep.
+  uint32_t slept = chunkMs;
+  if (wakeSource != PowerStats::WAKE_WATCHDOG) {
+    slept = wallClock.measureSleep(chunkMs);
+  } else if (budget - slept < SLEEP_MIN_MS) {
+    wallClock.resync();
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { sleptMs += slept; }
+  power.powerDownMs += slept;
+  power.wakes[wakeSource]++;
+}
 
-    Serial.println("Waiting for Med2 Base Hour...");
-    med2.baseHour = receiveData(true).toInt();
+void idle() {
+  if (Serial.available() || Serial1.available()) return;
+  uint32_t budget = dispenser.idleBudget();
+  if (budget == 0) return;
+  if (budget < SLEEP_MIN_MS || !dispenser.canPowerDown()) {
+    // Wakes on the next timer0 tick (~1 ms) or UART byte.
+    uint32_t before = millis();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+    power.idleMs += millis() - before;
+    return;
+  }
+  powerDown(budget);
+}
 
-    Serial.println("Waiting for Med2 Base Minute...");
-    med2.baseMinute = receiveData(true).toInt();
+void printClockStats() {
+  Serial.print("rtc reads=");
+  Serial.print(wallClock.reads());
+  Serial.print(" served=");
+  Serial.print(wallClock.served());
+  Serial.print(" jumps=");
+  Serial.print(wallClock.jumps());
+  Serial.print(" drift=");
+  Serial.print(wallClock.lastDrift());
+  Serial.print(" worst=");
+  Serial.print(wallClock.worstDrift());
+  // Seconds per day the millisecond clock runs slow (+) or fast (-).
+  Serial.print(" perDay=");
+  Serial.println(wallClock.driftSpanMs() >= CLOCK_RESYNC_MS
+                     ? (float)wallClock.driftTotal() * 86400000.0f /
+                           wallClock.driftSpanMs()
+                     : 0.0f);
+}
 
-    Serial.println("Waiting for Med2 Next Hour...");
-    med2.nextHour = receiveData(true).toInt();
+void printWatchdogStats() {
+  Serial.print("wdt resets=");
+  Serial.print(watchdogResets);
+  Serial.print(" warmBoots=");
+  Serial.print(warmBoots);
+  Serial.print(" lastReset=0x");
+  Serial.print(resetFlags, HEX);
+  Serial.print(" bootMs=");
+  Serial.println(bootMs);
+}
 
-    Serial.println("Waiting for Med2 Next Minute...");
-    med2.nextMinute = receiveData(true).toInt();
+void printPowerStats() {
+  power.activeMs = clockMillis() - power.idleMs - power.powerDownMs;
+  Serial.print("power wakes=");
+  Serial.print(power.totalWakes());
+  Serial.print(" wdt=");
+  Serial.print(power.wakes[PowerStats::WAKE_WATCHDOG]);
+  Serial.print(" serial=");
+  Serial.print(power.wakes[PowerStats::WAKE_SERIAL]);
+  Serial.print(" activeMs=");
+  Serial.print(power.activeMs);
+  Serial.print(" idleMs=");
+  Serial.print(power.idleMs);
+  Serial.print(" downMs=");
+  Serial.print(power.powerDownMs);
+  Serial.print(" uAh=");
+  Serial.println(power.chargeUah());
+}
 
-    Serial.println("Waiting for Med2 Last Dispensed Hour...");
-    med2.lastDispensedHour = receiveData(true).toInt();
+// ! MEMORY
+// The firmware is meant to allocate nothing once setup() returns. malloc and
+// realloc are wrapped at link time (see build_flags) so any allocation after
+// that point is counted and shows up on the "mem" console command.
+volatile bool heapSealed = false;
+volatile uint16_t lateAllocs = 0;
 
-    Serial.println("Waiting for Med2 Last Dispensed Minute...");
-    med2.lastDispensedMinute = receiveData(true).toInt();
-  }
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_realloc(void *p, size_t n);
 
-  saveSched();  // Save the schedule to SD
-  Serial.println("Setup Successful");
-  currentState = DISPENSE;
-  return 1;
+void *__wrap_malloc(size_t n) {
+  if (heapSealed) lateAllocs++;
+  return __real_malloc(n);
 }
 
-// SD load function: loads all tokens from one line
-void loadUser() {
-  File schedF = SD.open("USERINFO.txt", FILE_READ);
-  if (!schedF) {
-    Serial.println("Failed to open USERINFO.txt for reading.");
-    return;
-  }
-  Serial.println("Loading user data...");
-  String line = schedF.readStringUntil('\n');
-  line.trim();
-  if (line.length() == 0) {
-    Serial.println("USERINFO.txt is empty.");
-    schedF.close();
-    return;
-  }
-  // Increase token count to 21 for all fields:
-  String tokens[21];
-  int index = 0;
-  int lastIndex = 0;
-  for (int i = 0; i < line.length(); i++) {
-    if (line[i] == ',' || i == line.length() - 1) {
-      if (i == line.length() - 1) i++;
-      tokens[index++] = line.substring(lastIndex, i);
-      lastIndex = i + 1;
-    }
-  }
-  if (index < 11) {
-    Serial.println("Corrupt or incomplete data in USERINFO.txt.");
-    schedF.close();
-    return;
-  }
-  // Parse MedContact and Med1
-  MedContact = tokens[0];
-  med1.name = tokens[1];
-  med1.interval = tokens[2].toInt();
-  med1.iterations = tokens[3].toInt();
-  med1.baseHour = tokens[4].toInt();
-  med1.baseMinute = tokens[5].toInt();
-  med1.nextHour = tokens[6].toInt();
-  med1.nextMinute = tokens[7].toInt();
-  med1.active = (tokens[8] == "1");
-  med1.lastDispensedHour = tokens[9].toInt();
-  med1.lastDispensedMinute = tokens[10].toInt();
-  med2.active = (tokens[11] == "1");
-  if (med2.active && index >= 19) {
-    med2.name = tokens[12];
-    med2.interval = tokens[13].toInt();
-    med2.iterations = tokens[14].toInt();
-    med2.baseHour = tokens[15].toInt();
-    med2.baseMinute = tokens[16].toInt();
-    med2.nextHour = tokens[17].toInt();
-    med2.nextMinute = tokens[18].toInt();
-    med2.lastDispensedHour = tokens[19].toInt();
-    med2.lastDispensedMinute = tokens[20].toInt();
-  }
-  schedF.close();
-  Serial.println("User data loaded successfully.");
+void *__wrap_realloc(void *p, size_t n) {
+  if (heapSealed) lateAllocs++;
+  return __real_realloc(p, n);
+}
 }
 
-// Clear user function: saves current data to USER_LOG.txt then resets.
-void clearUser() {
-  File userFile = SD.open("USERINFO.txt", FILE_READ);
-  if (userFile) {
-    Serial.println("Saving current data to USER_LOG.txt...");
-    File logFile = SD.open("USER_LOG.txt", FILE_WRITE);
-    if (logFile) {
-      String userData = userFile.readStringUntil('\n');
-      logFile.println(userData);
-      logFile.close();
-      Serial.println("User data saved to log.");
-    } else {
-      Serial.println("ERROR: Failed to open USER_LOG.txt.");
-    }
-    userFile.close();
-  } else {
-    Serial.println("No existing user data found.");
-  }
-  if (SD.exists("USERINFO.txt")) {
-    SD.remove("USERINFO.txt");
-    Serial.println("USERINFO.txt deleted.");
-  } else {
-    Serial.println("USERINFO.txt does not exist.");
-  }
-  Serial.println("Restarting Arduino...");
-  delay(1000);
-  asm volatile("jmp 0");  // Soft reset Arduino
+// Bytes between the top of the heap (or static data) and the stack.
+int freeRam() {
+  extern int __heap_start, *__brkval;
+  int top;
+  char *heap = __brkval == 0 ? (char *)&__heap_start : (char *)__brkval;
+  return (int)((char *)&top - heap);
 }
 
-void sendAlert(String msg) {
-  // Set GSM module to text mode
-  Serial2.println("AT+CMGF=1");
-  delay(1000);
-
-  // Specify the recipient's phone number
-  Serial2.print("AT+CMGS=\"");
-  Serial2.print(MedContact);
-  Serial2.println("\"");
-  delay(1000);
-
-  // Send the message content
-  Serial2.println(msg);
-  delay(100);
-
-  // Send Ctrl+Z to indicate end of message
-  Serial2.write(26);
-  delay(5000);  // Wait for the message to be sent
-  Serial.println("GSM message sent: " + msg);
+void printMemStats() {
+  Serial.print("mem free=");
+  Serial.print(freeRam());
+  Serial.print(" lateAllocs=");
+  Serial.println(lateAllocs);
 }
 
-void setup() {
-  Wire.begin();
-  lcd.init();
-  lcd.backlight();
-  Rtc.Begin();
+void printBootStats();
+
+// ! BOARD COMMANDS (sorted by name; the Dispenser handles the rest)
+const Command kBoardCommands[] = {
+    {"boot", [](void *, StrView) { printBootStats(); }},
+    {"mem", [](void *, StrView) { printMemStats(); }},
+    {"power", [](void *, StrView) { printPowerStats(); }},
+    {"rtc", [](void *, StrView) { printClockStats(); }},
+    {"wdt", [](void *, StrView) { printWatchdogStats(); }},
+};
+
+// ! BOOT
+// setup() brings the board up in phases, timing each. Nothing waits for show:
+// the splash goes up first and stays while the SD card mounts and the
+// schedule loads, then the Dispenser draws over it. A phase whose device is
+// not ready (no SD card) is retried every retryMs with the watchdog kicked,
+// and the LCD says which one is holding boot up.
+#define SD_RETRY_MS 1000
+
+bool bootSerial() {
   Serial.begin(9600);
   Serial1.begin(9600);
   Serial2.begin(9600);
 
-  // Attach servos to designated pins.
-  servo1.attach(servo1pin);
-  servo2.attach(servo2pin);
-  servo1.write(0);
-  servo2.write(0);
-
   // Set buzzer and LED pins as output; IR sensor pin as input.
   pinMode(BUZZER_PIN, OUTPUT);
   pinMode(LED_PIN, OUTPUT);
   pinMode(IR_PIN, INPUT);
+  startIrSampling();
+  return true;
+}
 
+bool bootLcd() {
+  Wire.begin();
+  lcd.init();
+  lcd.backlight();
+  lcd.setCursor(0, 0);
+  lcd.print("Initializing...");
+  return true;
+}
+
+bool bootRtc() {
+  Rtc.Begin();
   // Rtc.SetDateTime(RtcDateTime(__DATE__, __TIME__));
   lcd.setCursor(0, 1);
   lcd.print("RTC OK");
-  lcd.setCursor(0, 0);
-  lcd.print("Initializing...");
-  delay(1000);
+  return true;
+}
 
+bool bootSd() {
   SPI.begin();
+  lcd.setCursor(10, 1);
   if (!SD.begin(CSpin)) {
     Serial.println("SD card initialization failed.");
-    while (true) {
-      lcd.setCursor(10, 1);
-      lcd.print("SD FAIL");
-    }
+    lcd.print("SD FAIL");
+    return false;
   }
-  lcd.setCursor(10, 1);
-  lcd.print("SD OK");
+  lcd.print("SD OK  ");
   Serial.println("SD card is ready to use.");
-  delay(2000);
-
-  // Check if USERINFO.txt exists and load user data if it does.
-  if (SD.exists("USERINFO.txt")) {
-    Serial.println("USERINFO.txt found. Loading user data...");
-    loadUser();
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("User Data Loaded");
-    delay(2000);
-    currentState = DISPENSE;
-  } else {
-    Serial.println("No saved data found. Proceeding to setup...");
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("   PillOtter");
-    lcd.setCursor(0, 1);
-    lcd.print("Connect 2 setup");
-    currentState = SETUP;
-  }
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print("   PillOtter");
-  lcd.setCursor(0, 1);
-  lcd.print("Connect 2 setup");
+  return true;
+}
+
+// From here on the Dispenser owns the LCD (it keeps a shadow of it).
+bool bootSchedule() {
+  dispenser.setExtraCommands(kBoardCommands,
+                             sizeof(kBoardCommands) / sizeof(kBoardCommands[0]),
+                             NULL);
+  dispenser.begin();
+  return true;
+}
+
+const BootPhase kBootPhases[] = {
+    {"serial", bootSerial, 0},
+    {"lcd", bootLcd, 0},
+    {"rtc", bootRtc, 0},
+    {"sd", bootSd, SD_RETRY_MS},
+    {"schedule", bootSchedule, 0},
+};
+
+BootSequence boot(kBootPhases, sizeof(kBootPhases) / sizeof(kBootPhases[0]),
+                  clockMicros);
+
+void printBootStats() {
+  Printer out(consoleLink);
+  out.print(warmBoot ? "warm " : "cold ");
+  boot.print(out);
+}
+
+void setup() {
+  // Warm if RAM still holds a valid checkpoint: a watchdog or reset-button
+  // restart, not a power-up.
+  dispenser.setCheckpoint(&runState);
+  warmBoot = dispenser.hasCheckpoint();
+  if (!warmBoot) warmBoots = watchdogResets = 0;
+  if (warmBoot) warmBoots++;
+  if (resetFlags & _BV(WDRF)) watchdogResets++;
+  wdt_enable(BOOT_WATCHDOG_TIMEOUT);
+#ifdef PILLOTTER_PROFILE
+  Profiler::setClock(clockMicros);
+#endif
+
+  while (!boot.step()) wdt_reset();
+  heapSealed = true;
+
+  bootMs = millis();
+  printBootStats();
+  superviseLoop();
 }
 
 void loop() {
-  switch (currentState) {
-    case SETUP:
-      // Existing SETUP code for handling new instance commands...
-      if (Serial1.available()) {
-        String receivedData = Serial1.readStringUntil('\n');
-        receivedData.trim();
-        Serial.println("RECEIVED: " + receivedData);
-        if (receivedData == "check") {
-          Serial1.println("1");
-        } else if (receivedData == "NewInstance") {
-          int confirmation = NewInstance();
-          Serial1.println(confirmation);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print("Setup Successful");
-        }
-      }
-      break;
-
-    case DISPENSE:
-      resetDailyDoses();
-      // Check the RTC and schedule every 10 seconds.
-      RtcDateTime now = Rtc.GetDateTime();
-      int currentHour = now.Hour();
-      int currentMinute = now.Minute();
-      int currentSecond = now.Second();
-      Serial.print("Current time: ");
-      Serial.print(currentHour);
-      Serial.print(":");
-      Serial.println(currentMinute);
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print("Current Time: ");
-      lcd.setCursor(0, 1);
-      lcd.print(currentHour);
-      lcd.print(":");
-      lcd.print(currentMinute);
-      lcd.print(":");
-      lcd.print(currentSecond);
-
-      checkAndDispense();
-      delay(1000);
-      // Optionally, process USB Serial commands for testing.
-      if (Serial.available()) {
-        String input = Serial.readStringUntil('\n');
-        input.trim();
-        if (input == "med1") {
-          Serial.print(med1.name);
-          Serial.print(",");
-          Serial.print(med1.interval);
-          Serial.print(",");
-          Serial.print(med1.iterations);
-          Serial.print(",");
-          Serial.print(med1.baseHour);
-          Serial.print(",");
-          Serial.print(med1.baseMinute);
-          Serial.print(",");
-          Serial.print(med1.nextHour);
-          Serial.print(",");
-          Serial.print(med1.nextMinute);
-          Serial.print(",");
-          Serial.print(med1.active);
-          Serial.print(",");
-          Serial.print(med1.lastDispensedHour);
-          Serial.print(",");
-          Serial.print(med1.lastDispensedMinute);
-          Serial.print(",");
-          Serial.println(med2.active);
-        } else if (input == "med2") {
-          Serial.print(med2.name);
-          Serial.print(",");
-          Serial.print(med2.interval);
-          Serial.print(",");
-          Serial.print(med1.iterations);
-          Serial.print(",");
-          Serial.print(med1.baseHour);
-          Serial.print(",");
-          Serial.print(med2.baseMinute);
-          Serial.print(",");
-          Serial.print(med2.nextHour);
-          Serial.print(",");
-          Serial.print(med2.nextMinute);
-          Serial.print(",");
-          Serial.print(med2.active);
-          Serial.print(",");
-          Serial.print(med2.lastDispensedHour);
-          Serial.print(",");
-          Serial.print(med2.lastDispensedMinute);
-        } else if (input == "clear") {
-          clearUser();
-        }
-      }
-      break;
-  }
-}
\ No newline at end of file
+  dispenser.loop();
+  wdt_reset();  // heartbeat: only a pass that returns keeps the board up
+  if (dispenser.state() == Dispenser::DISPENSE) idle();
+}
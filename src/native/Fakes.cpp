@@ -0,0 +1,223 @@
+#include "Fakes.h"
+
+#include <stdio.h>
+#include <string.h>
+
+thread_local SimClock *simClock = NULL;
+
+uint32_t simMillis() { return simClock->millis(); }
+
+// ! MemFileStore
+bool MemFileStore::exists(const char *path) {
+  return files_.count(path) != 0;
+}
+
+bool MemFileStore::remove(const char *path) {
+  return files_.erase(path) != 0;
+}
+
+int MemFileStore::readAt(const char *path, uint32_t offset, void *buf,
+                         uint16_t len) {
+  opens_++;
+  std::map<std::string, std::vector<uint8_t> >::const_iterator f =
+      files_.find(path);
+  if (f == files_.end()) return -1;
+  if (offset >= f->second.size()) return 0;
+  uint32_t n = f->second.size() - offset;
+  if (n > len) n = len;
+  memcpy(buf, &f->second[offset], n);
+  return n;
+}
+
+int MemFileStore::write(const char *path, const void *buf, uint16_t len) {
+  opens_++;
+  writeOps_++;
+  bytesWritten_ += len;
+  std::vector<uint8_t> &f = files_[path];
+  if (f.size() < len) f.resize(len);
+  memcpy(&f[0], buf, len);
+  return len;
+}
+
+int MemFileStore::append(const char *path, const void *buf, uint16_t len) {
+  opens_++;
+  writeOps_++;
+  bytesWritten_ += len;
+  std::vector<uint8_t> &f = files_[path];
+  const uint8_t *p = static_cast<const uint8_t *>(buf);
+  f.insert(f.end(), p, p + len);
+  return len;
+}
+
+uint32_t MemFileStore::size(const char *path) {
+  opens_++;
+  std::map<std::string, std::vector<uint8_t> >::const_iterator f =
+      files_.find(path);
+  return f == files_.end() ? 0 : f->second.size();
+}
+
+// ! TextDisplay
+void TextDisplay::clear() {
+  rows_[0] = rows_[1] = std::string(16, ' ');
+  col_ = row_ = 0;
+  writes_++;
+}
+
+void TextDisplay::setCursor(uint8_t col, uint8_t row) {
+  col_ = col;
+  row_ = row < 2 ? row : 1;
+  writes_++;
+}
+
+void TextDisplay::print(const char *text) {
+  for (; *text && col_ < 16; text++) rows_[row_][col_++] = *text;
+  writes_++;
+}
+
+// ! Patient
+// xorshift32: deterministic for a given seed on every host.
+uint32_t Patient::random() {
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_;
+}
+
+void Patient::add(uint64_t at, bool active, bool pickup) {
+  Edge e = {at, active, pickup};
+  pending_.push_back(e);
+  quietFrom_ = at + 1;
+}
+
+void Patient::pillDropped() {
+  dropped_++;
+  uint64_t now = clock_.elapsedMs();
+  uint64_t from = now > quietFrom_ ? now : quietFrom_;
+  bool missed = script_.missEvery && dropped_ % script_.missEvery == 0;
+  uint32_t delay = script_.pickupMs;
+  if (script_.lateEvery && dropped_ % script_.lateEvery == 0) {
+    delay = script_.lateMs;
+  } else if (script_.jitterMs) {
+    delay += random() % script_.jitterMs;
+  }
+  uint64_t pickup = now + delay;
+  if (pickup < from + 100) pickup = from + 100;
+
+  // Spurious pulses of 1-19 ms, spread over the wait (or the first minute
+  // of it, for a pill that is never taken).
+  uint64_t span = missed ? 60000 : pickup - from - 50;
+  for (uint8_t i = 0; i < script_.noisePulses && span > 100; i++) {
+    uint64_t at = from + (span * i + random() % (span / 2)) /
+                             script_.noisePulses;
+    if (at < quietFrom_) at = quietFrom_;
+    add(at, true);
+    add(at + 1 + random() % 19, false);
+  }
+  if (missed) return;
+  if (pickup < quietFrom_ + 20) pickup = quietFrom_ + 20;
+
+  // The hand breaks the beam, with a few 1-9 ms dropouts early on.
+  uint64_t at = pickup;
+  add(at, true, true);
+  for (uint8_t i = 0; i < script_.bounces; i++) {
+    at += 5 + random() % 20;
+    add(at, false);
+    at += 1 + random() % 9;
+    add(at, true);
+  }
+  uint32_t hand = script_.handMs ? script_.handMs : 400;
+  add(at > pickup + hand ? at + 50 : pickup + hand, false);
+}
+
+bool Patient::nextEdge(SensorEdge &edge) {
+  if (pending_.empty() || pending_.front().at > clock_.elapsedMs()) {
+    return false;
+  }
+  const Edge &e = pending_.front();
+  edge.at = (uint32_t)e.at;  // the millis() domain wraps the same way
+  edge.active = e.active;
+  if (e.pickup) taken_++;
+  edges_++;
+  pending_.pop_front();
+  return true;
+}
+
+uint64_t Patient::nextEdgeMs() const {
+  return pending_.empty() ? UINT64_MAX : pending_.front().at;
+}
+
+void SimServo::write(uint8_t angle) {
+  if (angle != angle_) moves_++;
+  uint8_t step = angle > angle_ ? angle - angle_ : angle_ - angle;
+  if (attached_ && step > maxStep_) maxStep_ = step;
+  if (angle_ != 0 && angle == 0) patient_.pillDropped();
+  angle_ = angle;
+  attached_ = true;
+}
+
+// ! SimLink
+int SimLink::read() {
+  if (rx_.empty()) return -1;
+  uint8_t b = rx_.front();
+  rx_.pop_front();
+  return b;
+}
+
+size_t SimLink::write(const uint8_t *buf, size_t len) {
+  if (discard_) return len;
+  tx_.append(reinterpret_cast<const char *>(buf), len);
+  if (echo_) fwrite(buf, 1, len, stdout);
+  return len;
+}
+
+void SimLink::send(const void *buf, size_t len) {
+  const uint8_t *p = static_cast<const uint8_t *>(buf);
+  rx_.insert(rx_.end(), p, p + len);
+}
+
+void SimLink::send(const char *s) { send(s, strlen(s)); }
+
+// ! SimModem
+int SimModem::read() {
+  if (rx_.empty()) return -1;
+  uint8_t b = rx_.front();
+  rx_.pop_front();
+  return b;
+}
+
+void SimModem::reply(const char *s) { rx_.insert(rx_.end(), s, s + strlen(s)); }
+
+size_t SimModem::write(const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    char c = buf[i];
+    if (inBody_) {
+      if (c == 26) {  // Ctrl+Z sends
+        messages_++;
+        bodies_.push_back(line_);
+        reply("\r\n+CMGS: 1\r\n\r\nOK\r\n");
+        inBody_ = false;
+        line_.clear();
+      } else if (c == 27) {  // ESC aborts
+        inBody_ = false;
+        line_.clear();
+      } else {
+        line_ += c;
+      }
+      continue;
+    }
+    if (c != '\r') {
+      line_ += c;
+      continue;
+    }
+    if (line_ == "AT+CMGF=1") {
+      reply("\r\nOK\r\n");
+    } else if (line_.compare(0, 8, "AT+CMGS=") == 0) {
+      reply("> ");
+      inBody_ = true;
+    } else {
+      reply("\r\nERROR\r\n");
+    }
+    line_.clear();
+  }
+  return len;
+}
@@ -0,0 +1,265 @@
+#ifndef PILLOTTER_NATIVE_FAKES_H
+#define PILLOTTER_NATIVE_FAKES_H
+
+// Host-side stand-ins for the board peripherals (see Hal.h). Time is virtual:
+// nothing advances it except SimClock::advance(), so a run is deterministic
+// and as fast as the code under test.
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Hal.h"
+
+class SimClock : public Clock {
+ public:
+  // `startEpoch` is the wall-clock time at t = 0, in seconds since 2000.
+  explicit SimClock(uint32_t startEpoch) : start_(startEpoch), ms_(0) {}
+
+  uint32_t now() { return start_ + (uint32_t)(ms_ / 1000); }
+  uint32_t millis() const { return (uint32_t)ms_; }  // wraps like the board
+  uint64_t elapsedMs() const { return ms_; }
+  void advance(uint32_t ms) { ms_ += ms; }
+
+ private:
+  uint32_t start_;
+  uint64_t ms_;
+};
+
+// The DS1302 as seen through SimClock, optionally running `ppm` parts per
+// million fast (or slow, if negative) against the millisecond clock.
+class SimRtc : public Clock {
+ public:
+  SimRtc(SimClock &clock, int32_t ppm) : clock_(clock), ppm_(ppm) {}
+  uint32_t now() {
+    reads_++;
+    int64_t ms = clock_.elapsedMs();
+    return clock_.now() - ms / 1000 + (ms + ms * ppm_ / 1000000) / 1000;
+  }
+  uint32_t reads() const { return reads_; }
+
+ private:
+  SimClock &clock_;
+  int32_t ppm_;
+  uint32_t reads_ = 0;
+};
+
+// The clock behind the ClockFn handed to the Dispenser. ClockFn takes no
+// context, so this is per thread: whoever steps a device points it at that
+// device's clock first (see DeviceSim::step()).
+extern thread_local SimClock *simClock;
+uint32_t simMillis();
+
+class MemFileStore : public FileStore {
+ public:
+  bool exists(const char *path);
+  bool remove(const char *path);
+  int readAt(const char *path, uint32_t offset, void *buf, uint16_t len);
+  int write(const char *path, const void *buf, uint16_t len);
+  int append(const char *path, const void *buf, uint16_t len);
+  uint32_t size(const char *path);
+
+  uint32_t opens() const { return opens_; }
+  uint32_t bytesWritten() const { return bytesWritten_; }
+  uint32_t writeOps() const { return writeOps_; }
+
+ private:
+  std::map<std::string, std::vector<uint8_t> > files_;
+  uint32_t opens_ = 0;
+  uint32_t bytesWritten_ = 0;
+  uint32_t writeOps_ = 0;
+};
+
+class MemEeprom : public Eeprom {
+ public:
+  MemEeprom() : cells_(4096, 0xFF), cellWrites_(4096, 0) {}
+  uint16_t size() { return cells_.size(); }
+  uint8_t read(uint16_t addr) { return cells_[addr]; }
+  bool ready() { return true; }
+  void write(uint16_t addr, uint8_t value) {
+    if (cells_[addr] != value) {
+      writes_++;
+      cellWrites_[addr]++;
+    }
+    cells_[addr] = value;
+  }
+
+  uint32_t writes() const { return writes_; }
+  // Erase/write cycles of one cell, and of the most worn one.
+  uint32_t writes(uint16_t addr) const { return cellWrites_[addr]; }
+  uint32_t maxCellWrites() const {
+    return *std::max_element(cellWrites_.begin(), cellWrites_.end());
+  }
+
+ private:
+  std::vector<uint8_t> cells_;
+  std::vector<uint32_t> cellWrites_;
+  uint32_t writes_ = 0;
+};
+
+// 16x2 character grid.
+class TextDisplay : public Display {
+ public:
+  TextDisplay() { clear(); }
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  void print(const char *text);
+
+  std::string row(uint8_t r) const { return rows_[r]; }
+  uint32_t writes() const { return writes_; }
+
+ private:
+  std::string rows_[2];
+  uint8_t col_ = 0, row_ = 0;
+  uint32_t writes_ = 0;
+};
+
+class FakeIndicator : public Indicator {
+ public:
+  void set(bool on) {
+    if (on && !on_) edges_++;
+    on_ = on;
+  }
+  bool on() const { return on_; }
+  uint32_t edges() const { return edges_; }
+
+ private:
+  bool on_ = false;
+  uint32_t edges_ = 0;
+};
+
+// How the simulated patient responds to each pill. Every `missEvery`-th
+// pill is never picked up and every `lateEvery`-th one after `lateMs`; the
+// rest after `pickupMs` plus up to `jitterMs`, drawn from `seed`. Zero turns
+// a rule off.
+//
+// The sensor signal is a waveform, not a flag: a pickup breaks the beam for
+// `handMs`, with `bounces` short gaps at the start, and `noisePulses` short
+// spurious pulses show up between the drop and the pickup.
+struct PatientScript {
+  uint32_t pickupMs;
+  uint32_t jitterMs;
+  uint32_t missEvery;
+  uint32_t lateEvery;
+  uint32_t lateMs;
+  uint32_t seed;
+  uint32_t handMs;
+  uint8_t bounces;
+  uint8_t noisePulses;
+};
+
+// The person at the tray. A pill lands when a compartment's servo closes;
+// the sensor edges it will cause are scripted right away and handed out as
+// virtual time reaches them.
+class Patient : public PresenceSensor {
+ public:
+  Patient(SimClock &clock, const PatientScript &script)
+      : clock_(clock), script_(script), rng_(script.seed | 1) {}
+
+  void pillDropped();
+  bool nextEdge(SensorEdge &edge);
+
+  // elapsedMs of the next scripted edge, or UINT64_MAX. The simulator never
+  // sleeps past it, as the board would be woken by the interrupt.
+  uint64_t nextEdgeMs() const;
+
+  uint32_t pillsDropped() const { return dropped_; }
+  uint32_t pillsTaken() const { return taken_; }
+  uint32_t edges() const { return edges_; }
+
+ private:
+  struct Edge {
+    uint64_t at;  // elapsedMs
+    bool active;
+    bool pickup;  // the edge that starts a real pickup
+  };
+
+  uint32_t random();
+  void add(uint64_t at, bool active, bool pickup = false);
+
+  SimClock &clock_;
+  PatientScript script_;
+  uint32_t rng_;
+  std::deque<Edge> pending_;  // in time order
+  uint64_t quietFrom_ = 0;    // after the last scripted edge
+  uint32_t dropped_ = 0;
+  uint32_t taken_ = 0;
+  uint32_t edges_ = 0;
+};
+
+class SimServo : public Actuator {
+ public:
+  explicit SimServo(Patient &patient) : patient_(patient) {}
+  void write(uint8_t angle);
+  void detach() {
+    if (attached_) detaches_++;
+    attached_ = false;
+  }
+
+  uint32_t moves() const { return moves_; }
+  uint32_t detaches() const { return detaches_; }
+  // Largest change between two commanded angles: 90 for a snap, a few
+  // degrees for a ramp.
+  uint8_t maxStep() const { return maxStep_; }
+
+ private:
+  Patient &patient_;
+  uint8_t angle_ = 0;
+  bool attached_ = false;
+  uint32_t moves_ = 0;
+  uint32_t detaches_ = 0;
+  uint8_t maxStep_ = 0;
+};
+
+// A UART: tests queue bytes towards the firmware with send() and see what it
+// wrote in output(). Output can also be echoed to stdout, or discarded
+// unseen when nobody will read it (fleet runs).
+class SimLink : public ByteStream {
+ public:
+  explicit SimLink(bool echo = false) : echo_(echo), discard_(false) {}
+
+  void setDiscard(bool discard) { discard_ = discard; }
+
+  int available() { return rx_.size(); }
+  int read();
+  size_t write(const uint8_t *buf, size_t len);
+  using ByteStream::write;
+  bool listening() { return !discard_; }
+
+  void send(const void *buf, size_t len);
+  void send(const char *s);
+  std::string &output() { return tx_; }
+
+ private:
+  bool echo_;
+  bool discard_;
+  std::deque<uint8_t> rx_;
+  std::string tx_;
+};
+
+// Answers the AT commands GsmModem sends: text mode, the body prompt and a
+// message reference for every Ctrl+Z-terminated body.
+class SimModem : public ByteStream {
+ public:
+  int available() { return rx_.size(); }
+  int read();
+  size_t write(const uint8_t *buf, size_t len);
+  using ByteStream::write;
+
+  uint32_t messages() const { return messages_; }
+  const std::vector<std::string> &bodies() const { return bodies_; }
+
+ private:
+  void reply(const char *s);
+
+  std::deque<uint8_t> rx_;
+  std::string line_;
+  bool inBody_ = false;
+  uint32_t messages_ = 0;
+  std::vector<std::string> bodies_;
+};
+
+#endif  // PILLOTTER_NATIVE_FAKES_H
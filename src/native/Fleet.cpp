@@ -0,0 +1,217 @@
+#include "Fleet.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+FleetConfig defaultFleetConfig() {
+  FleetConfig c;
+  c.devices = 1000;
+  c.days = 30;
+  c.threads = 0;
+  c.seed = 1;
+  c.minPickupMs = 5000;
+  c.maxPickupMs = 60000;
+  c.lateShare = 10;
+  c.lateEvery = 20;
+  c.lateMs = 45 * 60000UL;
+  c.missEvery = 0;
+  return c;
+}
+
+// splitmix32: spreads consecutive indices into unrelated seeds.
+static uint32_t mix(uint32_t x) {
+  x += 0x9E3779B9UL;
+  x = (x ^ (x >> 16)) * 0x85EBCA6BUL;
+  x = (x ^ (x >> 13)) * 0xC2B2AE35UL;
+  return x ^ (x >> 16);
+}
+
+SimConfig fleetDevice(const FleetConfig &config, uint32_t index) {
+  uint32_t r = mix(config.seed ^ mix(index));
+  SimConfig c = defaultSimConfig();
+  c.days = config.days;
+  c.patient.seed = r;
+  c.patient.pickupMs = config.minPickupMs;
+  if (config.maxPickupMs > config.minPickupMs) {
+    c.patient.pickupMs += mix(r) % (config.maxPickupMs - config.minPickupMs);
+  }
+  c.patient.jitterMs = c.patient.pickupMs / 4;
+  c.patient.missEvery = config.missEvery;
+  bool late = config.lateShare && mix(r + 1) % config.lateShare == 0;
+  c.patient.lateEvery = late ? config.lateEvery : 0;
+  c.patient.lateMs = config.lateMs;
+  return c;
+}
+
+// ! WORK-STEALING POOL
+// Every worker owns a deque of device indices, dealt round-robin up front. It
+// pops from the front of its own and, once that is empty, steals from the
+// back of the others. Device runs vary a lot in cost (while a late patient's
+// dose waits, the device wakes every second for the LCD countdown and the
+// escalation reminders), so static partitioning leaves threads idle at the
+// end.
+namespace {
+
+struct WorkQueue {
+  std::mutex lock;
+  std::deque<uint32_t> jobs;
+};
+
+struct WorkerResult {
+  SimTotals totals;
+  std::map<uint32_t, uint32_t> smsPerMinute;
+  std::vector<double> adherence;
+  uint32_t steals;
+};
+
+class FleetPool {
+ public:
+  FleetPool(const FleetConfig &config, unsigned threads)
+      : config_(config), queues_(threads), results_(threads) {
+    for (uint32_t i = 0; i < config.devices; i++) {
+      queues_[i % threads].jobs.push_back(i);
+    }
+  }
+
+  void run() {
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < queues_.size(); w++) {
+      workers.push_back(std::thread(&FleetPool::work, this, w));
+    }
+    for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+  }
+
+  const std::vector<WorkerResult> &results() const { return results_; }
+
+ private:
+  bool take(unsigned self, uint32_t &job) {
+    {
+      std::lock_guard<std::mutex> g(queues_[self].lock);
+      if (!queues_[self].jobs.empty()) {
+        job = queues_[self].jobs.front();
+        queues_[self].jobs.pop_front();
+        return true;
+      }
+    }
+    for (size_t k = 1; k < queues_.size(); k++) {
+      WorkQueue &victim = queues_[(self + k) % queues_.size()];
+      std::lock_guard<std::mutex> g(victim.lock);
+      if (!victim.jobs.empty()) {
+        job = victim.jobs.back();
+        victim.jobs.pop_back();
+        results_[self].steals++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(unsigned self) {
+    WorkerResult &r = results_[self];
+    memset(&r.totals, 0, sizeof(r.totals));
+    r.steals = 0;
+    uint32_t job;
+    while (take(self, job)) {
+      DeviceSim sim(fleetDevice(config_, job), NULL);
+      sim.run();
+      const SimTotals &t = sim.totals();
+      for (uint8_t e = 0; e < EVENT_KINDS; e++) {
+        r.totals.events[e] += t.events[e];
+      }
+      r.totals.sms += t.sms;
+      r.totals.sdBytes += t.sdBytes;
+      r.totals.sdWrites += t.sdWrites;
+      r.totals.eepromWrites += t.eepromWrites;
+      r.totals.servoMoves += t.servoMoves;
+      r.totals.servoDetaches += t.servoDetaches;
+      r.totals.servoMaxStep = std::max(r.totals.servoMaxStep, t.servoMaxStep);
+      r.totals.lcdBytes += t.lcdBytes;
+      r.totals.loops += t.loops;
+      const std::vector<uint32_t> &sms = sim.smsMinutes();
+      for (size_t i = 0; i < sms.size(); i++) r.smsPerMinute[sms[i]]++;
+      uint32_t dispensed = t.events[EVENT_DISPENSED];
+      r.adherence.push_back(dispensed ? (double)t.events[EVENT_TAKEN] /
+                                            dispensed
+                                      : 1.0);
+    }
+  }
+
+  const FleetConfig &config_;
+  std::vector<WorkQueue> queues_;
+  std::vector<WorkerResult> results_;
+};
+
+}  // namespace
+
+FleetReport runFleet(const FleetConfig &config) {
+  unsigned threads = config.threads;
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  FleetPool pool(config, threads);
+  pool.run();
+  std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - start;
+
+  FleetReport rep;
+  memset(&rep, 0, sizeof(rep));
+  rep.threads = threads;
+  rep.wallSec = wall.count();
+  rep.deviceDaysPerSec =
+      rep.wallSec > 0 ? (double)config.devices * config.days / rep.wallSec : 0;
+  rep.adherenceMin = 1.0;
+
+  // SMS times are relative to the start of the run; report them as minutes
+  // since midnight of the first day.
+  DateTime first = defaultSimConfig().start;
+  uint32_t startMinute = first.hour * 60 + first.minute;
+  std::map<uint32_t, uint32_t> perMinute;
+  double adherenceSum = 0;
+  for (size_t w = 0; w < pool.results().size(); w++) {
+    const WorkerResult &r = pool.results()[w];
+    for (uint8_t e = 0; e < EVENT_KINDS; e++) {
+      rep.totals.events[e] += r.totals.events[e];
+    }
+    rep.totals.sms += r.totals.sms;
+    rep.totals.sdBytes += r.totals.sdBytes;
+    rep.totals.sdWrites += r.totals.sdWrites;
+    rep.totals.eepromWrites += r.totals.eepromWrites;
+    rep.totals.servoMoves += r.totals.servoMoves;
+    rep.totals.servoDetaches += r.totals.servoDetaches;
+    rep.totals.servoMaxStep =
+        std::max(rep.totals.servoMaxStep, r.totals.servoMaxStep);
+    rep.totals.lcdBytes += r.totals.lcdBytes;
+    rep.totals.loops += r.totals.loops;
+    rep.steals += r.steals;
+    for (std::map<uint32_t, uint32_t>::const_iterator it =
+             r.smsPerMinute.begin();
+         it != r.smsPerMinute.end(); ++it) {
+      perMinute[it->first] += it->second;
+    }
+    for (size_t i = 0; i < r.adherence.size(); i++) {
+      rep.adherenceMin = std::min(rep.adherenceMin, r.adherence[i]);
+      rep.adherenceMax = std::max(rep.adherenceMax, r.adherence[i]);
+      adherenceSum += r.adherence[i];
+    }
+  }
+  if (config.devices) rep.adherenceMean = adherenceSum / config.devices;
+
+  for (std::map<uint32_t, uint32_t>::const_iterator it = perMinute.begin();
+       it != perMinute.end(); ++it) {
+    if (it->second > rep.smsPeak) {
+      rep.smsPeak = it->second;
+      rep.smsPeakMinute = it->first + startMinute;
+    }
+    rep.smsByHour[(it->first + startMinute) / 60 % 24] += it->second;
+  }
+  return rep;
+}
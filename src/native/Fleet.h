@@ -0,0 +1,54 @@
+#ifndef PILLOTTER_NATIVE_FLEET_H
+#define PILLOTTER_NATIVE_FLEET_H
+
+// Many independent DeviceSims at once, to see how the fleet behaves as a
+// whole: adherence spread, and how SMS traffic bunches up when every patient
+// is on the same schedule. Each device is one job on a work-stealing thread
+// pool; nothing is shared between devices except the aggregate at the end.
+#include <stdint.h>
+
+#include <vector>
+
+#include "Simulator.h"
+
+struct FleetConfig {
+  uint32_t devices;
+  uint32_t days;
+  unsigned threads;  // 0 = one per hardware thread
+  uint32_t seed;
+  // Patients are drawn at random around these: pickup within
+  // [minPickupMs, maxPickupMs], and one device in `lateShare` picks up
+  // `lateMs` late every `lateEvery` doses (0 = nobody is late).
+  uint32_t minPickupMs;
+  uint32_t maxPickupMs;
+  uint32_t lateShare;
+  uint32_t lateEvery;
+  uint32_t lateMs;
+  uint32_t missEvery;  // applied to every device; 0 = never
+};
+
+FleetConfig defaultFleetConfig();
+
+struct FleetReport {
+  SimTotals totals;  // summed over all devices
+  double wallSec;
+  double deviceDaysPerSec;
+  unsigned threads;
+  uint32_t steals;
+  // Per-device on-time adherence (TAKEN / DISPENSED; a LATE pickup counts
+  // against it) spread.
+  double adherenceMin, adherenceMean, adherenceMax;
+  // Busiest minute for SMS across the fleet.
+  uint32_t smsPeak;
+  uint32_t smsPeakMinute;  // minutes since 00:00 on the first day
+  // SMS per hour of the (simulated) day, summed over all days.
+  uint32_t smsByHour[24];
+};
+
+// Derives device `index`'s SimConfig; the same (config, index) always gives
+// the same device.
+SimConfig fleetDevice(const FleetConfig &config, uint32_t index);
+
+FleetReport runFleet(const FleetConfig &config);
+
+#endif  // PILLOTTER_NATIVE_FLEET_H
@@ -0,0 +1,205 @@
+#include "Simulator.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+static const char *kEventNames[EVENT_KINDS] = {"DISPENSED", "TAKEN",
+                                               "MISSED", "LATE"};
+
+SimConfig defaultSimConfig() {
+  SimConfig c;
+  DateTime start = {2025, 1, 1, 6, 0, 0};
+  c.start = start;
+  c.days = 30;
+  c.patient.pickupMs = 20000;
+  c.patient.jitterMs = 0;
+  c.patient.missEvery = 0;
+  c.patient.lateEvery = 0;
+  c.patient.lateMs = 45 * 60000UL;
+  c.patient.seed = 1;
+  c.patient.handMs = 400;
+  c.patient.bounces = 2;
+  c.patient.noisePulses = 0;
+  c.provision = true;
+  c.legacyProvisioning = false;
+  c.rtcPpm = 0;
+  c.resetEvery = 0;
+  c.resetAfterMs = 12000;  // after the first SMS
+  c.coldReset = false;
+  return c;
+}
+
+DeviceSim::DeviceSim(const SimConfig &config, FILE *trace)
+    : config_(config),
+      trace_(trace),
+      clock_(toEpoch(config.start)),
+      rtc_(clock_, config.rtcPpm),
+      wallClock_(rtc_, simMillis),
+      patient_(clock_, config.patient),
+      servo0_(patient_),
+      servo1_(patient_),
+      io_(DispenserIo{simMillis, wallClock_, lcd_, {&servo0_, &servo1_},
+                      buzzer_, led_, patient_, files_, eeprom_, console_,
+                      bluetooth_, gsm_, onRestart}),
+      dispenser_(io_),
+      endMs_((uint64_t)config.days * SECONDS_PER_DAY * 1000),
+      resetAtMs_(UINT64_MAX),
+      dispenses_(0),
+      started_(false) {
+  memset(&totals_, 0, sizeof(totals_));
+  memset(&checkpoint_, 0, sizeof(checkpoint_));
+  dispenser_.setDoseObserver(onDoseEvent, this);
+  dispenser_.setCheckpoint(&checkpoint_);
+  // Untraced runs (a fleet) never look at what the firmware printed.
+  console_.setDiscard(!trace);
+  bluetooth_.setDiscard(!trace);
+}
+
+// The device restart() asks for. Set by step() for the firmware's callbacks.
+static thread_local DeviceSim *running = NULL;
+
+// softReset(): the checkpoint is wiped and the watchdog resets the board, so
+// the next step() boots cold.
+void DeviceSim::onRestart() {
+  memset(&running->checkpoint_, 0, sizeof(running->checkpoint_));
+  running->reset();
+}
+
+void DeviceSim::onDoseEvent(void *ctx, uint8_t compartment, DoseEvent type,
+                            uint32_t at, uint32_t latency) {
+  DeviceSim &sim = *static_cast<DeviceSim *>(ctx);
+  sim.totals_.events[type]++;
+  if (type == EVENT_DISPENSED && sim.config_.resetEvery &&
+      ++sim.dispenses_ % sim.config_.resetEvery == 0) {
+    sim.resetAtMs_ = sim.clock_.elapsedMs() + sim.config_.resetAfterMs;
+  }
+  if (!sim.trace_) return;
+  char what[64];
+  snprintf(what, sizeof(what), "%s med%u latency=%lus", kEventNames[type],
+           compartment + 1, (unsigned long)latency);
+  sim.traceLine(at, what);
+}
+
+void DeviceSim::traceLine(uint32_t at, const char *what) {
+  DateTime dt = toDateTime(at);
+  fprintf(trace_, "%04u-%02u-%02u %02u:%02u:%02u %s\n", dt.year, dt.month,
+          dt.day, dt.hour, dt.minute, dt.second, what);
+}
+
+// Two medicines: three doses 8 hours apart from 07:00, and one at 21:00.
+void DeviceSim::sendSchedule() {
+  if (config_.legacyProvisioning) {
+    bluetooth_.send(
+        "NewInstance\n+639170000000\n"
+        "Losartan\n480\n3\n7\n0\n7\n0\n1\n0\n0\n"
+        "1\nMetformin\n0\n1\n21\n0\n21\n0\n0\n0\n");
+    return;
+  }
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 7;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 21;
+  t[1].active = true;
+
+  uint8_t payload[kFrameMaxPayload];
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  uint16_t len = encodeProvision(t, "+639170000000", payload);
+  bluetooth_.send(frame, encodeFrame(FRAME_SCHEDULE, payload, len, frame));
+}
+
+// Picks up what the fakes saw since the last pass.
+void DeviceSim::traceIo() {
+  char what[96];
+  if (gsm_.messages() != totals_.sms) {
+    for (uint32_t i = totals_.sms; i < gsm_.messages(); i++) {
+      smsMinutes_.push_back(clock_.elapsedMs() / 60000);
+      if (trace_) {
+        snprintf(what, sizeof(what), "SMS \"%s\"", gsm_.bodies()[i].c_str());
+        traceLine(clock_.now(), what);
+      }
+    }
+    totals_.sms = gsm_.messages();
+  }
+  if (files_.bytesWritten() != totals_.sdBytes) {
+    if (trace_) {
+      snprintf(what, sizeof(what), "SD +%lu bytes in %lu writes",
+               (unsigned long)(files_.bytesWritten() - totals_.sdBytes),
+               (unsigned long)(files_.writeOps() - totals_.sdWrites));
+      traceLine(clock_.now(), what);
+    }
+    totals_.sdBytes = files_.bytesWritten();
+    totals_.sdWrites = files_.writeOps();
+  }
+}
+
+// What a watchdog reset does to the board: outputs drop, the servos go limp
+// and the firmware starts over with SD, EEPROM and, unless the power went,
+// the .noinit checkpoint. Staged log records and queued EEPROM bytes are lost.
+void DeviceSim::reboot() {
+  resetAtMs_ = UINT64_MAX;
+  totals_.resets++;
+  if (trace_) {
+    traceLine(clock_.now(), config_.coldReset ? "POWER CUT" : "WATCHDOG RESET");
+  }
+  if (config_.coldReset) memset(&checkpoint_, 0, sizeof(checkpoint_));
+  buzzer_.set(false);
+  led_.set(false);
+  servo0_.detach();
+  servo1_.detach();
+  dispenser_.~Dispenser();
+  new (&dispenser_) Dispenser(io_);
+  dispenser_.setDoseObserver(onDoseEvent, this);
+  dispenser_.setCheckpoint(&checkpoint_);
+  dispenser_.begin();
+}
+
+bool DeviceSim::step() {
+  simClock = &clock_;
+  running = this;
+  if (!started_) {
+    started_ = true;
+    dispenser_.begin();
+    if (config_.provision) sendSchedule();
+  }
+  if (clock_.elapsedMs() >= endMs_) return false;
+  if (clock_.elapsedMs() >= resetAtMs_) reboot();
+
+  dispenser_.loop();
+  totals_.loops++;
+  traceIo();
+
+  // Bluetooth input is polled, so SETUP just ticks along.
+  uint32_t budget = dispenser_.state() == Dispenser::SETUP
+                        ? 1
+                        : dispenser_.idleBudget();
+  if (budget == 0) budget = 1;
+  uint64_t until = std::min(patient_.nextEdgeMs(), resetAtMs_);
+  if (until > endMs_) until = endMs_;
+  if (until > clock_.elapsedMs() && budget > until - clock_.elapsedMs()) {
+    budget = until - clock_.elapsedMs();
+  }
+  clock_.advance(budget);
+  return true;
+}
+
+void DeviceSim::run() {
+  while (step()) {
+  }
+  dispenser_.flushLogs();
+  traceIo();
+  totals_.eepromWrites = eeprom_.writes();
+  totals_.servoMoves = servo0_.moves() + servo1_.moves();
+  totals_.servoDetaches = servo0_.detaches() + servo1_.detaches();
+  totals_.servoMaxStep = std::max(servo0_.maxStep(), servo1_.maxStep());
+  totals_.lcdBytes = dispenser_.lcd().bytesSent();
+  totals_.rtcReads = rtc_.reads();
+  totals_.clockReads = wallClock_.served();
+  totals_.pillsDropped = patient_.pillsDropped();
+}
@@ -0,0 +1,116 @@
+#ifndef PILLOTTER_NATIVE_SIMULATOR_H
+#define PILLOTTER_NATIVE_SIMULATOR_H
+
+// Discrete-event simulation of one dispenser: the real Dispenser on the fakes
+// in Fakes.h. Virtual time jumps straight to the next scheduler deadline, so
+// a simulated year takes seconds, and a run is fully determined by its
+// SimConfig.
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "Calendar.h"
+#include "ClockService.h"
+#include "Dispenser.h"
+#include "Fakes.h"
+
+struct SimConfig {
+  DateTime start;
+  uint32_t days;
+  PatientScript patient;
+  bool provision;           // send the schedule over Bluetooth at first step
+  bool legacyProvisioning;  // line-per-field NewInstance instead of a frame
+  int32_t rtcPpm;           // RTC error against the millisecond clock
+  uint32_t resetEvery;      // reset the board after every Nth dispense...
+  uint32_t resetAfterMs;    // ...this long after it started
+  bool coldReset;           // a power cut: the .noinit checkpoint is lost too
+};
+
+SimConfig defaultSimConfig();
+
+struct SimTotals {
+  uint32_t events[EVENT_KINDS];
+  uint32_t sms;
+  uint32_t sdBytes;
+  uint32_t sdWrites;
+  uint32_t eepromWrites;
+  uint32_t servoMoves;     // commanded angle changes
+  uint32_t servoDetaches;  // pulse trains stopped after settling
+  uint32_t servoMaxStep;   // largest single angle change, degrees
+  uint32_t lcdBytes;  // commands + characters sent to the panel
+  uint32_t rtcReads;
+  uint32_t clockReads;  // served by the ClockService
+  uint32_t resets;
+  uint32_t pillsDropped;  // into the tray, as the patient saw it
+  uint64_t loops;
+};
+
+class DeviceSim {
+ public:
+  // `trace`, if given, gets one line per dose event, SMS and SD write.
+  DeviceSim(const SimConfig &config, FILE *trace);
+
+  // Runs the whole configured span.
+  void run();
+  // One loop() pass plus a jump to the next deadline. False once done.
+  bool step();
+  // A pass that hangs for `ms`: time moves on with loop() held off, as when
+  // the SD card or the I2C bus stalls. Sensor edges still queue up.
+  void stall(uint32_t ms) { clock_.advance(ms); }
+  // The reset button: the board restarts at the next step().
+  void reset() { resetAtMs_ = clock_.elapsedMs(); }
+
+  const SimTotals &totals() const { return totals_; }
+  // Minutes since the start of the run at which each SMS went out.
+  const std::vector<uint32_t> &smsMinutes() const { return smsMinutes_; }
+  Dispenser &dispenser() { return dispenser_; }
+  // The device's SD card and EEPROM, e.g. to lay down old files before the
+  // first step() boots it.
+  MemFileStore &files() { return files_; }
+  MemEeprom &eeprom() { return eeprom_; }
+  // The USB console and Bluetooth links, to type at the firmware.
+  SimLink &console() { return console_; }
+  SimLink &bluetooth() { return bluetooth_; }
+  // The alarm outputs, to time the escalation.
+  const FakeIndicator &buzzer() const { return buzzer_; }
+  const FakeIndicator &led() const { return led_; }
+  const ClockService &wallClock() const { return wallClock_; }
+  uint32_t elapsedSeconds() const { return clock_.elapsedMs() / 1000; }
+
+ private:
+  static void onDoseEvent(void *ctx, uint8_t compartment, DoseEvent type,
+                          uint32_t at, uint32_t latency);
+  static void onRestart();
+
+  void reboot();
+
+  void sendSchedule();
+  void traceIo();
+  void traceLine(uint32_t at, const char *what);
+
+  SimConfig config_;
+  FILE *trace_;
+  SimClock clock_;
+  SimRtc rtc_;
+  ClockService wallClock_;
+  MemFileStore files_;
+  MemEeprom eeprom_;
+  TextDisplay lcd_;
+  Patient patient_;
+  SimServo servo0_, servo1_;
+  FakeIndicator buzzer_, led_;
+  SimLink console_, bluetooth_;
+  SimModem gsm_;
+  DispenserIo io_;
+  RunCheckpoint checkpoint_;  // the board's .noinit RAM
+  Dispenser dispenser_;
+  uint64_t endMs_;
+  uint64_t resetAtMs_;
+  uint32_t dispenses_;
+  SimTotals totals_;
+  std::vector<uint32_t> smsMinutes_;
+  bool started_;
+};
+
+#endif  // PILLOTTER_NATIVE_SIMULATOR_H
@@ -0,0 +1,224 @@
+// Native (Linux) build of the dispenser: runs the real Dispenser code in the
+// simulator (Simulator.h) and prints a trace of dose events, SMS and SD
+// writes, then totals. With --fleet it runs that many devices in parallel
+// (Fleet.h) and prints a fleet report instead.
+//
+//   pio run -e native
+//   .pio/build/native/program --days 365 --miss-every 10 > year.trace
+//   .pio/build/native/program --fleet 10000 --days 30
+//   .pio/build/native/program --quiet --stats-json bench.json
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+
+#include "Fleet.h"
+#include "Printer.h"
+#include "Profile.h"
+#include "Simulator.h"
+
+// `pio test -e native` links this directory into every test program
+// (test_build_src), and each test brings its own main().
+#ifndef PIO_UNIT_TESTING
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--days N] [--pickup-s S] [--jitter-s S] "
+          "[--miss-every N]\n"
+          "          [--late-every N] [--late-s S] [--seed N] [--legacy] "
+          "[--quiet]\n"
+          "          [--rtc-ppm N] [--noise N] [--bounces N]\n"
+          "          [--reset-every N] [--reset-after-ms MS] [--cold-reset]\n"
+          "          [--stats-json PATH|-]\n"
+          "          [--fleet DEVICES] [--threads N]\n",
+          argv0);
+}
+
+#ifdef PILLOTTER_PROFILE
+// Real host time, so the profile shows what the firmware code costs here
+// rather than on the virtual clock.
+static uint32_t hostMicros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+// The `stats` counters as JSON, for benchmark dashboards.
+static bool writeStatsJson(const char *path) {
+  TextBuffer<1024> json;
+  Printer out(json);
+#ifdef PILLOTTER_PROFILE
+  Profiler::printJson(out);
+#else
+  fprintf(stderr, "--stats-json: build with -DPILLOTTER_PROFILE\n");
+  return false;
+#endif
+  FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  fputs(json.c_str(), f);
+  if (f != stdout) fclose(f);
+  return true;
+}
+
+static int runFleetReport(const FleetConfig &config) {
+  FleetReport r = runFleet(config);
+  const SimTotals &t = r.totals;
+  printf("fleet: %lu devices x %lu days on %u threads\n",
+         (unsigned long)config.devices, (unsigned long)config.days, r.threads);
+  printf("wall %.3f s, %.0f device-days/s, %llu loop passes, %lu steals\n",
+         r.wallSec, r.deviceDaysPerSec, (unsigned long long)t.loops,
+         (unsigned long)r.steals);
+  printf("dispensed=%lu taken=%lu late=%lu missed=%lu\n",
+         (unsigned long)t.events[EVENT_DISPENSED],
+         (unsigned long)t.events[EVENT_TAKEN],
+         (unsigned long)t.events[EVENT_LATE],
+         (unsigned long)t.events[EVENT_MISSED]);
+  printf("adherence min %.3f mean %.3f max %.3f\n", r.adherenceMin,
+         r.adherenceMean, r.adherenceMax);
+  printf("sms=%lu peak %lu in one minute (day %lu, %02lu:%02lu)\n",
+         (unsigned long)t.sms, (unsigned long)r.smsPeak,
+         (unsigned long)(r.smsPeakMinute / 1440 + 1),
+         (unsigned long)(r.smsPeakMinute % 1440 / 60),
+         (unsigned long)(r.smsPeakMinute % 60));
+  printf("sms by hour:");
+  for (uint8_t h = 0; h < 24; h++) {
+    if (r.smsByHour[h]) printf(" %02u:%lu", h, (unsigned long)r.smsByHour[h]);
+  }
+  printf("\nsdBytes=%lu eepromWrites=%lu\n", (unsigned long)t.sdBytes,
+         (unsigned long)t.eepromWrites);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  SimConfig config = defaultSimConfig();
+  FleetConfig fleet = defaultFleetConfig();
+  bool quiet = false;
+  bool fleetMode = false;
+  const char *statsJson = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    uint32_t value = hasValue ? strtoul(argv[i + 1], NULL, 10) : 0;
+    if (strcmp(arg, "--legacy") == 0) {
+      config.legacyProvisioning = true;
+    } else if (strcmp(arg, "--quiet") == 0) {
+      quiet = true;
+    } else if (strcmp(arg, "--cold-reset") == 0) {
+      config.coldReset = true;
+    } else if (!hasValue) {
+      usage(argv[0]);
+      return 2;
+    } else if (strcmp(arg, "--days") == 0) {
+      config.days = value;
+      i++;
+    } else if (strcmp(arg, "--pickup-s") == 0) {
+      config.patient.pickupMs = value * 1000;
+      i++;
+    } else if (strcmp(arg, "--jitter-s") == 0) {
+      config.patient.jitterMs = value * 1000;
+      i++;
+    } else if (strcmp(arg, "--miss-every") == 0) {
+      config.patient.missEvery = fleet.missEvery = value;
+      i++;
+    } else if (strcmp(arg, "--late-every") == 0) {
+      config.patient.lateEvery = fleet.lateEvery = value;
+      i++;
+    } else if (strcmp(arg, "--late-s") == 0) {
+      config.patient.lateMs = fleet.lateMs = value * 1000;
+      i++;
+    } else if (strcmp(arg, "--seed") == 0) {
+      config.patient.seed = fleet.seed = value;
+      i++;
+    } else if (strcmp(arg, "--noise") == 0) {
+      config.patient.noisePulses = value;
+      i++;
+    } else if (strcmp(arg, "--bounces") == 0) {
+      config.patient.bounces = value;
+      i++;
+    } else if (strcmp(arg, "--rtc-ppm") == 0) {
+      config.rtcPpm = strtol(argv[i + 1], NULL, 10);
+      i++;
+    } else if (strcmp(arg, "--reset-every") == 0) {
+      config.resetEvery = value;
+      i++;
+    } else if (strcmp(arg, "--reset-after-ms") == 0) {
+      config.resetAfterMs = value;
+      i++;
+    } else if (strcmp(arg, "--stats-json") == 0) {
+      statsJson = argv[i + 1];
+      i++;
+    } else if (strcmp(arg, "--fleet") == 0) {
+      fleet.devices = value;
+      fleetMode = true;
+      i++;
+    } else if (strcmp(arg, "--threads") == 0) {
+      fleet.threads = value;
+      i++;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (fleetMode) {
+    fleet.days = config.days;
+    return runFleetReport(fleet);
+  }
+
+#ifdef PILLOTTER_PROFILE
+  Profiler::setClock(hostMicros);
+#endif
+  DeviceSim sim(config, quiet ? NULL : stdout);
+  clock_t cpuStart = clock();
+  sim.run();
+  double cpuSec = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+
+  const SimTotals &t = sim.totals();
+  fprintf(stderr,
+          "simulated %lu days in %.3f s, %llu loop passes\n"
+          "dispensed=%lu taken=%lu late=%lu missed=%lu sms=%lu\n"
+          "sdBytes=%lu sdWrites=%lu eepromWrites=%lu servoMoves=%lu\n"
+          "lcdBytes=%lu (%.1f per minute)\n"
+          "clock reads=%lu rtc reads=%lu drift last=%ld worst=%lu "
+          "jumps=%u perDay=%.2fs\n"
+          "pickups=%lu rejected=%u bounces=%u latency mean=%lums "
+          "max=%lums\n"
+          "servo dispense mean=%lums max=%lums maxStep=%lu detaches=%lu\n"
+          "resets=%lu pillsDropped=%lu\n",
+          (unsigned long)config.days, cpuSec, (unsigned long long)t.loops,
+          (unsigned long)t.events[EVENT_DISPENSED],
+          (unsigned long)t.events[EVENT_TAKEN],
+          (unsigned long)t.events[EVENT_LATE],
+          (unsigned long)t.events[EVENT_MISSED], (unsigned long)t.sms,
+          (unsigned long)t.sdBytes, (unsigned long)t.sdWrites,
+          (unsigned long)t.eepromWrites, (unsigned long)t.servoMoves,
+          (unsigned long)t.lcdBytes,
+          config.days ? t.lcdBytes / (config.days * 1440.0) : 0.0,
+          (unsigned long)t.clockReads, (unsigned long)t.rtcReads,
+          (long)sim.wallClock().lastDrift(),
+          (unsigned long)sim.wallClock().worstDrift(),
+          sim.wallClock().jumps(),
+          sim.wallClock().driftSpanMs()
+              ? sim.wallClock().driftTotal() * 86400000.0 /
+                    sim.wallClock().driftSpanMs()
+              : 0.0,
+          (unsigned long)sim.dispenser().pickupLatency().total(),
+          sim.dispenser().pickupDetector().rejected(),
+          sim.dispenser().pickupDetector().bounces(),
+          (unsigned long)sim.dispenser().pickupLatency().mean(),
+          (unsigned long)sim.dispenser().pickupLatency().max(),
+          (unsigned long)sim.dispenser().motion().durations().mean(),
+          (unsigned long)sim.dispenser().motion().durations().max(),
+          (unsigned long)t.servoMaxStep, (unsigned long)t.servoDetaches,
+          (unsigned long)t.resets, (unsigned long)t.pillsDropped);
+  if (statsJson && !writeStatsJson(statsJson)) return 1;
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
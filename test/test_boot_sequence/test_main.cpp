@@ -0,0 +1,177 @@
+// Boot on fake peripherals with a fake microsecond clock: each phase costs
+// what the real part does, the schedule phase is the real Dispenser loading
+// its binary snapshot, and the whole boot must reach DISPENSE inside the
+// budget, SD retries included, with the breakdown printed on the console.
+#include <unity.h>
+
+#include <string>
+
+#include "BootSequence.h"
+#include "ScheduleStore.h"
+#include "native/Simulator.h"
+
+// Cold boot to DISPENSE with the card present.
+static const uint32_t kBootBudgetUs = 500000UL;
+// Each SD file operation: open, a sector or two over SPI.
+static const uint32_t kSdOpUs = 2000;
+// One pass of the boot loop around step(), watchdog kick included.
+static const uint32_t kStepUs = 20;
+
+static uint32_t fakeMicros;
+static uint32_t micros() { return fakeMicros; }
+
+static DeviceSim *sim;
+static uint8_t sdFailures;  // SD.begin() fails this many times first
+
+static bool bootSerial() {
+  fakeMicros += 150;
+  return true;
+}
+static bool bootLcd() {
+  fakeMicros += 52000;  // HD44780 power-on wait and 4-bit init over I2C
+  return true;
+}
+static bool bootRtc() {
+  fakeMicros += 600;
+  return true;
+}
+static bool bootSd() {
+  fakeMicros += 30000;
+  if (sdFailures) {
+    sdFailures--;
+    return false;
+  }
+  return true;
+}
+// The real Dispenser::begin(): snapshot load, checkpoint, first pass.
+static bool bootSchedule() {
+  uint32_t opens = sim->files().opens();
+  sim->step();
+  fakeMicros += (sim->files().opens() - opens) * kSdOpUs;
+  return sim->dispenser().state() == Dispenser::DISPENSE;
+}
+
+static const BootPhase kPhases[] = {
+    {"serial", bootSerial, 0}, {"lcd", bootLcd, 0},
+    {"rtc", bootRtc, 0},       {"sd", bootSd, 1000},
+    {"schedule", bootSchedule, 0},
+};
+static const uint8_t kPhaseCount = sizeof(kPhases) / sizeof(kPhases[0]);
+
+// A device with a schedule on the card, as every boot after the first.
+static DeviceSim *provisionedDevice() {
+  SimConfig config = defaultSimConfig();
+  config.provision = false;
+  DeviceSim *d = new DeviceSim(config, NULL);
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 7;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 21;
+  t[1].active = true;
+  TEST_ASSERT_TRUE(
+      ScheduleStore<kCompartments>(d->files()).save(t, "+639170000000"));
+  return d;
+}
+
+// setup(): step() until done, kicking the watchdog between attempts.
+static uint32_t runBoot(BootSequence &boot) {
+  uint32_t steps = 0;
+  while (!boot.step()) {
+    fakeMicros += kStepUs;
+    TEST_ASSERT_TRUE(++steps < 1000000);
+  }
+  return steps;
+}
+
+void setUp() {
+  fakeMicros = 0xFFFFFFFFUL - 100000;  // wraps mid-boot
+  sdFailures = 0;
+  sim = provisionedDevice();
+}
+
+void tearDown() {
+  delete sim;
+  sim = NULL;
+}
+
+static void test_cold_boot_within_budget() {
+  BootSequence boot(kPhases, kPhaseCount, micros);
+  runBoot(boot);
+  TEST_ASSERT_TRUE(boot.done());
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, sim->dispenser().state());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(kBootBudgetUs, boot.totalUs());
+
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < kPhaseCount; i++) {
+    TEST_ASSERT_EQUAL_UINT8(1, boot.attempts(i));
+    sum += boot.phaseUs(i);
+  }
+  // Nothing but the phases and a loop pass between each: no splash delays.
+  TEST_ASSERT_EQUAL_UINT32(sum + (kPhaseCount - 1) * kStepUs, boot.totalUs());
+  TEST_ASSERT_EQUAL_UINT32(52000, boot.phaseUs(1));
+  // The snapshot is a handful of file operations, not a text parse.
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(10 * kSdOpUs, boot.phaseUs(4));
+}
+
+// No card at first: each retry waits out SD_RETRY_MS without holding up the
+// loop, the wait counts towards the total but not towards the phase, and
+// the card's phase shows how many tries it took.
+static void test_sd_retries() {
+  sdFailures = 2;
+  BootSequence boot(kPhases, kPhaseCount, micros);
+  uint32_t steps = runBoot(boot);
+  TEST_ASSERT_EQUAL_UINT8(3, boot.attempts(3));
+  TEST_ASSERT_EQUAL_UINT32(3 * 30000, boot.phaseUs(3));
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2 * 1000000UL, boot.totalUs());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * 1000000UL + kBootBudgetUs,
+                                   boot.totalUs());
+  // Short passes in between: the watchdog is fed every kStepUs.
+  TEST_ASSERT_GREATER_THAN_UINT32(2 * 1000000UL / kStepUs / 2, steps);
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, sim->dispenser().state());
+}
+
+static void test_breakdown_on_the_console() {
+  sdFailures = 1;
+  BootSequence boot(kPhases, kPhaseCount, micros);
+  runBoot(boot);
+  SimLink console;
+  Printer out(console);
+  boot.print(out);
+  char want[96];
+  snprintf(want, sizeof(want),
+           "boot %lu ms: serial=0 lcd=52 rtc=0 sd=60 (2 tries) "
+           "schedule=%lu\r\n",
+           (unsigned long)(boot.totalUs() / 1000),
+           (unsigned long)(boot.phaseUs(4) / 1000));
+  TEST_ASSERT_EQUAL_STRING(want, console.output().c_str());
+}
+
+// A phase that is not done yet stops the sequence there; nothing after it
+// runs early.
+static void test_phases_run_in_order() {
+  sdFailures = 200;
+  BootSequence boot(kPhases, kPhaseCount, micros);
+  for (int i = 0; i < 100; i++) {
+    boot.step();
+    fakeMicros += 100000;
+  }
+  TEST_ASSERT_FALSE(boot.done());
+  TEST_ASSERT_EQUAL_UINT8(0, boot.attempts(4));
+  TEST_ASSERT_GREATER_THAN_UINT32(1, boot.attempts(3));
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(11, boot.attempts(3));
+  TEST_ASSERT_EQUAL_INT(Dispenser::SETUP, sim->dispenser().state());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cold_boot_within_budget);
+  RUN_TEST(test_sd_retries);
+  RUN_TEST(test_breakdown_on_the_console);
+  RUN_TEST(test_phases_run_in_order);
+  return UNITY_END();
+}
@@ -0,0 +1,177 @@
+// Epoch time: the table-driven calendar against the host's gmtime() for every
+// minute of a leap year and every day of the century, and the dispenser's
+// scheduling across midnight, the leap day and multi-day intervals.
+#include <unity.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "Calendar.h"
+#include "ScheduleStore.h"
+#include "native/Simulator.h"
+
+// 2000-01-01 00:00 UTC in Unix time.
+static const time_t kEpoch2000 = 946684800;
+
+static void checkAgainstHost(uint32_t t) {
+  time_t host = kEpoch2000 + (time_t)t;
+  struct tm want;
+  gmtime_r(&host, &want);
+  DateTime dt = toDateTime(t);
+  TEST_ASSERT_EQUAL_UINT16(want.tm_year + 1900, dt.year);
+  TEST_ASSERT_EQUAL_UINT8(want.tm_mon + 1, dt.month);
+  TEST_ASSERT_EQUAL_UINT8(want.tm_mday, dt.day);
+  TEST_ASSERT_EQUAL_UINT8(want.tm_hour, dt.hour);
+  TEST_ASSERT_EQUAL_UINT8(want.tm_min, dt.minute);
+  TEST_ASSERT_EQUAL_UINT8(want.tm_sec, dt.second);
+  TEST_ASSERT_EQUAL_UINT32(t, toEpoch(dt));
+}
+
+void setUp() {}
+void tearDown() {}
+
+// All 527,040 minutes of 2024, plus the last second of each and the
+// boundaries either side of the year.
+static void test_every_minute_of_a_leap_year() {
+  DateTime first = {2024, 1, 1, 0, 0, 0};
+  DateTime next = {2025, 1, 1, 0, 0, 0};
+  uint32_t from = toEpoch(first), to = toEpoch(next);
+  TEST_ASSERT_EQUAL_UINT32(366 * SECONDS_PER_DAY, to - from);
+  uint32_t minutes = 0;
+  for (uint32_t t = from; t < to; t += 60) {
+    checkAgainstHost(t);
+    checkAgainstHost(t + 59);
+    minutes++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(366UL * MINUTES_PER_DAY, minutes);
+  checkAgainstHost(from - 1);
+  checkAgainstHost(to);
+
+  DateTime leap = {2024, 2, 29, 23, 59, 59};
+  DateTime march = toDateTime(toEpoch(leap) + 1);
+  TEST_ASSERT_EQUAL_UINT8(3, march.month);
+  TEST_ASSERT_EQUAL_UINT8(1, march.day);
+}
+
+// Both ends of every day, 2000 through 2099.
+static void test_every_day_of_the_century() {
+  DateTime last = {2099, 12, 31, 23, 59, 59};
+  uint32_t end = toEpoch(last);
+  for (uint32_t day = 0; day * SECONDS_PER_DAY < end; day++) {
+    checkAgainstHost(day * SECONDS_PER_DAY);
+    checkAgainstHost(day * SECONDS_PER_DAY + SECONDS_PER_DAY - 1);
+  }
+  checkAgainstHost(end);
+}
+
+static void test_time_of_day_helpers() {
+  DateTime dt = {2024, 2, 29, 0, 30, 0};
+  uint32_t t = toEpoch(dt);
+  DateTime midnight = toDateTime(dayStart(t));
+  TEST_ASSERT_EQUAL_UINT8(29, midnight.day);
+  TEST_ASSERT_EQUAL_UINT8(0, midnight.hour);
+  TEST_ASSERT_EQUAL_UINT32(t - 1800 + 22 * 3600UL, atTimeOfDay(t, 22, 0));
+  // 22:00 has not come yet today: the last one was yesterday, the 28th.
+  DateTime last = toDateTime(lastOccurrence(t, 22, 0));
+  TEST_ASSERT_EQUAL_UINT8(28, last.day);
+  TEST_ASSERT_EQUAL_UINT8(22, last.hour);
+  TEST_ASSERT_EQUAL_UINT32(t, lastOccurrence(t, 0, 30));
+}
+
+// Runs `days` from `start` with `table` already on the card and returns
+// "MM-DD HH:MM medN" for every dispense.
+static std::vector<std::string> dispenses(
+    const DateTime &start, uint32_t days,
+    const ScheduleTable<kCompartments> &t) {
+  SimConfig config = defaultSimConfig();
+  config.start = start;
+  config.days = days;
+  config.provision = false;
+  FILE *f = tmpfile();
+  TEST_ASSERT_NOT_NULL(f);
+  {
+    DeviceSim sim(config, f);
+    TEST_ASSERT_TRUE(
+        ScheduleStore<kCompartments>(sim.files()).save(t, "+639170000000"));
+    sim.run();
+  }
+  rewind(f);
+  std::vector<std::string> out;
+  char line[160];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned y, mo, d, h, mi, s, med;
+    if (sscanf(line, "%u-%u-%u %u:%u:%u DISPENSED med%u", &y, &mo, &d, &h,
+               &mi, &s, &med) == 7) {
+      char what[32];
+      snprintf(what, sizeof(what), "%02u-%02u %02u:%02u med%u", mo, d, h, mi,
+               med);
+      out.push_back(what);
+    }
+  }
+  fclose(f);
+  return out;
+}
+
+// A course that runs past midnight (22:00, 01:00, 04:00) across the leap
+// day, and a dose every other day at 08:30. Every dose lands on its date.
+static void test_schedule_across_midnight_and_leap_day() {
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Night");
+  t[0].interval = 180;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 22;
+  t[0].active = true;
+  t.setName(1, "Alternate");
+  t[1].interval = 2 * MINUTES_PER_DAY;
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 8;
+  t[1].baseMinute = t[1].nextMinute = 30;
+  t[1].active = true;
+
+  DateTime start = {2024, 2, 27, 6, 0, 0};
+  std::vector<std::string> got = dispenses(start, 5, t);
+  const char *want[] = {
+      "02-27 08:30 med2", "02-27 22:00 med1", "02-28 01:00 med1",
+      "02-28 04:00 med1", "02-28 22:00 med1", "02-29 01:00 med1",
+      "02-29 04:00 med1", "02-29 08:30 med2", "02-29 22:00 med1",
+      "03-01 01:00 med1", "03-01 04:00 med1", "03-01 22:00 med1",
+      "03-02 01:00 med1", "03-02 04:00 med1", "03-02 08:30 med2",
+      "03-02 22:00 med1", "03-03 01:00 med1", "03-03 04:00 med1",
+  };
+  TEST_ASSERT_EQUAL_UINT32(sizeof(want) / sizeof(want[0]), got.size());
+  for (size_t i = 0; i < got.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING(want[i], got[i].c_str());
+  }
+}
+
+// A weekly dose across New Year: same time of day, exactly seven days on.
+static void test_weekly_dose_across_the_year_end() {
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Weekly");
+  t[0].interval = 7 * MINUTES_PER_DAY;
+  t[0].iterations = 1;
+  t[0].baseHour = t[0].nextHour = 9;
+  t[0].baseMinute = t[0].nextMinute = 15;
+  t[0].active = true;
+
+  DateTime start = {2024, 12, 20, 10, 0, 0};
+  std::vector<std::string> got = dispenses(start, 28, t);
+  TEST_ASSERT_EQUAL_UINT32(4, got.size());
+  TEST_ASSERT_EQUAL_STRING("12-21 09:15 med1", got[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("12-28 09:15 med1", got[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("01-04 09:15 med1", got[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("01-11 09:15 med1", got[3].c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_minute_of_a_leap_year);
+  RUN_TEST(test_every_day_of_the_century);
+  RUN_TEST(test_time_of_day_helpers);
+  RUN_TEST(test_schedule_across_midnight_and_leap_day);
+  RUN_TEST(test_weekly_dose_across_the_year_end);
+  return UNITY_END();
+}
@@ -0,0 +1,194 @@
+// ClockService against a fake DS1302: between the once-a-minute reads it
+// counts forward from millis() to the second, measures an RTC running fast
+// or slow, takes a set clock as a jump, holds through small corrections, and
+// accounts for time spent asleep.
+#include <unity.h>
+
+#include "Calendar.h"
+#include "ClockService.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+
+// The RTC, plus whatever the test sets it forward or back by.
+class SettableRtc : public Clock {
+ public:
+  explicit SettableRtc(int32_t ppm) : rtc_(clock, ppm), offset_(0) {}
+  uint32_t now() { return rtc_.now() + offset_; }
+  void set(int32_t offset) { offset_ = offset; }
+  uint32_t reads() const { return rtc_.reads(); }
+
+ private:
+  SimRtc rtc_;
+  int32_t offset_;
+};
+
+void setUp() {
+  DateTime start = {2025, 3, 30, 23, 59, 0};
+  clock = SimClock(toEpoch(start));
+  simClock = &clock;
+}
+
+void tearDown() {}
+
+// Asked ten times a second for ten minutes: exact to the second, one RTC
+// read a minute, and the broken-down fields agree.
+static void test_interpolates_between_reads() {
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  for (uint32_t i = 0; i < 6000; i++) {
+    TEST_ASSERT_EQUAL_UINT32(clock.now(), service.now());
+    if (i % 7 == 0) {
+      DateTime want = toDateTime(clock.now());
+      const DateTime &got = service.dateTime();
+      TEST_ASSERT_EQUAL_INT(0, memcmp(&want, &got, sizeof(want)));
+    }
+    clock.advance(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(10, service.reads());
+  TEST_ASSERT_EQUAL_UINT32(10, rtc.reads());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(6000, service.served());
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_EQUAL_UINT32(0, service.worstDrift());
+}
+
+// A crystal 200 ppm off runs 17.28 s a day away from millis(). Served time
+// stays within a second of the RTC, never goes backwards, and the measured
+// drift over the day comes out at 17 or 18 s in the right direction.
+static void checkDrift(int32_t ppm) {
+  SettableRtc rtc(ppm);
+  ClockService service(rtc, simMillis);
+  uint32_t last = 0;
+  for (uint32_t s = 0; s < 86400; s++) {
+    uint32_t t = service.now();
+    TEST_ASSERT_TRUE(t >= last);
+    int32_t error = (int32_t)(t - rtc.now());
+    TEST_ASSERT_TRUE(error >= -1 && error <= 1);
+    last = t;
+    clock.advance(1000);
+  }
+  int32_t perDay =
+      (int64_t)service.driftTotal() * 86400000 / service.driftSpanMs();
+  // Whole-second readings: the last one may be a second short.
+  int32_t size = perDay < 0 ? -perDay : perDay;
+  TEST_ASSERT_TRUE(size == 17 || size == 18);
+  TEST_ASSERT_TRUE((perDay > 0) == (ppm > 0));
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, service.worstDrift());
+  TEST_ASSERT_EQUAL_UINT32(1440, service.reads());
+}
+
+static void test_measures_fast_rtc() { checkDrift(200); }
+static void test_measures_slow_rtc() { checkDrift(-200); }
+
+// The RTC set three seconds back: served time holds rather than repeating
+// seconds, and it is drift, not a jump.
+static void test_small_step_back_is_held() {
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  service.now();
+  clock.advance(59000);
+  uint32_t before = service.now();
+  rtc.set(-3);
+  clock.advance(1000);  // the minute's read
+  for (uint32_t i = 0; i < 30; i++) {
+    TEST_ASSERT_EQUAL_UINT32(before, service.now());
+    clock.advance(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(before + 1, service.now());
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_EQUAL_INT32(-3, service.lastDrift());
+  TEST_ASSERT_EQUAL_UINT32(3, service.worstDrift());
+}
+
+// Setting the RTC an hour either way is taken at the next read, counted as
+// a jump, and restarts the drift measurement.
+static void test_set_clock_is_a_jump() {
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  service.now();
+  clock.advance(600000);
+  service.now();
+  TEST_ASSERT_EQUAL_UINT32(600000, service.driftSpanMs());
+
+  rtc.set(3600);
+  clock.advance(30000);
+  TEST_ASSERT_EQUAL_UINT32(clock.now(), service.now());  // not read yet
+  clock.advance(30000);
+  TEST_ASSERT_EQUAL_UINT32(clock.now() + 3600, service.now());
+  TEST_ASSERT_EQUAL_UINT16(1, service.jumps());
+  TEST_ASSERT_EQUAL_UINT32(0, service.driftSpanMs());
+
+  rtc.set(-3600);
+  clock.advance(60000);
+  TEST_ASSERT_EQUAL_UINT32(clock.now() - 3600, service.now());
+  TEST_ASSERT_EQUAL_UINT16(2, service.jumps());
+  TEST_ASSERT_EQUAL_UINT32(0, service.worstDrift());
+}
+
+// A sleep that stops millis() and ends early: one RTC read says how long,
+// capped at the planned length, and time carries on from the reading.
+static void test_measure_sleep() {
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  service.now();
+  clock.advance(20000);
+  TEST_ASSERT_EQUAL_UINT32(clock.now(), service.now());
+  uint32_t reads = service.reads();
+
+  rtc.set(6);  // six seconds asleep, millis() stopped
+  TEST_ASSERT_EQUAL_UINT32(6000, service.measureSleep(8000));
+  TEST_ASSERT_EQUAL_UINT32(reads + 1, service.reads());
+  clock.advance(6000);  // the caller credits millis()
+  rtc.set(0);
+  TEST_ASSERT_EQUAL_UINT32(clock.now(), service.now());
+  TEST_ASSERT_EQUAL_UINT32(reads + 1, service.reads());
+
+  rtc.set(30);
+  TEST_ASSERT_EQUAL_UINT32(8000, service.measureSleep(8000));
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_EQUAL_UINT32(0, service.worstDrift());
+}
+
+// resync() after a sleep millis() could only estimate: the next now()
+// reads the RTC and takes it as is, whatever the error.
+static void test_resync_is_quiet() {
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  service.now();
+  clock.advance(10000);
+  rtc.set(45);
+  service.resync();
+  TEST_ASSERT_EQUAL_UINT32(clock.now() + 45, service.now());
+  TEST_ASSERT_EQUAL_UINT32(2, service.reads());
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_EQUAL_INT32(0, service.lastDrift());
+  TEST_ASSERT_EQUAL_UINT32(0, service.driftSpanMs());
+}
+
+// millis() wraps after 49.7 days; served time carries straight through.
+static void test_millis_wrap() {
+  clock.advance(0xFFFFFFFFUL - 90295);  // on a whole second
+  SettableRtc rtc(0);
+  ClockService service(rtc, simMillis);
+  for (uint32_t i = 0; i < 3000; i++) {
+    TEST_ASSERT_EQUAL_UINT32(clock.now(), service.now());
+    clock.advance(100);
+  }
+  TEST_ASSERT_TRUE(clock.millis() < 300000);
+  TEST_ASSERT_EQUAL_UINT16(0, service.jumps());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, service.worstDrift());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_interpolates_between_reads);
+  RUN_TEST(test_measures_fast_rtc);
+  RUN_TEST(test_measures_slow_rtc);
+  RUN_TEST(test_small_step_back_is_held);
+  RUN_TEST(test_set_clock_is_a_jump);
+  RUN_TEST(test_measure_sleep);
+  RUN_TEST(test_resync_is_quiet);
+  RUN_TEST(test_millis_wrap);
+  return UNITY_END();
+}
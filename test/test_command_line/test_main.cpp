@@ -0,0 +1,148 @@
+// Serial command input: lines assembled from arbitrarily fragmented bytes,
+// the sorted command table lookup, and a flood of console input that loop()
+// must work through a bounded number of bytes at a time.
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "Commands.h"
+#include "LineReader.h"
+#include "native/Simulator.h"
+
+static std::vector<std::string> feed(LineReader<32> &reader, const char *s,
+                                     size_t len) {
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < len; i++) {
+    if (reader.push(s[i])) {
+      StrView v = reader.line();
+      lines.push_back(std::string(v.data(), v.size()));
+    }
+  }
+  return lines;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// However the bytes are split up across reads, the same lines come out.
+static void test_every_split_gives_the_same_lines() {
+  const char input[] = "med1\r\nclear\n  log  \n\nstats\n";
+  size_t len = sizeof(input) - 1;
+  for (size_t a = 0; a <= len; a++) {
+    for (size_t b = a; b <= len; b++) {
+      LineReader<32> reader;
+      std::vector<std::string> lines = feed(reader, input, a);
+      std::vector<std::string> more = feed(reader, input + a, b - a);
+      lines.insert(lines.end(), more.begin(), more.end());
+      more = feed(reader, input + b, len - b);
+      lines.insert(lines.end(), more.begin(), more.end());
+      TEST_ASSERT_EQUAL_UINT32(5, lines.size());
+      TEST_ASSERT_EQUAL_STRING("med1", lines[0].c_str());
+      TEST_ASSERT_EQUAL_STRING("clear", lines[1].c_str());
+      TEST_ASSERT_EQUAL_STRING("log", lines[2].c_str());
+      TEST_ASSERT_EQUAL_STRING("", lines[3].c_str());
+      TEST_ASSERT_EQUAL_STRING("stats", lines[4].c_str());
+      TEST_ASSERT_TRUE(reader.empty());
+    }
+  }
+}
+
+// An overlong line is dropped whole; the next one is read normally.
+static void test_overlong_line_is_dropped() {
+  LineReader<8> reader;
+  const char *input = "abcdefghijklmnop\nmed2\n";
+  std::vector<std::string> lines;
+  for (const char *p = input; *p; p++) {
+    if (reader.push(*p)) {
+      StrView v = reader.line();
+      lines.push_back(std::string(v.data(), v.size()));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, lines.size());
+  TEST_ASSERT_EQUAL_STRING("med2", lines[0].c_str());
+  TEST_ASSERT_EQUAL_UINT16(1, reader.overflows());
+}
+
+static std::string lastArgs;
+static uint32_t calls;
+static void record(void *ctx, StrView args) {
+  lastArgs.assign(args.data(), args.size());
+  calls += *static_cast<int *>(ctx);
+}
+
+static const Command kTable[] = {
+    {"NewInstance", record}, {"check", record}, {"clear", record},
+    {"log", record},         {"med", record},   {"stats", record},
+};
+
+static void test_lookup_and_arguments() {
+  for (size_t i = 1; i < sizeof(kTable) / sizeof(kTable[0]); i++) {
+    TEST_ASSERT_TRUE(strcmp(kTable[i - 1].name, kTable[i].name) < 0);
+  }
+  for (size_t i = 0; i < sizeof(kTable) / sizeof(kTable[0]); i++) {
+    TEST_ASSERT_EQUAL_PTR(&kTable[i],
+                          findCommand(kTable, 6, StrView(kTable[i].name)));
+  }
+  TEST_ASSERT_NULL(findCommand(kTable, 6, StrView("me")));
+  TEST_ASSERT_NULL(findCommand(kTable, 6, StrView("meds")));
+  TEST_ASSERT_NULL(findCommand(kTable, 6, StrView("")));
+  TEST_ASSERT_NULL(findCommand(kTable, 6, StrView("zzz")));
+
+  int one = 1;
+  calls = 0;
+  TEST_ASSERT_TRUE(dispatchCommand(kTable, 6, StrView("med2"), &one));
+  TEST_ASSERT_EQUAL_STRING("2", lastArgs.c_str());
+  TEST_ASSERT_TRUE(dispatchCommand(kTable, 6, StrView("log 3  4"), &one));
+  TEST_ASSERT_EQUAL_STRING("3  4", lastArgs.c_str());
+  TEST_ASSERT_FALSE(dispatchCommand(kTable, 6, StrView("reboot"), &one));
+  TEST_ASSERT_EQUAL_UINT32(2, calls);
+}
+
+static uint32_t pings;
+static void ping(void *, StrView args) {
+  if (args == "7") pings++;
+}
+static const Command kPing[] = {{"ping", ping}};
+
+// 200 commands typed at the console, arriving in ragged pieces between
+// passes. Each loop() takes at most SERIAL_POLL_BYTES of them, so no pass
+// is held up by how much input is waiting, and every command still runs.
+static void test_console_flood_is_bounded_per_pass() {
+  SimConfig config = defaultSimConfig();
+  DeviceSim sim(config, NULL);
+  while (sim.dispenser().state() != Dispenser::DISPENSE) sim.step();
+  sim.dispenser().setExtraCommands(kPing, 1, NULL);
+  pings = 0;
+
+  std::string input;
+  for (int i = 0; i < 200; i++) input += i % 3 ? "ping 7\n" : "ping 7\r\n";
+  SimLink &console = sim.console();
+  size_t sent = 0, chunk = 1, most = 0;
+  uint32_t passes = 0;
+  while (sent < input.size() || console.available()) {
+    if (sent < input.size()) {
+      chunk = chunk * 7 % 61 + 1;  // 2 to 61 bytes
+      size_t n = std::min(chunk, input.size() - sent);
+      console.send(input.data() + sent, n);
+      sent += n;
+    }
+    size_t before = console.available();
+    sim.dispenser().loop();
+    size_t taken = before - console.available();
+    if (taken > most) most = taken;
+    passes++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(200, pings);
+  TEST_ASSERT_EQUAL_UINT32(32, most);  // SERIAL_POLL_BYTES
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(input.size() / 32, passes);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_split_gives_the_same_lines);
+  RUN_TEST(test_overlong_line_is_dropped);
+  RUN_TEST(test_lookup_and_arguments);
+  RUN_TEST(test_console_flood_is_bounded_per_pass);
+  return UNITY_END();
+}
@@ -0,0 +1,96 @@
+// DoseTimeline on its own, then a simulated week in which loop() stalls right
+// across every dose's due minute.
+#include <unity.h>
+
+#include "Calendar.h"
+#include "DoseTimeline.h"
+#include "native/Simulator.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_head_is_the_earliest_due() {
+  DoseTimeline<4> t;
+  TEST_ASSERT_EQUAL_UINT8(DoseTimeline<4>::kNone, t.head());
+  TEST_ASSERT_EQUAL_UINT32(DoseTimeline<4>::kNever, t.secondsUntilNext(0));
+  t.set(0, 500);
+  t.set(1, 200);
+  t.set(2, 900);
+  t.set(3, 300);
+  TEST_ASSERT_EQUAL_UINT8(1, t.head());
+  TEST_ASSERT_EQUAL_UINT32(150, t.secondsUntilNext(50));
+
+  t.set(2, 100);  // moved to the front
+  TEST_ASSERT_EQUAL_UINT8(2, t.head());
+  t.remove(2);
+  TEST_ASSERT_FALSE(t.contains(2));
+  TEST_ASSERT_EQUAL_UINT8(1, t.head());
+  TEST_ASSERT_EQUAL_UINT8(3, t.size());
+}
+
+// Due is due from that second on, however late the check comes.
+static void test_pop_due_catches_overdue_doses() {
+  DoseTimeline<4> t;
+  t.set(0, 1000);
+  t.set(1, 1060);
+  t.set(2, 5000);
+  TEST_ASSERT_EQUAL_UINT8(DoseTimeline<4>::kNone, t.popDue(999));
+  TEST_ASSERT_EQUAL_UINT32(1, t.secondsUntilNext(999));
+
+  // A check 10 minutes late still finds both overdue doses, in order.
+  TEST_ASSERT_EQUAL_UINT8(0, t.popDue(1600));
+  TEST_ASSERT_EQUAL_UINT8(1, t.popDue(1600));
+  TEST_ASSERT_EQUAL_UINT8(DoseTimeline<4>::kNone, t.popDue(1600));
+  TEST_ASSERT_EQUAL_UINT32(0, t.secondsUntilNext(6000));
+  TEST_ASSERT_EQUAL_UINT8(2, t.popDue(6000));
+  TEST_ASSERT_TRUE(t.empty());
+}
+
+static void test_out_of_range_compartments_are_ignored() {
+  DoseTimeline<2> t;
+  t.set(5, 10);
+  t.remove(5);
+  TEST_ASSERT_TRUE(t.empty());
+  TEST_ASSERT_EQUAL_UINT32(DoseTimeline<2>::kNever, t.due(5));
+}
+
+// Every due dose finds the firmware hung: from up to a minute before it is
+// due until a minute after, and once a day for ten minutes. Matching the
+// current minute, as the old check did, would miss every one of them.
+static void test_week_with_stalls_misses_no_dose() {
+  SimConfig config = defaultSimConfig();
+  config.days = 7;
+  DeviceSim sim(config, NULL);
+  uint32_t start = toEpoch(config.start);
+  uint32_t stalls = 0;
+  uint32_t stalledFor = 0;  // due time the last stall was aimed at
+  while (sim.step()) {
+    uint32_t now = start + sim.elapsedSeconds();
+    const ScheduleTable<kCompartments> &meds = sim.dispenser().schedule();
+    uint32_t due = 0xFFFFFFFFUL;
+    for (uint8_t i = 0; i < kCompartments; i++) {
+      if (meds[i].active && meds[i].nextDue > now && meds[i].nextDue < due) {
+        due = meds[i].nextDue;
+      }
+    }
+    if (due - now <= 60 && due != stalledFor) {
+      stalledFor = due;
+      sim.stall(stalls % 4 == 3 ? 10 * 60000UL : (due - now + 60) * 1000UL);
+      stalls++;
+    }
+  }
+  const SimTotals &t = sim.totals();
+  TEST_ASSERT_EQUAL_UINT32(7 * 4, stalls);
+  TEST_ASSERT_EQUAL_UINT32(7 * 4, t.events[EVENT_DISPENSED]);
+  TEST_ASSERT_EQUAL_UINT32(7 * 4, t.events[EVENT_TAKEN]);
+  TEST_ASSERT_EQUAL_UINT32(0, t.events[EVENT_MISSED]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_head_is_the_earliest_due);
+  RUN_TEST(test_pop_due_catches_overdue_doses);
+  RUN_TEST(test_out_of_range_compartments_are_ignored);
+  RUN_TEST(test_week_with_stalls_misses_no_dose);
+  return UNITY_END();
+}
@@ -0,0 +1,180 @@
+// Missed-dose escalation on the simulated device: for back-to-back doses the
+// beeps and LED come on as each pill drops, the SMS goes out 10 s later and
+// again at 15 min, and at an hour the dose is logged missed and the
+// compartment moves on, each dose on its own clock.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "ScheduleStore.h"
+#include "native/Simulator.h"
+
+static const char *kAlert = "Ayaw uminom ni patient maamsir";
+static const char *kTaken = "Nakainom na si patient mo beh!";
+
+// What happened, in seconds since the run started.
+struct Moment {
+  uint32_t at;
+  std::string what;
+};
+
+struct Run {
+  std::vector<Moment> trace;  // DISPENSED / TAKEN / MISSED / SMS lines
+  std::vector<Moment> led;    // "on" / "off"
+  uint32_t buzzerEdges;
+  uint32_t silentSeconds;  // LED on but the buzzer off
+  bool buzzerAtEnd;
+  uint32_t sms;
+};
+
+static uint32_t sinceStart(const DateTime &start, const char *line) {
+  unsigned y, mo, d, h, mi, s;
+  if (sscanf(line, "%u-%u-%u %u:%u:%u", &y, &mo, &d, &h, &mi, &s) != 6) {
+    return 0;
+  }
+  DateTime dt = {(uint16_t)y, (uint8_t)mo, (uint8_t)d,
+                 (uint8_t)h,  (uint8_t)mi, (uint8_t)s};
+  return toEpoch(dt) - toEpoch(start);
+}
+
+// Med1 three doses from 07:00, 90 minutes apart; med2 once at 07:05. Runs
+// from 06:00 for `hours` with the patient taking every `missEvery`-th pill
+// never (1: none are taken).
+static Run simulate(uint32_t hours, uint32_t missEvery) {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  config.provision = false;
+  config.patient.missEvery = missEvery;
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Losartan");
+  t[0].interval = 90;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 7;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 7;
+  t[1].baseMinute = t[1].nextMinute = 5;
+  t[1].active = true;
+
+  FILE *f = tmpfile();
+  TEST_ASSERT_NOT_NULL(f);
+  Run run;
+  {
+    DeviceSim sim(config, f);
+    TEST_ASSERT_TRUE(
+        ScheduleStore<kCompartments>(sim.files()).save(t, "+639170000000"));
+    bool led = false;
+    run.silentSeconds = 0;
+    for (;;) {
+      uint32_t at = sim.elapsedSeconds();  // step() runs loop() now, then
+      if (at >= hours * 3600 || !sim.step()) break;  // jumps ahead
+      if (sim.led().on() && !sim.buzzer().on()) {
+        run.silentSeconds += sim.elapsedSeconds() - at;
+      }
+      if (sim.led().on() != led) {
+        led = sim.led().on();
+        Moment m = {at, led ? "on" : "off"};
+        run.led.push_back(m);
+      }
+    }
+    run.buzzerEdges = sim.buzzer().edges();
+    run.buzzerAtEnd = sim.buzzer().on();
+    run.sms = sim.totals().sms;
+  }
+  rewind(f);
+  char line[160];
+  while (fgets(line, sizeof(line), f)) {
+    if (strstr(line, " SD +")) continue;
+    line[strcspn(line, "\n")] = '\0';
+    Moment m = {sinceStart(defaultSimConfig().start, line), line + 20};
+    run.trace.push_back(m);
+  }
+  fclose(f);
+  return run;
+}
+
+static void expectAt(const Run &run, size_t i, uint32_t at, const char *what) {
+  TEST_ASSERT_TRUE(i < run.trace.size());
+  TEST_ASSERT_EQUAL_STRING(what, run.trace[i].what.c_str());
+  TEST_ASSERT_EQUAL_UINT32(at, run.trace[i].at);
+}
+
+static std::string sms(const char *text) {
+  return std::string("SMS \"") + text + "\"";
+}
+
+void setUp() {}
+void tearDown() {}
+
+// Nobody comes. Each pill is in the tray 3 s after its dose is due; every
+// stage is timed from then, per dose, and each later dose of med1 starts
+// over from the first stage.
+static void test_every_stage_at_its_time() {
+  Run run = simulate(6, 1);
+  const uint32_t med1 = 3600, med2 = 3900;  // first doses due
+  const uint32_t drop = 3;
+  std::string alert = sms(kAlert);
+  size_t i = 0;
+  expectAt(run, i++, med1, "DISPENSED med1 latency=0s");
+  expectAt(run, i++, med1 + drop + 10, alert.c_str());
+  expectAt(run, i++, med2, "DISPENSED med2 latency=0s");
+  expectAt(run, i++, med2 + drop + 10, alert.c_str());
+  expectAt(run, i++, med1 + drop + 900, alert.c_str());
+  expectAt(run, i++, med2 + drop + 900, alert.c_str());
+  expectAt(run, i++, med1 + drop + 3600, "MISSED med1 latency=3603s");
+  expectAt(run, i++, med2 + drop + 3600, "MISSED med2 latency=3603s");
+  // 08:30 and 10:00: 90 minutes after the last one went out.
+  for (uint32_t due = 9000; due <= 14400; due += 5400) {
+    expectAt(run, i++, due, "DISPENSED med1 latency=0s");
+    expectAt(run, i++, due + drop + 10, alert.c_str());
+    expectAt(run, i++, due + drop + 900, alert.c_str());
+    expectAt(run, i++, due + drop + 3600, "MISSED med1 latency=3603s");
+  }
+  TEST_ASSERT_EQUAL_UINT32(i, run.trace.size());
+  TEST_ASSERT_EQUAL_UINT32(8, run.sms);
+
+  // The LED stays on while either pill waits and goes off with the last.
+  const uint32_t led[] = {med1 + drop, med2 + drop + 3600, 9003, 12603,
+                          14403, 18003};
+  TEST_ASSERT_EQUAL_UINT32(6, run.led.size());
+  for (size_t k = 0; k < 6; k++) {
+    TEST_ASSERT_EQUAL_UINT32(led[k], run.led[k].at);
+    TEST_ASSERT_EQUAL_STRING(k % 2 ? "off" : "on", run.led[k].what.c_str());
+  }
+  // The alarm sounds for as long as a pill waits, but for the gaps between
+  // the two beeps as each pill drops (under a second apiece; med2's dispense
+  // beep no longer silences med1's alarm), and stops with the last one.
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(4 * 3, run.buzzerEdges);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(4, run.silentSeconds);
+  TEST_ASSERT_FALSE(run.buzzerAtEnd);
+}
+
+// Every other pill is taken 20 s after it drops: that dose stops after the
+// first SMS and reports the pickup, and the next dose escalates in full.
+static void test_taken_dose_stops_escalating() {
+  Run run = simulate(6, 2);
+  std::string alert = sms(kAlert), taken = sms(kTaken);
+  size_t i = 0;
+  expectAt(run, i++, 3600, "DISPENSED med1 latency=0s");
+  expectAt(run, i++, 3613, alert.c_str());
+  expectAt(run, i++, 3623, "TAKEN med1 latency=23s");
+  expectAt(run, i++, 3623, taken.c_str());
+  expectAt(run, i++, 3900, "DISPENSED med2 latency=0s");
+  expectAt(run, i++, 3913, alert.c_str());
+  expectAt(run, i++, 4803, alert.c_str());
+  expectAt(run, i++, 7503, "MISSED med2 latency=3603s");
+  for (; i < run.trace.size(); i++) {
+    TEST_ASSERT_TRUE(run.trace[i].what.find("med2") == std::string::npos);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_stage_at_its_time);
+  RUN_TEST(test_taken_dose_stops_escalating);
+  return UNITY_END();
+}
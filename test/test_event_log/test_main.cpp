@@ -0,0 +1,177 @@
+// EventLog over a simulated two-year history: range queries must match what
+// was recorded and cost a fixed number of file operations per day in the
+// range, however long the log is.
+#include <unity.h>
+
+#include <vector>
+
+#include "Calendar.h"
+#include "EventLog.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+
+static const uint16_t kDays = 731;  // from 2025-01-01: two years and a day
+static uint16_t firstDay;
+
+// Expected per-day counts, filled in as the history is written.
+static std::vector<EventTotals> expected;
+
+// Four doses a day over two compartments, from a fixed-seed generator: each
+// dose is dispensed, then taken, taken late or missed.
+static void writeHistory(EventLog &log) {
+  DateTime start = {2025, 1, 1, 0, 0, 0};
+  firstDay = toEpoch(start) / EventLog::kSecondsPerDay;
+  expected.assign(kDays, EventTotals());
+  uint32_t seed = 12345;
+  for (uint16_t d = 0; d < kDays; d++) {
+    EventTotals &day = expected[d];
+    memset(&day, 0, sizeof(day));
+    uint32_t midnight = (uint32_t)(firstDay + d) * EventLog::kSecondsPerDay;
+    for (uint8_t dose = 0; dose < 4; dose++) {
+      uint32_t due = midnight + (7 + dose * 4) * 3600UL;
+      seed = seed * 1103515245UL + 12345;
+      uint8_t roll = (seed >> 16) % 20;
+      DoseEvent outcome = roll == 0 ? EVENT_MISSED
+                          : roll < 3 ? EVENT_LATE
+                                     : EVENT_TAKEN;
+      uint32_t latency = outcome == EVENT_LATE ? 3000 : 20 + roll;
+      TEST_ASSERT_TRUE(log.record(due, dose % 2, EVENT_DISPENSED, 0));
+      TEST_ASSERT_TRUE(log.record(due + latency, dose % 2, outcome, latency));
+      day.byType[EVENT_DISPENSED]++;
+      day.byType[outcome]++;
+    }
+    clock.advance(86400000UL);
+    log.poll();
+  }
+  TEST_ASSERT_TRUE(log.flush());
+}
+
+static void sumExpected(uint16_t from, uint16_t to, EventTotals &out) {
+  memset(&out, 0, sizeof(out));
+  for (uint16_t d = from; d <= to; d++) {
+    for (uint8_t t = 0; t < EVENT_KINDS; t++) {
+      out.byType[t] += expected[d].byType[t];
+    }
+    out.days++;
+  }
+}
+
+// Runs a query over history days [from, to] and checks it against what was
+// written; returns the file operations it took.
+static uint32_t query(MemFileStore &card, EventLog &log, uint16_t from,
+                      uint16_t to) {
+  EventTotals want, got;
+  sumExpected(from, to, want);
+  uint32_t opens = card.opens();
+  log.totals(firstDay + from, firstDay + to, got);
+  uint32_t ops = card.opens() - opens;
+  TEST_ASSERT_EQUAL_UINT16(want.days, got.days);
+  TEST_ASSERT_EQUAL_UINT16(0, got.scanned);
+  for (uint8_t t = 0; t < EVENT_KINDS; t++) {
+    TEST_ASSERT_EQUAL_UINT32(want.byType[t], got.byType[t]);
+  }
+  return ops;
+}
+
+static MemFileStore *card;
+static EventLog *log2y;
+
+void setUp() {
+  simClock = &clock;
+  if (!card) {
+    card = new MemFileStore;
+    log2y = new EventLog(*card, simMillis, 60000);
+    writeHistory(*log2y);
+  }
+}
+
+void tearDown() {}
+
+static void test_one_segment_per_day() {
+  char path[EventLog::kPathLen];
+  for (uint16_t d = 0; d < kDays; d++) {
+    EventLog::segmentPath(firstDay + d, path);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(SegmentHeader) + 8 * sizeof(EventRecord),
+                             card->size(path));
+  }
+  EventLog::segmentPath(firstDay + kDays, path);
+  TEST_ASSERT_FALSE(card->exists(path));
+}
+
+// A size check and a header read per day in the range: the cost of a week
+// is the same at the start and the end of two years of history, and the
+// whole history is 731 headers, not 5,848 records.
+static void test_query_cost_is_per_day_not_per_record() {
+  uint32_t early = query(*card, *log2y, 7, 13);
+  uint32_t late = query(*card, *log2y, kDays - 7, kDays - 1);
+  TEST_ASSERT_EQUAL_UINT32(2 * 7, early);
+  TEST_ASSERT_EQUAL_UINT32(early, late);
+  TEST_ASSERT_EQUAL_UINT32(2 * 30, query(*card, *log2y, 300, 329));
+  TEST_ASSERT_EQUAL_UINT32(2 * kDays, query(*card, *log2y, 0, kDays - 1));
+}
+
+// Days past the end of the history have no segment: they cost one size
+// check and add nothing.
+static void test_query_past_the_history() {
+  EventTotals got;
+  uint32_t opens = card->opens();
+  log2y->totals(firstDay + kDays, firstDay + kDays + 9, got);
+  TEST_ASSERT_EQUAL_UINT16(0, got.days);
+  TEST_ASSERT_EQUAL_UINT32(0, got.byType[EVENT_DISPENSED]);
+  TEST_ASSERT_EQUAL_UINT32(10, card->opens() - opens);
+}
+
+// Records that reached the card after the header last did (a reset between
+// the two writes) are found by scanning that one segment.
+static void test_stale_header_is_rescanned() {
+  MemFileStore fs;
+  EventLog log(fs, simMillis, 60000);
+  uint32_t day = 9500;
+  log.record(day * EventLog::kSecondsPerDay + 3600, 0, EVENT_DISPENSED, 0);
+  log.record(day * EventLog::kSecondsPerDay + 3620, 0, EVENT_TAKEN, 20);
+  log.flush();
+  char path[EventLog::kPathLen];
+  EventLog::segmentPath(day, path);
+  EventRecord extra = {7200, 1, EVENT_MISSED, 3600};
+  fs.append(path, &extra, sizeof(extra));
+
+  EventTotals got;
+  log.totals(day, day, got);
+  TEST_ASSERT_EQUAL_UINT16(1, got.scanned);
+  TEST_ASSERT_EQUAL_UINT32(1, got.byType[EVENT_DISPENSED]);
+  TEST_ASSERT_EQUAL_UINT32(1, got.byType[EVENT_TAKEN]);
+  TEST_ASSERT_EQUAL_UINT32(1, got.byType[EVENT_MISSED]);
+
+  // After a reboot, reopening the day repairs the header.
+  EventLog rebooted(fs, simMillis, 60000);
+  rebooted.record(day * EventLog::kSecondsPerDay + 9000, 1, EVENT_DISPENSED,
+                  0);
+  rebooted.totals(day, day, got);
+  TEST_ASSERT_EQUAL_UINT16(0, got.scanned);
+  TEST_ASSERT_EQUAL_UINT32(2, got.byType[EVENT_DISPENSED]);
+}
+
+static void test_latency_saturates() {
+  MemFileStore fs;
+  EventLog log(fs, simMillis, 60000);
+  log.record(9600 * EventLog::kSecondsPerDay, 0, EVENT_LATE, 100000);
+  log.flush();
+  char path[EventLog::kPathLen];
+  EventLog::segmentPath(9600, path);
+  EventRecord rec;
+  TEST_ASSERT_EQUAL_INT(sizeof(rec), fs.readAt(path, sizeof(SegmentHeader),
+                                               &rec, sizeof(rec)));
+  TEST_ASSERT_EQUAL_UINT16(0xFFFF, rec.latency);
+  TEST_ASSERT_EQUAL_UINT8(EVENT_LATE, rec.type);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_one_segment_per_day);
+  RUN_TEST(test_query_cost_is_per_day_not_per_record);
+  RUN_TEST(test_query_past_the_history);
+  RUN_TEST(test_stale_header_is_rescanned);
+  RUN_TEST(test_latency_saturates);
+  return UNITY_END();
+}
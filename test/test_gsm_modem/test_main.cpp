@@ -0,0 +1,255 @@
+// GsmModem against a scripted modem: every command the firmware sends is
+// checked against the script, and the modem's answers arrive after the
+// scripted delay on the fake clock.
+#include <unity.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "GsmModem.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+
+// One exchange: what the firmware must send next (a command without its
+// '\r', or an SMS body ending in Ctrl+Z) and what the modem answers, `delayMs`
+// later. A NULL reply means the modem stays silent.
+struct Step {
+  const char *expect;
+  const char *reply;
+  uint32_t delayMs;
+};
+
+class ScriptedModem : public ByteStream {
+ public:
+  ScriptedModem(const Step *steps, size_t count)
+      : steps_(steps), count_(count), next_(0), mismatches_(0) {}
+
+  int available() {
+    release();
+    return rx_.size();
+  }
+  int read() {
+    release();
+    if (rx_.empty()) return -1;
+    uint8_t b = rx_.front();
+    rx_.pop_front();
+    return b;
+  }
+  size_t write(const uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      char c = buf[i];
+      if (c == '\r' || c == 26 || c == 27) {
+        if (c != '\r') line_ += c;
+        heard(line_);
+        line_.clear();
+      } else {
+        line_ += c;
+      }
+    }
+    return len;
+  }
+  using ByteStream::write;
+
+  const std::vector<std::string> &heard() const { return heard_; }
+  size_t stepsLeft() const { return count_ - next_; }
+  uint32_t mismatches() const { return mismatches_; }
+
+ private:
+  struct Reply {
+    uint64_t at;
+    std::string text;
+  };
+
+  void heard(const std::string &unit) {
+    heard_.push_back(unit);
+    if (unit == "\x1B") return;  // an abort is never scripted
+    if (next_ == count_ || unit != steps_[next_].expect) {
+      mismatches_++;
+      return;
+    }
+    const Step &s = steps_[next_++];
+    if (s.reply) {
+      Reply r = {clock.elapsedMs() + s.delayMs, s.reply};
+      later_.push_back(r);
+    }
+  }
+  void release() {
+    while (!later_.empty() && later_.front().at <= clock.elapsedMs()) {
+      const std::string &t = later_.front().text;
+      rx_.insert(rx_.end(), t.begin(), t.end());
+      later_.pop_front();
+    }
+  }
+
+  const Step *steps_;
+  size_t count_;
+  size_t next_;
+  uint32_t mismatches_;
+  std::string line_;
+  std::vector<std::string> heard_;
+  std::deque<Reply> later_;
+  std::deque<uint8_t> rx_;
+};
+
+#define CMGF "AT+CMGF=1"
+#define CMGS "AT+CMGS=\"+639170000000\""
+#define OK "\r\nOK\r\n"
+#define SENT "\r\n+CMGS: 7\r\n\r\nOK\r\n"
+
+// Polls the way the Dispenser's task does: sleep for whatever poll() asks.
+static void drain(GsmModem &modem, uint32_t limitMs) {
+  uint64_t end = clock.elapsedMs() + limitMs;
+  while (modem.busy() && clock.elapsedMs() < end) {
+    uint32_t wait = modem.poll();
+    if (wait == Scheduler::kNever) break;
+    clock.advance(wait);
+  }
+}
+
+void setUp() {
+  clock = SimClock(0);
+  simClock = &clock;
+}
+
+void tearDown() {}
+
+// The old sendAlert() slept a fixed 7.1 s per message; the state machine
+// finishes as soon as the modem has answered.
+static void test_follows_the_modem_not_fixed_sleeps() {
+  static const Step script[] = {{CMGF, OK, 50},
+                                {CMGS, "> ", 200},
+                                {"Dose taken\x1A", SENT, 1500}};
+  ScriptedModem port(script, 3);
+  GsmModem modem(port, simMillis);
+  modem.setRecipient("+639170000000");
+  TEST_ASSERT_TRUE(modem.enqueue("Dose taken"));
+
+  drain(modem, 10000);
+  TEST_ASSERT_EQUAL_UINT32(0, port.mismatches());
+  TEST_ASSERT_EQUAL_UINT32(0, port.stepsLeft());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.sent());
+  TEST_ASSERT_FALSE(modem.busy());
+  TEST_ASSERT_EQUAL_UINT32(Scheduler::kNever, modem.poll());
+  // Each answer is noticed within one kPollMs poll.
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1750 + 3 * GsmModem::kPollMs,
+                                   modem.busyMs());
+  TEST_ASSERT_LESS_THAN_UINT32(7100, modem.busyMs());
+}
+
+// Text mode is only set once; the second message goes straight to AT+CMGS.
+static void test_text_mode_is_remembered() {
+  static const Step script[] = {{CMGF, OK, 10},
+                                {CMGS, "> ", 10},
+                                {"one\x1A", SENT, 10},
+                                {CMGS, "> ", 10},
+                                {"two\x1A", SENT, 10}};
+  ScriptedModem port(script, 5);
+  GsmModem modem(port, simMillis);
+  modem.setRecipient("+639170000000");
+  modem.enqueue("one");
+  modem.enqueue("two");
+  drain(modem, 10000);
+  TEST_ASSERT_EQUAL_UINT32(0, port.mismatches());
+  TEST_ASSERT_EQUAL_UINT16(2, modem.sent());
+}
+
+static void test_error_retries_then_gives_up() {
+  static const Step script[] = {{CMGF, "\r\nERROR\r\n", 10},
+                                {CMGF, "\r\nERROR\r\n", 10},
+                                {CMGF, "\r\nERROR\r\n", 10}};
+  ScriptedModem port(script, 3);
+  GsmModem modem(port, simMillis);
+  modem.setRecipient("+639170000000");
+  modem.enqueue("Missed dose");
+
+  uint64_t start = clock.elapsedMs();
+  drain(modem, 60000);
+  TEST_ASSERT_EQUAL_UINT32(0, port.mismatches());
+  TEST_ASSERT_EQUAL_UINT16(0, modem.sent());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.failed());
+  TEST_ASSERT_EQUAL_UINT16(GsmModem::kMaxAttempts - 1, modem.retries());
+  // Two back-offs between three attempts.
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2 * GsmModem::kRetryBackoffMs,
+                                      clock.elapsedMs() - start);
+  TEST_ASSERT_FALSE(modem.busy());
+}
+
+// No delivery report: the half-sent body is aborted with ESC and the message
+// is sent again from the top.
+static void test_silent_modem_times_out_and_retries() {
+  static const Step script[] = {{CMGF, OK, 10},
+                                {CMGS, "> ", 10},
+                                {"Dose taken\x1A", NULL, 0},
+                                {CMGF, OK, 10},
+                                {CMGS, "> ", 10},
+                                {"Dose taken\x1A", SENT, 10}};
+  ScriptedModem port(script, 6);
+  GsmModem modem(port, simMillis);
+  modem.setRecipient("+639170000000");
+  modem.enqueue("Dose taken");
+
+  drain(modem, 2 * GsmModem::kSendTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT32(0, port.mismatches());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.sent());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.retries());
+  const std::vector<std::string> &heard = port.heard();
+  TEST_ASSERT_EQUAL_STRING("\x1B", heard[3].c_str());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(GsmModem::kSendTimeoutMs,
+                                      clock.elapsedMs());
+}
+
+static void test_dedups_pending_and_bounds_the_queue() {
+  SimModem port;
+  GsmModem modem(port, simMillis);
+  TEST_ASSERT_TRUE(modem.enqueue("a"));
+  TEST_ASSERT_TRUE(modem.enqueue("a"));
+  TEST_ASSERT_EQUAL_UINT8(1, modem.pending());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.deduped());
+
+  TEST_ASSERT_TRUE(modem.enqueue("b"));
+  TEST_ASSERT_TRUE(modem.enqueue("c"));
+  TEST_ASSERT_TRUE(modem.enqueue("d"));
+  TEST_ASSERT_FALSE(modem.enqueue("e"));
+  TEST_ASSERT_EQUAL_UINT8(GsmModem::kQueueLen, modem.pending());
+  TEST_ASSERT_EQUAL_UINT16(1, modem.dropped());
+
+  // Once "a" is sent, the same text is a new message again.
+  drain(modem, 60000);
+  TEST_ASSERT_TRUE(modem.enqueue("a"));
+  TEST_ASSERT_EQUAL_UINT8(1, modem.pending());
+}
+
+// Throughput against a modem that answers at once: the queue drains at a few
+// polls per message, far beyond what one patient's alerts need.
+static void test_throughput() {
+  SimModem port;
+  GsmModem modem(port, simMillis);
+  modem.setRecipient("+639170000000");
+  char text[16];
+  uint32_t queued = 0;
+  while (clock.elapsedMs() < 60000) {
+    if (modem.pending() < GsmModem::kQueueLen) {
+      snprintf(text, sizeof(text), "msg %u", (unsigned)queued++);
+      modem.enqueue(text);
+    }
+    uint32_t wait = modem.poll();
+    clock.advance(wait == Scheduler::kNever ? GsmModem::kPollMs : wait);
+  }
+  TEST_ASSERT_EQUAL_UINT32(modem.sent(), port.messages());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(600, port.messages());  // per minute
+  TEST_ASSERT_EQUAL_STRING("msg 0", port.bodies()[0].c_str());
+  TEST_ASSERT_EQUAL_UINT16(0, modem.failed());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_follows_the_modem_not_fixed_sleeps);
+  RUN_TEST(test_text_mode_is_remembered);
+  RUN_TEST(test_error_retries_then_gives_up);
+  RUN_TEST(test_silent_modem_times_out_and_retries);
+  RUN_TEST(test_dedups_pending_and_bounds_the_queue);
+  RUN_TEST(test_throughput);
+  return UNITY_END();
+}
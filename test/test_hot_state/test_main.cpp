@@ -0,0 +1,232 @@
+// HotStateLog on the host EEPROM: reboot recovery, resets mid-record, a
+// rarely-dosed compartment surviving many ring laps, and cell wear across a
+// simulated year.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <string>
+
+#include "HotState.h"
+#include "native/Fakes.h"
+#include "native/Simulator.h"
+
+// Lets `budget` more byte writes through, then reports busy for good, like
+// a board that resets partway through a record.
+class CuttingEeprom : public Eeprom {
+ public:
+  CuttingEeprom(MemEeprom &cells, uint32_t budget)
+      : cells_(cells), budget_(budget) {}
+  uint16_t size() { return cells_.size(); }
+  uint8_t read(uint16_t addr) { return cells_.read(addr); }
+  bool ready() { return budget_ > 0; }
+  void write(uint16_t addr, uint8_t value) {
+    budget_--;
+    cells_.write(addr, value);
+  }
+
+ private:
+  MemEeprom &cells_;
+  uint32_t budget_;
+};
+
+static HotRecord record(uint32_t nextDue, uint8_t taken) {
+  HotRecord r = {nextDue, taken, 7, 0, 0};
+  return r;
+}
+
+// A fresh log on `ee`, as after a reboot.
+static uint32_t bootNextDue(Eeprom &ee, uint8_t c, uint16_t generation) {
+  HotStateLog log(ee, 0, 1536);
+  log.begin();
+  HotRecord r;
+  return log.latest(c, generation, r) ? r.nextDue : 0;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_newest_record_survives_reboot() {
+  MemEeprom ee;
+  HotStateLog log(ee, 0, 1536);
+  log.begin();
+  TEST_ASSERT_EQUAL_UINT16(96, log.slots());
+  for (uint32_t i = 1; i <= 10; i++) {
+    TEST_ASSERT_TRUE(log.save(i % 2, 3, record(1000 + i, i)));
+    while (log.pump()) {
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(1010, bootNextDue(ee, 0, 3));
+  TEST_ASSERT_EQUAL_UINT32(1009, bootNextDue(ee, 1, 3));
+  // Records from another schedule generation do not apply.
+  TEST_ASSERT_EQUAL_UINT32(0, bootNextDue(ee, 0, 4));
+  TEST_ASSERT_EQUAL_UINT32(10, log.recordsWritten());
+}
+
+// save() only queues; the bytes go out from pump() while the EEPROM is
+// ready, one at a time, so a save never blocks the loop.
+static void test_save_only_queues() {
+  MemEeprom ee;
+  HotStateLog log(ee, 0, 1536);
+  log.begin();
+  log.save(0, 1, record(5000, 1));
+  TEST_ASSERT_TRUE(log.busy());
+  TEST_ASSERT_EQUAL_UINT32(0, ee.writes());
+  while (log.pump()) {
+  }
+  TEST_ASSERT_EQUAL_UINT32(HotStateLog::kRecordSize + 1, log.bytesWritten());
+}
+
+// A reset after any byte of a record leaves the previous one in charge.
+static void test_reset_at_every_byte_of_a_record() {
+  for (uint32_t at = 0; at <= HotStateLog::kRecordSize + 1; at++) {
+    MemEeprom cells;
+    {
+      HotStateLog log(cells, 0, 1536);
+      log.begin();
+      log.save(0, 1, record(100, 1));
+      while (log.pump()) {
+      }
+    }
+    CuttingEeprom flaky(cells, at);
+    HotStateLog log(flaky, 0, 1536);
+    log.begin();
+    log.save(0, 1, record(200, 2));
+    bool done = !log.pump();
+    TEST_ASSERT_EQUAL(at == HotStateLog::kRecordSize + 1, done);
+    TEST_ASSERT_EQUAL_UINT32(done ? 200 : 100, bootNextDue(cells, 0, 1));
+  }
+}
+
+// Compartment 1 is dosed once; compartment 0 then laps the ring ten times,
+// rebooting every so often. The head carries compartment 1's record along
+// instead of overwriting it.
+static void test_rare_compartment_survives_ring_laps() {
+  MemEeprom ee;
+  HotStateLog *log = new HotStateLog(ee, 0, 1536);
+  log->begin();
+  log->save(1, 2, record(777, 1));
+  while (log->pump()) {
+  }
+  for (uint32_t i = 0; i < 10 * 96; i++) {
+    if (i % 37 == 0) {
+      delete log;
+      log = new HotStateLog(ee, 0, 1536);
+      log->begin();
+    }
+    TEST_ASSERT_TRUE(log->save(0, 2, record(i, 0)));
+    while (log->pump()) {
+    }
+  }
+  delete log;
+  TEST_ASSERT_EQUAL_UINT32(777, bootNextDue(ee, 1, 2));
+  TEST_ASSERT_EQUAL_UINT32(10 * 96 - 1, bootNextDue(ee, 0, 2));
+}
+
+// A year of four doses a day. The ATmega2560 EEPROM is rated for 100,000
+// cycles per cell; wear is spread evenly over the ring, so no cell gets near
+// that in the device's life.
+static void test_cell_wear_over_a_year() {
+  SimConfig config = defaultSimConfig();
+  config.days = 365;
+  DeviceSim sim(config, NULL);
+  sim.run();
+  const SimTotals &t = sim.totals();
+  TEST_ASSERT_EQUAL_UINT32(365 * 4, t.events[EVENT_TAKEN]);
+
+  const MemEeprom &ee = sim.eeprom();
+  uint32_t worst = ee.maxCellWrites();
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(100000 / 20, worst);  // 20+ years
+  // The magic byte, cleared and set for every record, is the most worn
+  // cell of its slot; the head visits every slot in turn.
+  uint32_t most = 0, least = worst;
+  for (uint16_t a = 0; a < 1536; a += HotStateLog::kRecordSize) {
+    if (ee.writes(a) > most) most = ee.writes(a);
+    if (ee.writes(a) < least) least = ee.writes(a);
+  }
+  TEST_ASSERT_EQUAL_UINT32(worst, most);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(least + 2, most);
+  TEST_ASSERT_EQUAL_UINT32(t.eepromWrites, ee.writes());
+}
+
+// Runs until `seconds` into the simulation.
+static void stepUntil(DeviceSim &sim, uint32_t seconds) {
+  while (sim.elapsedSeconds() < seconds && sim.step()) {
+  }
+}
+
+// A dose is out when the caregiver clears the device; a new patient's
+// schedule goes on and the board restarts before its first dose. The old
+// patient's EEPROM records must not come back with it: nothing is resumed
+// or dispensed until the new schedule's own time.
+static void test_clear_then_new_schedule_starts_clean() {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  FILE *trace = tmpfile();
+  TEST_ASSERT_NOT_NULL(trace);
+  DeviceSim sim(config, trace);
+  stepUntil(sim, 3600 + 8);  // 07:00 dose waiting in the tray
+  TEST_ASSERT_EQUAL_UINT32(1, sim.totals().events[EVENT_DISPENSED]);
+  uint16_t old = sim.dispenser().hotState().highestGeneration();
+  TEST_ASSERT_GREATER_THAN_UINT32(0, old);
+
+  sim.console().send("clear\n");
+  stepUntil(sim, 3600 + 10);
+  TEST_ASSERT_EQUAL_UINT32(1, sim.totals().resets);
+  TEST_ASSERT_EQUAL_INT(Dispenser::SETUP, sim.dispenser().state());
+
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Amlodipine");
+  t[0].iterations = 1;
+  t[0].baseHour = t[0].nextHour = 20;
+  t[0].active = true;
+  uint8_t payload[kFrameMaxPayload];
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  uint16_t len = encodeProvision(t, "+639171111111", payload);
+  sim.bluetooth().send(frame,
+                       encodeFrame(FRAME_SCHEDULE, payload, len, frame));
+  stepUntil(sim, 3600 + 20);
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, sim.dispenser().state());
+
+  sim.console().output().clear();
+  sim.reset();
+  stepUntil(sim, 3600 + 30);
+  TEST_ASSERT_EQUAL_UINT32(2, sim.totals().resets);
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, sim.dispenser().state());
+  TEST_ASSERT_TRUE(sim.console().output().find("Resumed") ==
+                   std::string::npos);
+  const Compartment &med = sim.dispenser().schedule()[0];
+  TEST_ASSERT_EQUAL_UINT8(0, med.dosesTaken);
+  TEST_ASSERT_EQUAL_UINT8(20, toDateTime(med.nextDue).hour);
+  TEST_ASSERT_FALSE(sim.dispenser().schedule()[1].active);
+
+  // Nothing until 20:00, then the new dose on time.
+  stepUntil(sim, 14 * 3600 - 1);
+  TEST_ASSERT_EQUAL_UINT32(1, sim.totals().events[EVENT_DISPENSED]);
+  sim.run();
+  TEST_ASSERT_EQUAL_UINT32(2, sim.totals().events[EVENT_DISPENSED]);
+  TEST_ASSERT_GREATER_THAN_UINT32(
+      old, sim.dispenser().hotState().highestGeneration());
+
+  rewind(trace);
+  char line[160];
+  uint32_t dispensed = 0;
+  while (fgets(line, sizeof(line), trace)) {
+    if (!strstr(line, "DISPENSED")) continue;
+    TEST_ASSERT_TRUE(strstr(line, "latency=0s") != NULL);
+    dispensed++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, dispensed);
+  fclose(trace);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_newest_record_survives_reboot);
+  RUN_TEST(test_save_only_queues);
+  RUN_TEST(test_reset_at_every_byte_of_a_record);
+  RUN_TEST(test_rare_compartment_survives_ring_laps);
+  RUN_TEST(test_cell_wear_over_a_year);
+  RUN_TEST(test_clear_then_new_schedule_starts_clean);
+  return UNITY_END();
+}
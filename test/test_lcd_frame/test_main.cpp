@@ -0,0 +1,177 @@
+// The LCD shadow framebuffer: the panel always ends up showing the frame,
+// a clock tick costs a cursor move and a digit or two, and a minute of the
+// clock costs a fraction of what clearing and reprinting every pass did.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include "LcdFrame.h"
+#include "native/Fakes.h"
+#include "native/Simulator.h"
+
+// Counts what reaches the panel as LcdFrame does: one byte per command and
+// per character.
+class CountingDisplay : public TextDisplay {
+ public:
+  CountingDisplay() : bytes_(0) {}
+  void clear() {
+    TextDisplay::clear();
+    bytes_++;
+  }
+  void setCursor(uint8_t col, uint8_t row) {
+    TextDisplay::setCursor(col, row);
+    bytes_++;
+  }
+  void print(const char *text) {
+    TextDisplay::print(text);
+    bytes_ += strlen(text);
+  }
+  uint32_t bytes() const { return bytes_; }
+
+ private:
+  uint32_t bytes_;
+};
+
+static std::string padded(const char *text) {
+  std::string s(text);
+  s.resize(LCD_COLS, ' ');
+  return s;
+}
+
+static void clockText(uint32_t seconds, char *text) {
+  sprintf(text, "%02u:%02u:%02u", (unsigned)(seconds / 3600 % 24),
+          (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60));
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_flush_sends_only_changes() {
+  CountingDisplay panel;
+  LcdFrame frame(panel);
+  frame.reset();
+  TEST_ASSERT_EQUAL_UINT32(1, frame.bytesSent());
+  TEST_ASSERT_EQUAL_UINT16(0, frame.flush());
+
+  frame.printRow(0, "Current Time: ");
+  frame.printRow(1, "12:34:09");
+  TEST_ASSERT_EQUAL_UINT16(1 + 13 + 1 + 8, frame.flush());
+  TEST_ASSERT_EQUAL_UINT16(0, frame.flush());
+
+  // One second: one cursor move and one digit.
+  frame.printRow(0, "Current Time: ");
+  frame.printRow(1, "12:34:08");
+  TEST_ASSERT_EQUAL_UINT16(2, frame.flush());
+  // A ten-second carry: both digits in one run.
+  frame.printRow(1, "12:34:10");
+  TEST_ASSERT_EQUAL_UINT16(3, frame.flush());
+  TEST_ASSERT_TRUE(padded("12:34:10") == panel.row(1));
+  TEST_ASSERT_EQUAL_UINT32(1 + 23 + 2 + 3, frame.bytesSent());
+  TEST_ASSERT_EQUAL_UINT32(frame.bytesSent() * LCD_I2C_WRITES_PER_BYTE,
+                           frame.i2cWrites());
+  TEST_ASSERT_EQUAL_UINT32(3, frame.flushes());
+}
+
+// Up to two unchanged cells between changes are resent rather than paying
+// for a second cursor move; a wider gap splits the run.
+static void test_runs_absorb_short_gaps() {
+  CountingDisplay panel;
+  LcdFrame frame(panel);
+  frame.printRow(0, "abcdefgh");
+  frame.flush();
+
+  frame.printRow(0, "XbcXefgh");
+  TEST_ASSERT_EQUAL_UINT16(1 + 4, frame.flush());
+  frame.printRow(0, "abcXefgY");
+  TEST_ASSERT_EQUAL_UINT16(1 + 1 + 1 + 1, frame.flush());
+  TEST_ASSERT_TRUE(padded("abcXefgY") == panel.row(0));
+}
+
+// Whatever is drawn, and however often it is flushed, the panel ends up
+// showing exactly the frame.
+static void test_panel_matches_frame() {
+  CountingDisplay panel;
+  LcdFrame frame(panel);
+  frame.reset();
+  std::string want[LCD_ROWS] = {padded(""), padded("")};
+  uint32_t seed = 7;
+  for (int i = 0; i < 5000; i++) {
+    seed = seed * 1103515245UL + 12345;
+    uint8_t row = (seed >> 8) & 1;
+    uint8_t col = (seed >> 9) % 20;
+    char text[6];
+    uint8_t len = (seed >> 14) % 6;
+    for (uint8_t k = 0; k < len; k++) text[k] = 'a' + (seed >> (k + 17)) % 4;
+    text[len] = '\0';
+    if ((seed >> 28) == 0) {
+      frame.printRow(row, text);
+      want[row] = padded(text);
+    } else {
+      frame.print(col, row, text);
+      for (uint8_t k = 0; k < len && col + k < LCD_COLS; k++) {
+        want[row][col + k] = text[k];
+      }
+    }
+    if ((seed >> 24) % 3 == 0) {
+      frame.flush();
+      TEST_ASSERT_TRUE(want[0] == panel.row(0));
+      TEST_ASSERT_TRUE(want[1] == panel.row(1));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(panel.bytes(), frame.bytesSent());
+}
+
+// A minute of the seconds clock, redrawn twice a second as the old IR wait
+// loop did: clear, label, time. Through the frame, the same redraws cost a
+// cursor move and a digit or two per second.
+static void test_bytes_per_minute_against_clear_and_reprint() {
+  CountingDisplay old;
+  CountingDisplay panel;
+  LcdFrame frame(panel);
+  frame.reset();
+  uint32_t start = 7 * 3600UL + 59 * 60 + 30;  // across 08:00:00
+  uint32_t start0 = frame.bytesSent();
+  for (uint32_t half = 0; half < 120; half++) {
+    char text[12];
+    clockText(start + half / 2, text);
+
+    old.clear();
+    old.setCursor(0, 0);
+    old.print("Current Time: ");
+    old.setCursor(0, 1);
+    old.print(text);
+
+    frame.printRow(0, "Current Time: ");
+    frame.printRow(1, text);
+    frame.flush();
+  }
+  uint32_t before = old.bytes();
+  uint32_t after = frame.bytesSent() - start0;
+  TEST_ASSERT_EQUAL_UINT32(120 * (1 + 1 + 14 + 1 + 8), before);
+  // First draw, then 59 ticks; the carry into 08:00:00 rewrites five cells.
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1 + 13 + 1 + 8 + 59 * 3 + 6, after);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(before / 10, after);
+  TEST_ASSERT_TRUE(padded("08:00:29") == panel.row(1));
+}
+
+// The whole device over a month draws a few bytes a minute: HH:MM while
+// idle, HH:MM:SS only while a dose is out.
+static void test_device_bytes_per_minute() {
+  SimConfig config = defaultSimConfig();
+  DeviceSim sim(config, NULL);
+  sim.run();
+  uint32_t minutes = config.days * 24 * 60;
+  uint32_t bytes = sim.totals().lcdBytes;
+  TEST_ASSERT_GREATER_THAN_UINT32(minutes, bytes);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(3 * minutes, bytes);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_flush_sends_only_changes);
+  RUN_TEST(test_runs_absorb_short_gaps);
+  RUN_TEST(test_panel_matches_frame);
+  RUN_TEST(test_bytes_per_minute_against_clear_and_reprint);
+  RUN_TEST(test_device_bytes_per_minute);
+  return UNITY_END();
+}
@@ -0,0 +1,194 @@
+// LogWriter against an in-memory card: sector-aligned flushes, the age
+// bound, a card that fails partway through every possible byte of a flush,
+// and card traffic per 1,000 logged doses against one open per line.
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "LogWriter.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+
+// Records every append and can cut one short: the first `landBytes` reach
+// the card and the call fails, as when the card drops out mid-write.
+class RecordingFileStore : public FileStore {
+ public:
+  explicit RecordingFileStore(MemFileStore &card)
+      : card_(card), failNext_(false), landBytes_(0), sectors_(0) {}
+
+  bool exists(const char *path) { return card_.exists(path); }
+  bool remove(const char *path) { return card_.remove(path); }
+  int readAt(const char *path, uint32_t offset, void *buf, uint16_t len) {
+    return card_.readAt(path, offset, buf, len);
+  }
+  int write(const char *path, const void *buf, uint16_t len) {
+    return card_.write(path, buf, len);
+  }
+  int append(const char *path, const void *buf, uint16_t len) {
+    uint32_t start = card_.size(path);
+    if (failNext_) {
+      failNext_ = false;
+      if (landBytes_ > len) landBytes_ = len;
+      if (landBytes_ > 0) count(start, landBytes_);
+      card_.append(path, buf, landBytes_);
+      return -1;
+    }
+    count(start, len);
+    appends_.push_back(len);
+    return card_.append(path, buf, len);
+  }
+  uint32_t size(const char *path) { return card_.size(path); }
+
+  void failNextAfter(uint16_t bytes) {
+    failNext_ = true;
+    landBytes_ = bytes;
+  }
+  const std::vector<uint16_t> &appends() const { return appends_; }
+  // 512-byte sectors of the file touched by appends, i.e. data sector writes.
+  uint32_t sectors() const { return sectors_; }
+
+ private:
+  void count(uint32_t start, uint16_t len) {
+    if (len > 0) sectors_ += (start + len - 1) / 512 - start / 512 + 1;
+  }
+
+  MemFileStore &card_;
+  bool failNext_;
+  uint16_t landBytes_;
+  uint32_t sectors_;
+  std::vector<uint16_t> appends_;
+};
+
+static std::string contents(MemFileStore &card, const char *path) {
+  std::string s(card.size(path), '\0');
+  if (!s.empty()) card.readAt(path, 0, &s[0], s.size());
+  return s;
+}
+
+// A dose line as the event log writes it: about 40 bytes.
+static std::string doseLine(uint32_t i) {
+  char line[64];
+  snprintf(line, sizeof(line), "2025-%02u-%02u %02u:00,Losartan,TAKEN,%u\n",
+           (unsigned)(i / 120 % 12 + 1), (unsigned)(i / 4 % 28 + 1),
+           (unsigned)(7 + i % 4 * 4), (unsigned)i);
+  return line;
+}
+
+void setUp() {
+  clock = SimClock(0);
+  simClock = &clock;
+}
+
+void tearDown() {}
+
+// An existing 100-byte file: the first flush tops the sector up, every
+// later one is a whole sector.
+static void test_flushes_end_on_sector_boundaries() {
+  MemFileStore card;
+  card.append("LOG.TXT", std::string(100, 'x').c_str(), 100);
+  RecordingFileStore fs(card);
+  LogWriter log(fs, "LOG.TXT", simMillis, 60000);
+  log.begin();
+  std::string expect(100, 'x');
+  for (uint32_t i = 0; i < 100; i++) {
+    std::string line = doseLine(i);
+    TEST_ASSERT_TRUE(log.print(line.c_str()));
+    expect += line;
+  }
+  const std::vector<uint16_t> &a = fs.appends();
+  TEST_ASSERT_GREATER_THAN_UINT32(2, a.size());
+  TEST_ASSERT_EQUAL_UINT16(412, a[0]);
+  for (size_t i = 1; i < a.size(); i++) TEST_ASSERT_EQUAL_UINT16(512, a[i]);
+  TEST_ASSERT_EQUAL_UINT32(a.size(), fs.sectors());
+  TEST_ASSERT_LESS_THAN_UINT32(LogWriter::kSectorSize, log.staged());
+
+  TEST_ASSERT_TRUE(log.flush());
+  TEST_ASSERT_EQUAL_UINT16(0, log.staged());
+  TEST_ASSERT_TRUE(expect == contents(card, "LOG.TXT"));
+}
+
+// Staged bytes never wait on the card longer than maxAgeMs.
+static void test_age_bound() {
+  MemFileStore card;
+  LogWriter log(card, "LOG.TXT", simMillis, 60000);
+  log.begin();
+  TEST_ASSERT_EQUAL_UINT32(Scheduler::kNever, log.poll());
+  log.print("first\n");
+  clock.advance(20000);
+  log.print("second\n");  // does not restart the clock
+  TEST_ASSERT_EQUAL_UINT32(40000, log.poll());
+  TEST_ASSERT_EQUAL_UINT32(0, card.size("LOG.TXT"));
+  clock.advance(40000);
+  TEST_ASSERT_EQUAL_UINT32(Scheduler::kNever, log.poll());
+  TEST_ASSERT_TRUE(contents(card, "LOG.TXT") == "first\nsecond\n");
+  TEST_ASSERT_EQUAL_UINT32(1, log.flushes());
+}
+
+// The card takes any prefix of a flush and then fails; the retry must
+// write exactly the rest, so the file neither repeats nor loses a byte.
+static void test_card_failure_at_every_byte_of_a_flush() {
+  for (uint16_t cut = 0; cut < LogWriter::kSectorSize; cut++) {
+    MemFileStore card;
+    RecordingFileStore fs(card);
+    LogWriter log(fs, "LOG.TXT", simMillis, 60000);
+    log.begin();
+    std::string expect;
+    for (uint32_t i = 0; i < 10; i++) {
+      std::string line = doseLine(i);
+      log.print(line.c_str());
+      expect += line;
+    }
+    fs.failNextAfter(cut);
+    TEST_ASSERT_FALSE(log.flush());
+    TEST_ASSERT_EQUAL_UINT16(1, log.failures());
+    for (uint32_t i = 10; i < 40; i++) {
+      std::string line = doseLine(i);
+      log.print(line.c_str());
+      expect += line;
+    }
+    TEST_ASSERT_TRUE(log.flush());
+    TEST_ASSERT_EQUAL_UINT32(0, log.dropped());
+    TEST_ASSERT_TRUE(expect == contents(card, "LOG.TXT"));
+  }
+}
+
+// 1,000 dose lines inside one age window. The old logSched() opened,
+// appended one line and closed the file per dose: an open and at least one
+// data sector write each, plus the directory entry. Staged, the card sees
+// one whole sector per dozen lines.
+static void test_card_traffic_per_1000_doses() {
+  MemFileStore oldCard;
+  RecordingFileStore oldFs(oldCard);
+  MemFileStore newCard;
+  RecordingFileStore newFs(newCard);
+  LogWriter log(newFs, "LOG.TXT", simMillis, 60000);
+  log.begin();
+  uint32_t bytes = 0;
+  for (uint32_t i = 0; i < 1000; i++) {
+    std::string line = doseLine(i);
+    oldFs.append("LOG.TXT", line.c_str(), line.size());
+    log.print(line.c_str());
+    bytes += line.size();
+  }
+  log.flush();
+
+  uint32_t sectors = (bytes + 511) / 512;
+  TEST_ASSERT_EQUAL_UINT32(1000, oldFs.appends().size());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1000, oldFs.sectors());
+  TEST_ASSERT_EQUAL_UINT32(sectors, newFs.appends().size());
+  TEST_ASSERT_EQUAL_UINT32(sectors, newFs.sectors());
+  TEST_ASSERT_LESS_THAN_UINT32(100, newFs.appends().size());
+  TEST_ASSERT_TRUE(contents(oldCard, "LOG.TXT") ==
+                   contents(newCard, "LOG.TXT"));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_flushes_end_on_sector_boundaries);
+  RUN_TEST(test_age_bound);
+  RUN_TEST(test_card_failure_at_every_byte_of_a_flush);
+  RUN_TEST(test_card_traffic_per_1000_doses);
+  return UNITY_END();
+}
@@ -0,0 +1,332 @@
+// The firmware must not allocate once setup() is done. The board build
+// wraps malloc/realloc at link time (src/main.cpp, "mem"); here malloc,
+// realloc, calloc and operator new are replaced outright and counted while
+// a Dispenser runs three days of doses on fakes that never allocate
+// themselves, so every allocation the counter sees is the firmware's.
+#include <unity.h>
+
+#include <new>
+
+#include "Calendar.h"
+#include "Dispenser.h"
+#include "ScheduleStore.h"
+#include "native/Fakes.h"
+
+static volatile bool heapSealed = false;
+static volatile uint32_t lateAllocs = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t n);
+void *__libc_calloc(size_t count, size_t n);
+void *__libc_realloc(void *p, size_t n);
+void __libc_free(void *p);
+
+void *malloc(size_t n) {
+  if (heapSealed) lateAllocs++;
+  return __libc_malloc(n);
+}
+void *calloc(size_t count, size_t n) {
+  if (heapSealed) lateAllocs++;
+  return __libc_calloc(count, n);
+}
+void *realloc(void *p, size_t n) {
+  if (heapSealed) lateAllocs++;
+  return __libc_realloc(p, n);
+}
+void free(void *p) { __libc_free(p); }
+}
+#endif
+
+// Goes through malloc, so it is only counted here where malloc is not.
+void *operator new(size_t n) {
+#ifndef __GLIBC__
+  if (heapSealed) lateAllocs++;
+#endif
+  void *p = ::malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { ::free(p); }
+void operator delete(void *p, size_t) noexcept { ::free(p); }
+
+// ! Allocation-free fakes
+
+class NullDisplay : public Display {
+ public:
+  void clear() {}
+  void setCursor(uint8_t, uint8_t) {}
+  void print(const char *) {}
+};
+
+class NullLink : public ByteStream {
+ public:
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(const uint8_t *, size_t len) { return len; }
+  using ByteStream::write;
+  bool listening() { return false; }
+};
+
+// A handful of fixed-size files in static storage.
+class FixedFileStore : public FileStore {
+ public:
+  static const uint8_t kFiles = 16;
+  static const uint16_t kFileSize = 8192;
+
+  bool exists(const char *path) { return find(path) != NULL; }
+  bool remove(const char *path) {
+    File *f = find(path);
+    if (f) f->used = false;
+    return f != NULL;
+  }
+  int readAt(const char *path, uint32_t offset, void *buf, uint16_t len) {
+    File *f = find(path);
+    if (!f) return -1;
+    if (offset >= f->size) return 0;
+    uint16_t n = f->size - offset < len ? f->size - offset : len;
+    memcpy(buf, f->data + offset, n);
+    return n;
+  }
+  int write(const char *path, const void *buf, uint16_t len) {
+    File *f = open(path);
+    if (!f || len > kFileSize) return -1;
+    memcpy(f->data, buf, len);
+    if (f->size < len) f->size = len;
+    return len;
+  }
+  int append(const char *path, const void *buf, uint16_t len) {
+    File *f = open(path);
+    if (!f || f->size + len > kFileSize) return -1;
+    memcpy(f->data + f->size, buf, len);
+    f->size += len;
+    return len;
+  }
+  uint32_t size(const char *path) {
+    File *f = find(path);
+    return f ? f->size : 0;
+  }
+
+ private:
+  struct File {
+    bool used;
+    char name[16];
+    uint16_t size;
+    uint8_t data[kFileSize];
+  };
+
+  File *find(const char *path) {
+    for (uint8_t i = 0; i < kFiles; i++) {
+      if (files_[i].used && strcmp(files_[i].name, path) == 0) {
+        return &files_[i];
+      }
+    }
+    return NULL;
+  }
+  File *open(const char *path) {
+    File *f = find(path);
+    for (uint8_t i = 0; !f && i < kFiles; i++) {
+      if (!files_[i].used) {
+        f = &files_[i];
+        f->used = true;
+        f->size = 0;
+        strncpy(f->name, path, sizeof(f->name) - 1);
+        f->name[sizeof(f->name) - 1] = '\0';
+      }
+    }
+    return f;
+  }
+
+  File files_[kFiles];
+};
+
+// Answers text mode, the body prompt and each body, from a fixed buffer.
+class FixedModem : public ByteStream {
+ public:
+  FixedModem() : head_(0), tail_(0), len_(0), inBody_(false), messages_(0) {}
+
+  int available() { return tail_ - head_; }
+  int read() { return head_ < tail_ ? rx_[head_++] : -1; }
+  size_t write(const uint8_t *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) take(buf[i]);
+    return n;
+  }
+  using ByteStream::write;
+
+  uint32_t messages() const { return messages_; }
+
+ private:
+  void take(char c) {
+    if (inBody_) {
+      if (c == 26) {
+        messages_++;
+        reply("\r\n+CMGS: 1\r\n\r\nOK\r\n");
+      }
+      if (c == 26 || c == 27) inBody_ = false;
+      return;
+    }
+    if (c != '\r') {
+      if (len_ < sizeof(line_) - 1) line_[len_++] = c;
+      return;
+    }
+    line_[len_] = '\0';
+    if (strncmp(line_, "AT+CMGS=", 8) == 0) {
+      reply("> ");
+      inBody_ = true;
+    } else {
+      reply("\r\nOK\r\n");
+    }
+    len_ = 0;
+  }
+  void reply(const char *s) {
+    if (head_ == tail_) head_ = tail_ = 0;
+    size_t n = strlen(s);
+    if (tail_ + n > sizeof(rx_)) return;
+    memcpy(rx_ + tail_, s, n);
+    tail_ += n;
+  }
+
+  char rx_[256];
+  size_t head_, tail_;
+  char line_[64];
+  size_t len_;
+  bool inBody_;
+  uint32_t messages_;
+};
+
+static SimClock clock(0);
+
+// Picks the pill up 20 s after the servo closes, for 400 ms.
+class FixedPatient : public PresenceSensor {
+ public:
+  FixedPatient() : count_(0) {}
+  void pillDropped() {
+    uint32_t at = clock.millis() + 20000;
+    if (count_ + 2 > kMax) return;
+    edges_[count_].at = at;
+    edges_[count_++].active = true;
+    edges_[count_].at = at + 400;
+    edges_[count_++].active = false;
+  }
+  bool nextEdge(SensorEdge &edge) {
+    if (count_ == 0 || (int32_t)(clock.millis() - edges_[0].at) < 0) {
+      return false;
+    }
+    edge = edges_[0];
+    memmove(edges_, edges_ + 1, --count_ * sizeof(edges_[0]));
+    return true;
+  }
+  uint32_t nextAt() const { return count_ ? edges_[0].at : 0; }
+  bool waiting() const { return count_ > 0; }
+
+ private:
+  static const uint8_t kMax = 8;
+  SensorEdge edges_[kMax];
+  uint8_t count_;
+};
+
+static FixedPatient patient;
+
+class FixedServo : public Actuator {
+ public:
+  FixedServo() : angle_(0) {}
+  void write(uint8_t angle) {
+    if (angle_ != 0 && angle == 0) patient.pillDropped();
+    angle_ = angle;
+  }
+  void detach() {}
+
+ private:
+  uint8_t angle_;
+};
+
+static uint32_t taken;
+static void onDose(void *, uint8_t, DoseEvent type, uint32_t, uint32_t) {
+  if (type == EVENT_TAKEN) taken++;
+}
+
+static void restart() {}
+
+static NullDisplay lcd;
+static FixedServo servo0, servo1;
+static FakeIndicator buzzer, led;
+static FixedFileStore files;
+static MemEeprom *eeprom;
+static NullLink console, bluetooth;
+static FixedModem gsm;
+
+void setUp() {}
+void tearDown() {}
+
+static void test_no_allocation_after_setup() {
+  DateTime start = {2025, 1, 1, 6, 0, 0};
+  clock = SimClock(toEpoch(start));
+  simClock = &clock;
+  eeprom = new MemEeprom;
+
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 7;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 21;
+  t[1].active = true;
+  TEST_ASSERT_TRUE(
+      ScheduleStore<kCompartments>(files).save(t, "+639170000000"));
+
+  DispenserIo io = {simMillis, clock,   lcd,     {&servo0, &servo1},
+                    buzzer,    led,     patient, files,
+                    *eeprom,   console, bluetooth, gsm,
+                    restart};
+  Dispenser *d = new Dispenser(io);
+  d->setDoseObserver(onDose, NULL);
+  d->begin();
+
+  heapSealed = true;
+  uint32_t end = 3 * 86400000UL;
+  while (clock.millis() < end) {
+    d->loop();
+    uint32_t budget = d->idleBudget();
+    if (budget == 0) budget = 1;
+    if (patient.waiting() && patient.nextAt() > clock.millis() &&
+        patient.nextAt() - clock.millis() < budget) {
+      budget = patient.nextAt() - clock.millis();
+    }
+    clock.advance(budget);
+  }
+  d->flushLogs();
+  heapSealed = false;
+
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, d->state());
+  TEST_ASSERT_EQUAL_UINT32(3 * 4, taken);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, gsm.messages());
+  TEST_ASSERT_EQUAL_UINT32(0, lateAllocs);
+  delete d;
+}
+
+// The hook itself works: a stray allocation while sealed is seen.
+static void test_hook_counts() {
+  heapSealed = true;
+  int *p = new int(3);
+  void *q = malloc(16);
+  heapSealed = false;
+  uint32_t seen = lateAllocs;
+  delete p;
+  free(q);
+#ifdef __GLIBC__
+  TEST_ASSERT_EQUAL_UINT32(2, seen);
+#else
+  TEST_ASSERT_EQUAL_UINT32(1, seen);
+#endif
+  lateAllocs = 0;
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_allocation_after_setup);
+  RUN_TEST(test_hook_counts);
+  return UNITY_END();
+}
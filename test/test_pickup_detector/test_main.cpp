@@ -0,0 +1,240 @@
+// Pickup detection on synthetic noisy waveforms: spurious blips are
+// rejected, dropouts and release bounces are ridden out, every real pickup
+// confirms exactly once at the moment the beam broke, and none of it depends
+// on how late the main loop gets to the edge queue.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "PickupDetector.h"
+#include "native/Simulator.h"
+
+static uint32_t seed;
+static uint32_t random(uint32_t n) {
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 8) % n;
+}
+
+struct Waveform {
+  std::vector<SensorEdge> edges;
+  std::vector<uint32_t> pickups;  // when each real pickup broke the beam
+  uint32_t blips;                 // spurious pulses, all to be rejected
+};
+
+static void pulse(Waveform &w, uint32_t at, uint32_t len) {
+  SensorEdge on = {at, true}, off = {at + len, false};
+  w.edges.push_back(on);
+  w.edges.push_back(off);
+}
+
+// `trials` pickups, each after up to three blips too short to hold, with
+// dropouts shorter than the debounce while the hand is there and bounces
+// of the same length as it leaves. Timestamps start just short of the
+// millis() wrap.
+static Waveform noisyPickups(uint32_t trials, uint16_t debounce,
+                             uint16_t hold) {
+  Waveform w;
+  w.blips = 0;
+  uint32_t t = 0xFFFFFFFFUL - 200000;
+  for (uint32_t k = 0; k < trials; k++) {
+    for (uint32_t n = random(4); n > 0; n--) {
+      t += debounce + 1 + random(2000);
+      uint32_t len = 1 + random(hold - 1);
+      pulse(w, t, len);
+      t += len;
+      w.blips++;
+    }
+    t += debounce + 1 + random(2000);
+    w.pickups.push_back(t);
+    uint32_t end = t + hold + random(1000);
+    SensorEdge on = {t, true};
+    w.edges.push_back(on);
+    for (uint32_t n = random(5); n > 0; n--) {
+      uint32_t gap = 1 + random(debounce - 1);
+      t += 1 + random(hold / 2);
+      if (t + gap >= end) break;
+      SensorEdge off = {t, false}, back = {t + gap, true};
+      w.edges.push_back(off);
+      w.edges.push_back(back);
+      t += gap;
+    }
+    t = end;
+    SensorEdge off = {t, false};
+    w.edges.push_back(off);
+    for (uint32_t n = random(4); n > 0; n--) {
+      t += 1 + random(debounce - 1);
+      uint32_t len = 1 + random(debounce - 1);
+      pulse(w, t, len);
+      t += len;
+    }
+    t += debounce;
+  }
+  return w;
+}
+
+// Plays `w` through the edge queue with the main loop getting to it every
+// `pollMs`, and returns the confirmed pickup times.
+static std::vector<uint32_t> play(const Waveform &w, PickupDetector &detector,
+                                  uint32_t pollMs) {
+  EdgeQueue<64> queue;
+  std::vector<uint32_t> taken;
+  size_t next = 0;
+  uint32_t now = w.edges.front().at;
+  uint32_t end = w.edges.back().at + 1000;
+  while ((int32_t)(end - now) > 0) {
+    now += pollMs;
+    // The interrupt side: every edge up to now, stamped when it happened.
+    while (next < w.edges.size() && (int32_t)(w.edges[next].at - now) <= 0) {
+      TEST_ASSERT_TRUE(queue.push(w.edges[next].at, w.edges[next].active));
+      next++;
+    }
+    SensorEdge e;
+    while (queue.pop(e)) detector.edge(e.at, e.active);
+    detector.advance(now);
+    uint32_t at;
+    while (detector.take(at)) taken.push_back(at);
+  }
+  TEST_ASSERT_EQUAL_UINT32(w.edges.size(), next);
+  TEST_ASSERT_EQUAL_UINT16(0, queue.overflows());
+  return taken;
+}
+
+void setUp() { seed = 1; }
+void tearDown() {}
+
+static void test_noisy_pickups_confirm_once_each() {
+  Waveform w = noisyPickups(1000, PICKUP_DEBOUNCE_MS, PICKUP_HOLD_MS);
+  PickupDetector detector;
+  std::vector<uint32_t> taken = play(w, detector, 1);
+  TEST_ASSERT_EQUAL_UINT32(w.pickups.size(), taken.size());
+  for (size_t i = 0; i < taken.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(w.pickups[i], taken[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT16(w.blips, detector.rejected());
+  TEST_ASSERT_GREATER_THAN_UINT32(1000, detector.bounces());
+  TEST_ASSERT_EQUAL_INT(PickupDetector::WAITING, detector.state());
+}
+
+// The same waveform read every 10 ms or every quarter second gives the same
+// pickups at the same times.
+static void test_result_does_not_depend_on_loop_rate() {
+  Waveform w = noisyPickups(300, PICKUP_DEBOUNCE_MS, PICKUP_HOLD_MS);
+  PickupDetector fast, slow;
+  std::vector<uint32_t> a = play(w, fast, 10);
+  std::vector<uint32_t> b = play(w, slow, 250);
+  TEST_ASSERT_EQUAL_UINT32(w.pickups.size(), a.size());
+  TEST_ASSERT_TRUE(a == b);
+  TEST_ASSERT_TRUE(a == w.pickups);
+  TEST_ASSERT_EQUAL_UINT16(fast.rejected(), slow.rejected());
+  TEST_ASSERT_EQUAL_UINT16(fast.bounces(), slow.bounces());
+}
+
+// A pulse confirms if it lasts the hold time, not a millisecond less.
+static void test_hold_boundary() {
+  PickupDetector detector;
+  uint32_t at;
+  detector.edge(1000, true);
+  TEST_ASSERT_EQUAL_INT(PickupDetector::DETECTED, detector.state());
+  TEST_ASSERT_EQUAL_UINT32(PICKUP_HOLD_MS, detector.msUntilChange(1000));
+  detector.edge(1000 + PICKUP_HOLD_MS - 1, false);
+  TEST_ASSERT_EQUAL_UINT32(PICKUP_DEBOUNCE_MS,
+                           detector.msUntilChange(1000 + PICKUP_HOLD_MS - 1));
+  detector.advance(5000);
+  TEST_ASSERT_FALSE(detector.take(at));
+  TEST_ASSERT_EQUAL_UINT16(1, detector.rejected());
+  TEST_ASSERT_EQUAL_UINT32(PickupDetector::kNever,
+                           detector.msUntilChange(5000));
+
+  detector.edge(6000, true);
+  detector.edge(6000 + PICKUP_HOLD_MS, false);
+  TEST_ASSERT_EQUAL_INT(PickupDetector::CONFIRMED, detector.state());
+  TEST_ASSERT_TRUE(detector.take(at));
+  TEST_ASSERT_EQUAL_UINT32(6000, at);
+  TEST_ASSERT_FALSE(detector.take(at));
+}
+
+// Debounce and hold are per detector: a 60 ms pulse is a pickup at 10/50
+// and noise at the defaults, and a 15 ms gap splits it at 10 ms debounce.
+static void test_configurable_timing() {
+  uint32_t at;
+  PickupDetector quick(10, 50), standard;
+  quick.edge(0, true);
+  standard.edge(0, true);
+  quick.edge(60, false);
+  standard.edge(60, false);
+  quick.advance(200);
+  standard.advance(200);
+  TEST_ASSERT_TRUE(quick.take(at));
+  TEST_ASSERT_FALSE(standard.take(at));
+
+  PickupDetector split(10, 50);
+  split.edge(1000, true);
+  split.edge(1040, false);
+  split.edge(1055, true);
+  split.edge(1095, false);
+  split.advance(2000);
+  TEST_ASSERT_FALSE(split.take(at));
+  TEST_ASSERT_EQUAL_UINT16(2, split.rejected());
+  TEST_ASSERT_EQUAL_UINT16(0, split.bounces());
+}
+
+static void test_edge_queue() {
+  EdgeQueue<4> queue;
+  TEST_ASSERT_TRUE(queue.push(1, true));
+  TEST_ASSERT_TRUE(queue.push(2, false));
+  TEST_ASSERT_TRUE(queue.push(3, true));
+  TEST_ASSERT_FALSE(queue.push(4, false));  // one slot is kept free
+  TEST_ASSERT_EQUAL_UINT16(1, queue.overflows());
+  SensorEdge e;
+  for (uint32_t i = 1; i <= 3; i++) {
+    TEST_ASSERT_TRUE(queue.pop(e));
+    TEST_ASSERT_EQUAL_UINT32(i, e.at);
+    TEST_ASSERT_EQUAL(i % 2 == 1, e.active);
+  }
+  TEST_ASSERT_FALSE(queue.pop(e));
+  TEST_ASSERT_TRUE(queue.push(5, true));
+  TEST_ASSERT_TRUE(queue.pop(e));
+  TEST_ASSERT_EQUAL_UINT32(5, e.at);
+}
+
+// On the device, a week of noisy pickups: every dose is taken, the blips
+// are rejected, and the `ir` command reports the latency histogram, which
+// sits at the hold time because the loop wakes for the deadline.
+static void test_device_reports_latency() {
+  SimConfig config = defaultSimConfig();
+  config.days = 7;
+  config.patient.noisePulses = 3;
+  config.patient.bounces = 3;
+  config.patient.jitterMs = 60000;
+  FILE *trace = tmpfile();
+  DeviceSim sim(config, trace);
+  sim.run();
+  fclose(trace);
+  TEST_ASSERT_EQUAL_UINT32(28, sim.totals().events[EVENT_TAKEN]);
+
+  const Log2Histogram<12> &h = sim.dispenser().pickupLatency();
+  TEST_ASSERT_EQUAL_UINT32(28, h.total());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(PICKUP_HOLD_MS, h.min());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(PICKUP_HOLD_MS + 10, h.max());
+
+  sim.console().output().clear();
+  sim.console().send("ir\n");
+  sim.dispenser().loop();
+  const std::string &out = sim.console().output();
+  TEST_ASSERT_TRUE(out.find("ir pickups=28 stray=0") != std::string::npos);
+  TEST_ASSERT_TRUE(out.find("rejected=0") == std::string::npos);
+  TEST_ASSERT_TRUE(out.find("  >=128ms 28") != std::string::npos);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_noisy_pickups_confirm_once_each);
+  RUN_TEST(test_result_does_not_depend_on_loop_rate);
+  RUN_TEST(test_hold_boundary);
+  RUN_TEST(test_configurable_timing);
+  RUN_TEST(test_edge_queue);
+  RUN_TEST(test_device_reports_latency);
+  return UNITY_END();
+}
@@ -0,0 +1,80 @@
+// Idle behaviour on the simulator: how often the firmware wakes between
+// doses, when it may power down, and the PowerStats charge estimate.
+#include <unity.h>
+
+#include "PowerStats.h"
+#include "native/Simulator.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Steps `sim` until `seconds` into the run; returns the loop passes taken.
+static uint32_t runTo(DeviceSim &sim, uint32_t seconds) {
+  uint32_t passes = 0;
+  while (sim.elapsedSeconds() < seconds && sim.step()) passes++;
+  return passes;
+}
+
+// The simulator starts at 06:00 with the first dose at 07:00. From 08:00 the
+// next dose is hours away: the only wake is the LCD clock on each minute
+// boundary, against one per second for the old delay(1000) loop.
+static void test_wakes_once_a_minute_between_doses() {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  DeviceSim sim(config, NULL);
+  runTo(sim, 2 * 3600);
+  TEST_ASSERT_TRUE(sim.dispenser().canPowerDown());
+
+  uint32_t wakes = runTo(sim, 3 * 3600);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(60, wakes);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(62, wakes);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(60000, sim.dispenser().idleBudget());
+}
+
+// A whole day, doses included, against the 86400 wakes of a 1 s loop.
+static void test_wakes_per_day() {
+  SimConfig config = defaultSimConfig();
+  config.days = 7;
+  DeviceSim sim(config, NULL);
+  sim.run();
+  uint32_t perDay = sim.totals().loops / config.days;
+  TEST_ASSERT_EQUAL_UINT32(7 * 4, sim.totals().events[EVENT_TAKEN]);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(86400 / 40, perDay);
+}
+
+// While a dose waits for the patient the servo and beeper tasks need timer0,
+// so the board may only idle, not power down.
+static void test_no_power_down_with_a_dose_in_flight() {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  config.patient.pickupMs = 10 * 60000UL;
+  DeviceSim sim(config, NULL);
+  runTo(sim, 3600 + 60);  // 07:01, pill in the tray
+  TEST_ASSERT_FALSE(sim.dispenser().canPowerDown());
+  runTo(sim, 3600 + 15 * 60);  // taken at 07:10
+  TEST_ASSERT_TRUE(sim.dispenser().canPowerDown());
+}
+
+static void test_charge_estimate() {
+  PowerStats p;
+  p.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, p.chargeUah());
+  p.activeMs = 3600000UL;
+  TEST_ASSERT_EQUAL_UINT32(PowerStats::kActiveUa, p.chargeUah());
+  p.reset();
+  p.powerDownMs = 24 * 3600000UL;  // a day asleep
+  TEST_ASSERT_EQUAL_UINT32(24 * PowerStats::kPowerDownUa, p.chargeUah());
+
+  p.wakes[PowerStats::WAKE_WATCHDOG] = 3;
+  p.wakes[PowerStats::WAKE_SERIAL] = 2;
+  TEST_ASSERT_EQUAL_UINT32(5, p.totalWakes());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_wakes_once_a_minute_between_doses);
+  RUN_TEST(test_wakes_per_day);
+  RUN_TEST(test_no_power_down_with_a_dose_in_flight);
+  RUN_TEST(test_charge_estimate);
+  return UNITY_END();
+}
@@ -0,0 +1,260 @@
+// Provisioning frames through a fake 9600-baud UART: a clean round trip,
+// throughput against the old field-per-line handshake, and a fuzz run of
+// damaged frames after each of which the next clean frame must get through.
+#include <unity.h>
+
+#include <deque>
+
+#include "Crc.h"
+#include "Dispenser.h"
+#include "Provision.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+
+// 8N1 at 9600 baud: ten bit times, 1.04 ms, per byte.
+static const uint32_t kBaud = 9600;
+
+// The Bluetooth module's UART: bytes the app sends become readable one
+// character time after the previous one.
+class BaudUart : public ByteStream {
+ public:
+  BaudUart() : lineFreeUs_(0) {}
+
+  void send(const uint8_t *p, size_t len) {
+    uint64_t nowUs = clock.elapsedMs() * 1000;
+    if (lineFreeUs_ < nowUs) lineFreeUs_ = nowUs;
+    for (size_t i = 0; i < len; i++) {
+      lineFreeUs_ += 10 * 1000000ULL / kBaud;
+      Byte b = {lineFreeUs_, p[i]};
+      wire_.push_back(b);
+    }
+  }
+  int available() {
+    uint64_t nowUs = clock.elapsedMs() * 1000;
+    int n = 0;
+    for (size_t i = 0; i < wire_.size() && wire_[i].at <= nowUs; i++) n++;
+    return n;
+  }
+  int read() {
+    if (!available()) return -1;
+    uint8_t b = wire_.front().value;
+    wire_.pop_front();
+    return b;
+  }
+  size_t write(const uint8_t *, size_t len) { return len; }
+  using ByteStream::write;
+
+  bool empty() const { return wire_.empty(); }
+
+ private:
+  struct Byte {
+    uint64_t at;  // microseconds
+    uint8_t value;
+  };
+  std::deque<Byte> wire_;
+  uint64_t lineFreeUs_;
+};
+
+static uint32_t seed;
+static uint32_t random(uint32_t n) {
+  seed = seed * 1103515245UL + 12345;
+  return (seed >> 16) % n;
+}
+
+static ScheduleTable<kCompartments> sampleTable(uint32_t v) {
+  ScheduleTable<kCompartments> t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = t[0].nextHour = 7;
+  t[0].dosesTaken = v % 5;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 21;
+  t[1].nextDue = v;
+  t[1].active = true;
+  return t;
+}
+
+// A whole FRAME_SCHEDULE for schedule `v`; returns its size.
+static size_t scheduleFrame(uint32_t v, uint8_t *frame) {
+  uint8_t payload[kFrameMaxPayload];
+  uint16_t len = encodeProvision(sampleTable(v), "+639170000000", payload);
+  return encodeFrame(FRAME_SCHEDULE, payload, len, frame);
+}
+
+// Reads the UART every `pollMs`, as loop() does, until a frame is ready or
+// the line goes quiet. Returns the parser's last result.
+static FrameParser::Result pump(BaudUart &uart, FrameParser &parser,
+                                uint32_t pollMs) {
+  FrameParser::Result last = FrameParser::FRAME_NONE;
+  while (!uart.empty()) {
+    while (uart.available()) {
+      last = parser.feed(uart.read(), clock.millis());
+      if (last == FrameParser::FRAME_READY) return last;
+    }
+    clock.advance(pollMs);
+  }
+  return last;
+}
+
+void setUp() {
+  clock = SimClock(0);
+  seed = 1;
+}
+
+void tearDown() {}
+
+static void test_round_trip() {
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  size_t n = scheduleFrame(42, frame);
+  FrameParser parser;
+  for (size_t i = 0; i + 1 < n; i++) {
+    TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_NONE, parser.feed(frame[i], 0));
+  }
+  TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_READY,
+                        parser.feed(frame[n - 1], 0));
+  TEST_ASSERT_EQUAL_UINT8(FRAME_SCHEDULE, parser.type());
+
+  ScheduleTable<kCompartments> t;
+  char contact[kContactLen];
+  TEST_ASSERT_TRUE(
+      decodeProvision(parser.payload(), parser.length(), t, contact));
+  TEST_ASSERT_EQUAL_STRING("+639170000000", contact);
+  TEST_ASSERT_EQUAL_STRING("Metformin", t.name(1));
+  TEST_ASSERT_EQUAL_UINT32(42, t[1].nextDue);
+  TEST_ASSERT_EQUAL_UINT16(480, t[0].interval);
+}
+
+// The whole schedule in one frame lands in its wire time plus one poll. The
+// old handshake waited for about 20 separate lines, each one a round trip.
+static void test_throughput_at_9600_baud() {
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  size_t n = scheduleFrame(1, frame);
+  BaudUart uart;
+  FrameParser parser;
+  uart.send(frame, n);
+  TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_READY, pump(uart, parser, 10));
+  uint32_t wireMs = (n * 10 * 1000 + kBaud - 1) / kBaud;
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(wireMs + 10, clock.millis());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(150, clock.millis());
+
+  // Back to back, frames go at line rate: 960 bytes a second.
+  uint32_t start = clock.millis();
+  for (uint32_t i = 0; i < 20; i++) {
+    uart.send(frame, n);
+    TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_READY, pump(uart, parser, 10));
+  }
+  uint32_t bytesPerSecond = 20 * n * 1000 / (clock.millis() - start);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(900, bytesPerSecond);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(kBaud / 10, bytesPerSecond);
+}
+
+// Damage one frame (flip, drop or insert bytes, cut it short, or prefix
+// line noise), then send a clean one the way the app resends: right away
+// after a NAK, or after the byte timeout when nothing came back. A damaged
+// frame must never be accepted, and the clean one always must be.
+static void test_fuzz_damaged_frames() {
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead + 16];
+  uint8_t clean[kFrameMaxPayload + kFrameOverhead];
+  BaudUart uart;
+  FrameParser parser;
+  uint32_t naks = 0, timeouts = 0;
+  for (uint32_t round = 1; round <= 2000; round++) {
+    size_t n = scheduleFrame(round, frame);
+    switch (random(5)) {
+      case 0:  // bit flips
+        for (uint32_t k = 1 + random(3); k > 0; k--) {
+          frame[random(n)] ^= 1 << random(8);
+        }
+        break;
+      case 1:  // a dropped byte
+        if (n > 1) {
+          size_t at = random(n);
+          memmove(frame + at, frame + at + 1, n - at - 1);
+          n--;
+        }
+        break;
+      case 2: {  // an extra byte
+        size_t at = 1 + random(n - 1);
+        memmove(frame + at + 1, frame + at, n - at);
+        frame[at] = random(256);
+        n++;
+        break;
+      }
+      case 3:  // cut short
+        n = 1 + random(n - 1);
+        break;
+      default: {  // noise ahead of an intact frame: must be skipped
+        uint8_t noise = 1 + random(16);
+        memmove(frame + noise, frame, n);
+        for (uint8_t i = 0; i < noise; i++) {
+          frame[i] = random(256);
+          if (frame[i] == kFrameSof) frame[i] = 0;
+        }
+        n += noise;
+        break;
+      }
+    }
+    uart.send(frame, n);
+    FrameParser::Result r = pump(uart, parser, 10);
+    if (r == FrameParser::FRAME_READY) {
+      // Only an intact frame may get through.
+      uint8_t expect[kFrameMaxPayload + kFrameOverhead];
+      size_t en = scheduleFrame(round, expect);
+      TEST_ASSERT_EQUAL_UINT16(en - kFrameOverhead, parser.length());
+      TEST_ASSERT_EQUAL_INT(0, memcmp(expect + 5, parser.payload(),
+                                      parser.length()));
+      continue;
+    }
+    if (r == FrameParser::FRAME_ERROR) naks++;
+    if (!parser.idle()) {
+      clock.advance(500);
+      TEST_ASSERT_TRUE(parser.expire(clock.millis()));
+      timeouts++;
+    }
+    size_t cn = scheduleFrame(round + 100000, clean);
+    uart.send(clean, cn);
+    TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_READY, pump(uart, parser, 10));
+    ScheduleTable<kCompartments> t;
+    char contact[kContactLen];
+    TEST_ASSERT_TRUE(
+        decodeProvision(parser.payload(), parser.length(), t, contact));
+    TEST_ASSERT_EQUAL_UINT32(round + 100000, t[1].nextDue);
+  }
+  TEST_ASSERT_GREATER_THAN_UINT32(0, naks);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, timeouts);
+}
+
+static void test_rejects_oversized_and_unknown_version() {
+  FrameParser parser;
+  const uint8_t tooLong[] = {kFrameSof, kFrameVersion, FRAME_SCHEDULE,
+                             (kFrameMaxPayload + 1) & 0xFF,
+                             (kFrameMaxPayload + 1) >> 8};
+  FrameParser::Result r = FrameParser::FRAME_NONE;
+  for (size_t i = 0; i < sizeof(tooLong); i++) r = parser.feed(tooLong[i], 0);
+  TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_ERROR, r);
+  TEST_ASSERT_EQUAL_INT(NAK_LENGTH, parser.error());
+
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  uint8_t ack = NAK_NONE;
+  size_t n = encodeFrame(FRAME_ACK, &ack, 1, frame);
+  frame[1] = kFrameVersion + 1;  // a newer app, checksummed correctly
+  uint16_t crc = crc16(frame + 1, n - 3);
+  frame[n - 2] = crc & 0xFF;
+  frame[n - 1] = crc >> 8;
+  for (size_t i = 0; i < n; i++) r = parser.feed(frame[i], 0);
+  TEST_ASSERT_EQUAL_INT(FrameParser::FRAME_ERROR, r);
+  TEST_ASSERT_EQUAL_INT(NAK_VERSION, parser.error());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_throughput_at_9600_baud);
+  RUN_TEST(test_fuzz_damaged_frames);
+  RUN_TEST(test_rejects_oversized_and_unknown_version);
+  return UNITY_END();
+}
@@ -0,0 +1,329 @@
+// Binary schedule image: round trip, corruption, the single block write,
+// a side-by-side benchmark against the old USERINFO.txt CSV, and migration
+// of both old CSV layouts on boot.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+
+#include "ScheduleFile.h"
+#include "ScheduleStore.h"
+#include "native/Simulator.h"
+
+typedef ScheduleTable<kCompartments> Table;
+
+static Table sample() {
+  Table t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = 7;
+  t[0].nextHour = 15;
+  t[0].nextDue = 789000000UL;
+  t[0].dosesTaken = 1;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = t[1].nextHour = 21;
+  t[1].active = true;
+  return t;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_image_round_trip() {
+  ScheduleImage<kCompartments> img;
+  encodeSchedule(sample(), "+639170000000", 7, img);
+  TEST_ASSERT_TRUE(validSchedule(img));
+
+  Table t;
+  char contact[kContactLen];
+  TEST_ASSERT_TRUE(decodeSchedule(img, t, contact));
+  TEST_ASSERT_EQUAL_STRING("+639170000000", contact);
+  TEST_ASSERT_EQUAL_STRING("Losartan", t.name(0));
+  TEST_ASSERT_EQUAL_STRING("Metformin", t.name(1));
+  TEST_ASSERT_EQUAL_UINT16(480, t[0].interval);
+  TEST_ASSERT_EQUAL_UINT32(789000000UL, t[0].nextDue);
+  TEST_ASSERT_EQUAL_UINT8(15, t[0].nextHour);
+  TEST_ASSERT_EQUAL_UINT8(1, t[0].dosesTaken);
+  TEST_ASSERT_TRUE(t[1].active);
+  TEST_ASSERT_EQUAL_UINT8(21, t[1].baseHour);
+}
+
+// Any one damaged byte, header or record, makes the image unusable. The
+// header's reserved byte sits ahead of the CRC and is never read.
+static void test_every_damaged_byte_is_rejected() {
+  ScheduleImage<kCompartments> img;
+  encodeSchedule(sample(), "+639170000000", 7, img);
+  uint8_t *p = reinterpret_cast<uint8_t *>(&img);
+  size_t reserved = offsetof(ScheduleHeader, reserved);
+  for (size_t i = 0; i < sizeof(img); i++) {
+    if (i == reserved) continue;
+    p[i] ^= 0x5A;
+    TEST_ASSERT_FALSE(validSchedule(img));
+    p[i] ^= 0x5A;
+  }
+  TEST_ASSERT_TRUE(validSchedule(img));
+}
+
+static void test_other_layouts_are_rejected() {
+  ScheduleImage<kCompartments> img;
+  encodeSchedule(sample(), "+639170000000", 7, img);
+  img.header.version = kScheduleVersion + 1;
+  img.header.crc = scheduleCrc(img.header, sizeof(img));
+  TEST_ASSERT_FALSE(validSchedule(img));
+
+  encodeSchedule(sample(), "+639170000000", 7, img);
+  img.header.count = kCompartments + 1;
+  img.header.crc = scheduleCrc(img.header, sizeof(img));
+  TEST_ASSERT_FALSE(validSchedule(img));
+}
+
+// One open and one write of a fixed-size block per save, where the CSV
+// version removed, recreated and printed field by field.
+static void test_save_is_one_block_write() {
+  MemFileStore fs;
+  ScheduleStore<kCompartments> store(fs);
+  TEST_ASSERT_TRUE(store.save(sample(), "+639170000000"));
+  uint32_t opens = fs.opens(), ops = fs.writeOps(), bytes = fs.bytesWritten();
+  TEST_ASSERT_TRUE(store.save(sample(), "+639170000000"));
+  TEST_ASSERT_EQUAL_UINT32(1, fs.opens() - opens);
+  TEST_ASSERT_EQUAL_UINT32(1, fs.writeOps() - ops);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(ScheduleImage<kCompartments>),
+                           fs.bytesWritten() - bytes);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(ScheduleHeader) +
+                               kCompartments * sizeof(CompartmentRecord),
+                           sizeof(ScheduleImage<kCompartments>));
+}
+
+// The old saveSched()'s open File: every print() is a call into the SD
+// library, whose 512-byte cache reaches the card as one write on close.
+class CsvFile : public ByteStream {
+ public:
+  CsvFile() : calls_(0) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  size_t write(const uint8_t *buf, size_t len) {
+    calls_++;
+    text_.append((const char *)buf, len);
+    return len;
+  }
+  void close(FileStore &fs, const char *path) {
+    fs.write(path, text_.data(), text_.size());
+  }
+  uint32_t calls() const { return calls_; }
+
+ private:
+  uint32_t calls_;
+  std::string text_;
+};
+
+// Both ways of reading a schedule back, each timed over `rounds` boots.
+static double csvLoadUs(MemFileStore &fs, uint32_t rounds) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < rounds; k++) {
+    char line[24 + kCompartments * 72];
+    int got = fs.read("USERINFO.txt", line, sizeof(line) - 1);
+    TEST_ASSERT_TRUE(got > 0);
+    uint16_t len = 0;
+    for (int i = 0; i < got && line[i] != '\n'; i++) {
+      if (line[i] != '\r') line[len++] = line[i];
+    }
+    line[len] = '\0';
+    Table t;
+    char contact[kContactLen];
+    TEST_ASSERT_TRUE(decodeScheduleCsv(line, t, contact));
+  }
+  std::chrono::duration<double, std::micro> took =
+      std::chrono::steady_clock::now() - start;
+  return took.count() / rounds;
+}
+
+// Parsing alone, from a line or an image already in RAM.
+static double csvParseUs(const char *text, uint32_t rounds) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < rounds; k++) {
+    char line[24 + kCompartments * 72];
+    strncpy(line, text, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    Table t;
+    char contact[kContactLen];
+    TEST_ASSERT_TRUE(decodeScheduleCsv(line, t, contact));
+  }
+  std::chrono::duration<double, std::micro> took =
+      std::chrono::steady_clock::now() - start;
+  return took.count() / rounds;
+}
+
+static double binaryParseUs(const ScheduleImage<kCompartments> &img,
+                            uint32_t rounds) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < rounds; k++) {
+    Table t;
+    char contact[kContactLen];
+    TEST_ASSERT_TRUE(decodeSchedule(img, t, contact));
+  }
+  std::chrono::duration<double, std::micro> took =
+      std::chrono::steady_clock::now() - start;
+  return took.count() / rounds;
+}
+
+static double binaryLoadUs(MemFileStore &fs, uint32_t rounds) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < rounds; k++) {
+    ScheduleStore<kCompartments> store(fs);
+    Table t;
+    char contact[kContactLen];
+    TEST_ASSERT_TRUE(store.load(t, contact));
+  }
+  std::chrono::duration<double, std::micro> took =
+      std::chrono::steady_clock::now() - start;
+  return took.count() / rounds;
+}
+
+// The same schedule saved and loaded both ways. The CSV save checked for
+// the file, deleted it, and printed the line field by field; the image is
+// one block write. Both load back the same table. Host timings are
+// reported, not asserted: they say nothing about an AVR and would make the
+// test flaky. On the host the CSV parses faster; the image pays for its
+// CRC, and a load reads and checks both A/B slots.
+static void test_binary_against_csv() {
+  Table want = sample();
+  const char *contact = "+639170000000";
+
+  MemFileStore csvFs;
+  csvFs.write("USERINFO.txt", "stale", 5);
+  uint32_t csvOps = csvFs.opens();
+  TEST_ASSERT_TRUE(csvFs.exists("USERINFO.txt"));
+  TEST_ASSERT_TRUE(csvFs.remove("USERINFO.txt"));
+  CsvFile file;
+  Printer out(file);
+  printScheduleCsv(out, want, contact);
+  file.close(csvFs, "USERINFO.txt");
+  csvOps = 2 + csvFs.opens() - csvOps;  // and the exists() and remove()
+  uint32_t csvBytes = csvFs.size("USERINFO.txt");
+
+  MemFileStore binFs;
+  ScheduleStore<kCompartments> store(binFs);
+  TEST_ASSERT_TRUE(store.save(want, contact));  // as the CSV, a resave
+  uint32_t binOps = binFs.opens(), binBytes = binFs.bytesWritten();
+  TEST_ASSERT_TRUE(store.save(want, contact));
+  binOps = binFs.opens() - binOps;
+  binBytes = binFs.bytesWritten() - binBytes;
+
+  TEST_ASSERT_EQUAL_UINT32(1, binOps);
+  TEST_ASSERT_GREATER_THAN_UINT32(binOps, csvOps);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(ScheduleImage<kCompartments>), binBytes);
+  TEST_ASSERT_GREATER_THAN_UINT32(2 + kCompartments * 22, file.calls());
+  // Byte for byte they are close: the image pads names and contact to
+  // fixed widths. Either way it is one data sector on the card.
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(512, csvBytes);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(512, binBytes);
+
+  // Same table out of both, nextDue and all.
+  char line[24 + kCompartments * 72];
+  int got = csvFs.read("USERINFO.txt", line, sizeof(line) - 1);
+  line[got - 2] = '\0';  // "\r\n"
+  std::string text(line);
+  Table fromCsv, fromBin;
+  char c1[kContactLen], c2[kContactLen];
+  TEST_ASSERT_TRUE(decodeScheduleCsv(line, fromCsv, c1));
+  TEST_ASSERT_TRUE(store.load(fromBin, c2));
+  TEST_ASSERT_EQUAL_STRING(c1, c2);
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    TEST_ASSERT_EQUAL_STRING(fromCsv.name(i), fromBin.name(i));
+    TEST_ASSERT_EQUAL_UINT32(fromCsv[i].nextDue, fromBin[i].nextDue);
+    TEST_ASSERT_EQUAL_UINT16(fromCsv[i].interval, fromBin[i].interval);
+    TEST_ASSERT_EQUAL_UINT8(fromCsv[i].nextHour, fromBin[i].nextHour);
+    TEST_ASSERT_EQUAL(fromCsv[i].active, fromBin[i].active);
+  }
+
+  const char *slot = ScheduleStore<kCompartments>::path(store.activeSlot());
+  ScheduleImage<kCompartments> img;
+  TEST_ASSERT_EQUAL_INT(sizeof(img), binFs.read(slot, &img, sizeof(img)));
+  char report[200];
+  snprintf(report, sizeof(report),
+           "save: csv %lu bytes, %lu print calls, %lu file ops; "
+           "binary %lu bytes, 1 write",
+           (unsigned long)csvBytes, (unsigned long)file.calls(),
+           (unsigned long)csvOps, (unsigned long)binBytes);
+  TEST_MESSAGE(report);
+  snprintf(report, sizeof(report),
+           "host us per schedule: parse csv %.2f, binary %.2f; "
+           "load from card csv %.2f, binary (both slots) %.2f",
+           csvParseUs(text.c_str(), 20000), binaryParseUs(img, 20000),
+           csvLoadUs(csvFs, 20000), binaryLoadUs(binFs, 20000));
+  TEST_MESSAGE(report);
+}
+
+// Boots a simulated device on `csv` as USERINFO.txt.
+static void bootOnCsv(DeviceSim &sim, const char *csv) {
+  sim.files().write("USERINFO.txt", csv, strlen(csv));
+  sim.step();
+}
+
+static void checkMigrated(DeviceSim &sim) {
+  const Table &t = sim.dispenser().schedule();
+  TEST_ASSERT_EQUAL_INT(Dispenser::DISPENSE, sim.dispenser().state());
+  TEST_ASSERT_EQUAL_STRING("Losartan", t.name(0));
+  TEST_ASSERT_EQUAL_UINT16(480, t[0].interval);
+  TEST_ASSERT_EQUAL_UINT8(3, t[0].iterations);
+  TEST_ASSERT_EQUAL_UINT8(7, t[0].baseHour);
+  TEST_ASSERT_TRUE(t[0].active);
+  TEST_ASSERT_EQUAL_STRING("Metformin", t.name(1));
+  TEST_ASSERT_EQUAL_UINT8(21, t[1].nextHour);
+  TEST_ASSERT_TRUE(t[1].active);
+  // Moved into a binary slot, and the CSV is gone.
+  TEST_ASSERT_FALSE(sim.files().exists("USERINFO.txt"));
+  TEST_ASSERT_TRUE(sim.files().exists(ScheduleStore<kCompartments>::path(0)));
+}
+
+// The original two-medicine line: med1's active flag sits after nextMinute,
+// med2 has a separate active flag and none in its own fields.
+static void test_migrates_original_csv() {
+  SimConfig config = defaultSimConfig();
+  config.provision = false;
+  DeviceSim sim(config, NULL);
+  bootOnCsv(sim,
+            "+639170000000,Losartan,480,3,7,0,7,0,1,0,0,"
+            "1,Metformin,0,1,21,0,21,0,0,0\r\n");
+  checkMigrated(sim);
+}
+
+static void test_migrates_v2_csv() {
+  SimConfig config = defaultSimConfig();
+  config.provision = false;
+  DeviceSim sim(config, NULL);
+  bootOnCsv(sim,
+            "V2,+639170000000,1,Losartan,480,3,7,0,7,0,0,0,0,"
+            "1,Metformin,0,1,21,0,21,0,0,0,0\n");
+  checkMigrated(sim);
+}
+
+static void test_truncated_csv_is_not_loaded() {
+  SimConfig config = defaultSimConfig();
+  config.provision = false;
+  DeviceSim sim(config, NULL);
+  bootOnCsv(sim, "V2,+639170000000,1,Losartan,480\n");
+  TEST_ASSERT_EQUAL_INT(Dispenser::SETUP, sim.dispenser().state());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_image_round_trip);
+  RUN_TEST(test_every_damaged_byte_is_rejected);
+  RUN_TEST(test_other_layouts_are_rejected);
+  RUN_TEST(test_save_is_one_block_write);
+  RUN_TEST(test_binary_against_csv);
+  RUN_TEST(test_migrates_original_csv);
+  RUN_TEST(test_migrates_v2_csv);
+  RUN_TEST(test_truncated_csv_is_not_loaded);
+  return UNITY_END();
+}
@@ -0,0 +1,202 @@
+// ScheduleStore under fault injection: power is cut after every possible
+// number of bytes of a save, then the device "reboots" onto what reached the
+// card and must come back with the old schedule or the new one, never none.
+#include <unity.h>
+
+#include "Dispenser.h"
+#include "ScheduleStore.h"
+#include "native/Fakes.h"
+
+typedef ScheduleTable<kCompartments> Table;
+typedef ScheduleStore<kCompartments> Store;
+
+static const char *kContact = "+639170000000";
+
+// Passes everything through to a MemFileStore until `budget` bytes have been
+// written; the write that crosses it lands only partly, and every later
+// write is lost, as on a card that loses power mid-block.
+class CuttingFileStore : public FileStore {
+ public:
+  CuttingFileStore(MemFileStore &card, uint32_t budget)
+      : card_(card), budget_(budget), cut_(false) {}
+
+  bool exists(const char *path) { return card_.exists(path); }
+  bool remove(const char *path) { return !cut_ && card_.remove(path); }
+  int readAt(const char *path, uint32_t offset, void *buf, uint16_t len) {
+    return card_.readAt(path, offset, buf, len);
+  }
+  int write(const char *path, const void *buf, uint16_t len) {
+    return land(path, buf, len, false);
+  }
+  int append(const char *path, const void *buf, uint16_t len) {
+    return land(path, buf, len, true);
+  }
+  uint32_t size(const char *path) { return card_.size(path); }
+
+  bool cut() const { return cut_; }
+
+ private:
+  int land(const char *path, const void *buf, uint16_t len, bool append) {
+    if (cut_) return -1;
+    uint16_t n = len;
+    if (n > budget_) {
+      n = budget_;
+      cut_ = true;
+    }
+    budget_ -= n;
+    // A zero-length write still opens (and so creates) the file.
+    append ? card_.append(path, buf, n) : card_.write(path, buf, n);
+    return cut_ ? -1 : n;
+  }
+
+  MemFileStore &card_;
+  uint32_t budget_;
+  bool cut_;
+};
+
+// Schedule number `v`, told apart by nextDue and dosesTaken.
+static Table version(uint32_t v) {
+  Table t;
+  t.setName(0, "Losartan");
+  t[0].interval = 480;
+  t[0].iterations = 3;
+  t[0].baseHour = 7;
+  t[0].nextDue = 800000000UL + v * 28800UL;
+  t[0].dosesTaken = v % 3;
+  t[0].active = true;
+  t.setName(1, "Metformin");
+  t[1].iterations = 1;
+  t[1].baseHour = 21;
+  t[1].nextDue = 800000000UL + v * 86400UL;
+  t[1].active = v > 0;
+  return t;
+}
+
+// Boots on `card` and returns which version it loaded, or -1 for none.
+static int32_t bootVersion(MemFileStore &card) {
+  Store store(card);
+  Table t;
+  char contact[kContactLen];
+  if (!store.load(t, contact)) return -1;
+  TEST_ASSERT_EQUAL_STRING(kContact, contact);
+  for (uint32_t v = 0; v < 16; v++) {
+    Table want = version(v);
+    if (t[0].nextDue == want[0].nextDue) {
+      TEST_ASSERT_EQUAL_UINT32(want[1].nextDue, t[1].nextDue);
+      TEST_ASSERT_EQUAL_UINT8(want[0].dosesTaken, t[0].dosesTaken);
+      TEST_ASSERT_EQUAL(want[1].active, t[1].active);
+      TEST_ASSERT_EQUAL_STRING("Metformin", t.name(1));
+      return v;
+    }
+  }
+  TEST_FAIL_MESSAGE("loaded a schedule that was never saved");
+  return -1;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_newest_slot_wins_and_slots_alternate() {
+  MemFileStore card;
+  Store store(card);
+  TEST_ASSERT_FALSE(store.exists());
+  for (uint32_t v = 0; v < 5; v++) {
+    TEST_ASSERT_TRUE(store.save(version(v), kContact));
+    TEST_ASSERT_EQUAL_UINT8(v % 2, store.activeSlot());
+    TEST_ASSERT_EQUAL_INT32(v, bootVersion(card));
+  }
+  TEST_ASSERT_EQUAL_UINT32(5, store.sequence());
+  // Saves never delete: both slots are always on the card.
+  TEST_ASSERT_TRUE(card.exists(Store::path(0)));
+  TEST_ASSERT_TRUE(card.exists(Store::path(1)));
+}
+
+// The first save has nothing to fall back on: a cut leaves no schedule or
+// the complete new one.
+static void test_cut_during_first_save() {
+  size_t image = sizeof(ScheduleImage<kCompartments>);
+  for (uint32_t at = 0; at <= image; at++) {
+    MemFileStore card;
+    CuttingFileStore flaky(card, at);
+    Store(flaky).save(version(0), kContact);
+    TEST_ASSERT_EQUAL_INT32(at < image ? -1 : 0, bootVersion(card));
+  }
+}
+
+// With k saves behind it, a cut at any byte of save k+1 boots into version
+// k or k+1, and the device keeps saving normally afterwards.
+static void test_cut_at_every_byte_keeps_the_last_good_copy() {
+  size_t image = sizeof(ScheduleImage<kCompartments>);
+  for (uint32_t k = 1; k <= 4; k++) {
+    for (uint32_t at = 0; at <= image; at++) {
+      MemFileStore card;
+      Store before(card);
+      for (uint32_t v = 0; v < k; v++) before.save(version(v), kContact);
+
+      CuttingFileStore flaky(card, at);
+      bool saved = Store(flaky).save(version(k), kContact);
+      TEST_ASSERT_EQUAL(at == image, saved);
+      TEST_ASSERT_EQUAL(at < image, flaky.cut());
+      // A cut past the last byte that differs from the slot's old image
+      // leaves the new one whole, so a torn save may still boot into k.
+      int32_t booted = bootVersion(card);
+      if (saved) TEST_ASSERT_EQUAL_INT32(k, booted);
+      TEST_ASSERT_TRUE(booted == (int32_t)k || booted == (int32_t)k - 1);
+      if (at < sizeof(ScheduleHeader)) TEST_ASSERT_EQUAL_INT32(k - 1, booted);
+
+      // After the reboot the next save lands on the torn slot and wins.
+      Store after(card);
+      TEST_ASSERT_TRUE(after.exists());
+      TEST_ASSERT_TRUE(after.save(version(k + 1), kContact));
+      TEST_ASSERT_EQUAL_INT32(k + 1, bootVersion(card));
+    }
+  }
+}
+
+// A slot left behind with a newer sequence but a damaged body is ignored.
+static void test_torn_newer_slot_loses_to_older_valid_one() {
+  MemFileStore card;
+  Store store(card);
+  store.save(version(1), kContact);
+  store.save(version(2), kContact);
+  ScheduleImage<kCompartments> img;
+  TEST_ASSERT_EQUAL_INT(sizeof(img), card.read(Store::path(1), &img,
+                                               sizeof(img)));
+  img.records[1].nextDue ^= 1;
+  card.write(Store::path(1), &img, sizeof(img));
+  TEST_ASSERT_EQUAL_INT32(1, bootVersion(card));
+}
+
+// The sequence tags EEPROM records, so it only ever goes up: across an
+// erase, and across a reboot onto an empty card given the EEPROM's floor.
+static void test_sequence_never_goes_back() {
+  MemFileStore card;
+  Store store(card);
+  store.save(version(1), kContact);
+  store.save(version(2), kContact);
+  store.erase();
+  TEST_ASSERT_FALSE(store.exists());
+  TEST_ASSERT_TRUE(store.save(version(3), kContact));
+  TEST_ASSERT_EQUAL_UINT32(3, store.sequence());
+
+  MemFileStore blank;
+  Store rebooted(blank);
+  rebooted.setFloor(7);
+  rebooted.setFloor(4);  // a lower floor changes nothing
+  TEST_ASSERT_TRUE(rebooted.save(version(4), kContact));
+  TEST_ASSERT_EQUAL_UINT32(8, rebooted.sequence());
+  Store again(blank);
+  TEST_ASSERT_TRUE(again.exists());
+  TEST_ASSERT_EQUAL_UINT32(8, again.sequence());
+  TEST_ASSERT_EQUAL_INT32(4, bootVersion(blank));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_newest_slot_wins_and_slots_alternate);
+  RUN_TEST(test_cut_during_first_save);
+  RUN_TEST(test_cut_at_every_byte_keeps_the_last_good_copy);
+  RUN_TEST(test_torn_newer_slot_loses_to_older_valid_one);
+  RUN_TEST(test_sequence_never_goes_back);
+  return UNITY_END();
+}
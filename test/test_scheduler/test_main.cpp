@@ -0,0 +1,138 @@
+// Scheduler on a fake millisecond clock: deadline order, periods, rollover
+// and the latency counters loop() reports.
+#include <unity.h>
+
+#include "Scheduler.h"
+#include "native/Fakes.h"
+
+static SimClock clock(0);
+static Scheduler *sched;
+
+static char order[16];
+static uint8_t ran;
+static uint32_t workMs;  // how long each task "runs" on the fake clock
+
+static void note(void *ctx) {
+  order[ran++] = *static_cast<const char *>(ctx);
+  clock.advance(workMs);
+}
+
+void setUp() {
+  clock = SimClock(0);
+  simClock = &clock;
+  sched = new Scheduler(simMillis);
+  memset(order, 0, sizeof(order));
+  ran = 0;
+  workMs = 0;
+}
+
+void tearDown() { delete sched; }
+
+static void test_runs_in_deadline_order() {
+  static const char a = 'a', b = 'b', c = 'c';
+  sched->add(note, (void *)&c, 0, 30);
+  sched->add(note, (void *)&a, 0, 10);
+  sched->add(note, (void *)&b, 0, 20);
+  TEST_ASSERT_EQUAL_UINT32(10, sched->idleBudget());
+  TEST_ASSERT_EQUAL_UINT8(0, sched->runDue());
+
+  clock.advance(30);
+  TEST_ASSERT_EQUAL_UINT8(3, sched->runDue());
+  TEST_ASSERT_EQUAL_STRING("abc", order);
+  TEST_ASSERT_EQUAL_UINT32(Scheduler::kNever, sched->idleBudget());
+}
+
+static void test_reschedule_moves_and_cancel_drops() {
+  static const char a = 'a', b = 'b';
+  Scheduler::TaskId ta = sched->add(note, (void *)&a, 0, 10);
+  Scheduler::TaskId tb = sched->add(note, (void *)&b, 0, 20);
+  sched->schedule(ta, 50);
+  sched->cancel(tb);
+  TEST_ASSERT_TRUE(sched->pending(ta));
+  TEST_ASSERT_FALSE(sched->pending(tb));
+  clock.advance(49);
+  TEST_ASSERT_EQUAL_UINT8(0, sched->runDue());
+  clock.advance(1);
+  TEST_ASSERT_EQUAL_UINT8(1, sched->runDue());
+  TEST_ASSERT_EQUAL_STRING("a", order);
+}
+
+// A periodic task keeps its phase, but after a stall it runs once and
+// carries on from there instead of firing every missed period back to back.
+static void test_period_does_not_catch_up_after_stall() {
+  static const char p = 'p';
+  sched->add(note, (void *)&p, 100, 100);
+  for (int i = 0; i < 3; i++) {
+    clock.advance(100);
+    sched->runDue();
+  }
+  TEST_ASSERT_EQUAL_UINT8(3, ran);
+  TEST_ASSERT_EQUAL_UINT32(100, sched->idleBudget());
+
+  clock.advance(1000);
+  TEST_ASSERT_EQUAL_UINT8(1, sched->runDue());
+  TEST_ASSERT_EQUAL_UINT32(100, sched->idleBudget());
+}
+
+static void test_deadlines_survive_millis_rollover() {
+  static const char a = 'a', b = 'b';
+  clock.advance(0xFFFFFFFFUL - 50);
+  sched->add(note, (void *)&b, 0, 100);  // due after the wrap
+  sched->add(note, (void *)&a, 0, 20);   // due before it
+  clock.advance(30);
+  TEST_ASSERT_EQUAL_UINT8(1, sched->runDue());
+  clock.advance(70);
+  TEST_ASSERT_EQUAL_UINT8(1, sched->runDue());
+  TEST_ASSERT_EQUAL_STRING("ab", order);
+}
+
+// Lateness is measured against the deadline, the pass against the clock
+// around runDue(): three 40 ms slices hold the loop off for 120 ms.
+static void test_latency_counters_follow_the_fake_clock() {
+  static const char a = 'a', b = 'b', c = 'c';
+  sched->add(note, (void *)&a, 0, 0);
+  sched->add(note, (void *)&b, 0, 0);
+  sched->add(note, (void *)&c, 0, 0);
+  workMs = 40;
+  clock.advance(5);
+  sched->runDue();
+  TEST_ASSERT_EQUAL_UINT32(120, sched->worstPassMs());
+  TEST_ASSERT_EQUAL_UINT32(85, sched->worstLatenessMs());  // c waited on a, b
+  TEST_ASSERT_EQUAL_UINT32(3, sched->runs());
+
+  sched->resetStats();
+  TEST_ASSERT_EQUAL_UINT32(0, sched->worstPassMs());
+  TEST_ASSERT_EQUAL_UINT32(0, sched->worstLatenessMs());
+}
+
+// A task that re-arms itself with no delay cannot keep runDue() for itself.
+static Scheduler::TaskId spinner;
+static void spin(void *) {
+  ran++;
+  sched->schedule(spinner, 0);
+}
+
+static void test_zero_delay_rearm_is_bounded() {
+  spinner = sched->add(spin, NULL, 0, 0);
+  TEST_ASSERT_EQUAL_UINT8(Scheduler::kMaxTasks, sched->runDue());
+  TEST_ASSERT_TRUE(sched->pending(spinner));
+}
+
+static void test_table_full() {
+  for (uint8_t i = 0; i < Scheduler::kMaxTasks; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, sched->add(spin, NULL));
+  }
+  TEST_ASSERT_EQUAL_UINT8(Scheduler::kNoTask, sched->add(spin, NULL));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_runs_in_deadline_order);
+  RUN_TEST(test_reschedule_moves_and_cancel_drops);
+  RUN_TEST(test_period_does_not_catch_up_after_stall);
+  RUN_TEST(test_deadlines_survive_millis_rollover);
+  RUN_TEST(test_latency_counters_follow_the_fake_clock);
+  RUN_TEST(test_zero_delay_rearm_is_bounded);
+  RUN_TEST(test_table_full);
+  return UNITY_END();
+}
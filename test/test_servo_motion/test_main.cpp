@@ -0,0 +1,260 @@
+// ServoMotion against fake servos that record every commanded angle and
+// detach with its time: the ramp, hold and return land on schedule in small
+// steps, servos in flight at once keep their own timelines, and an idle
+// servo is always let go.
+#include <unity.h>
+
+#include <vector>
+
+#include "ScheduleStore.h"
+#include "ServoMotion.h"
+#include "native/Simulator.h"
+
+static uint32_t now;
+
+static const uint8_t kDetached = 0xFF;
+
+struct ServoCommand {
+  uint32_t at;
+  uint8_t angle;  // kDetached for a detach
+};
+
+class TimelineServo : public Actuator {
+ public:
+  TimelineServo() : attached_(false) {}
+  void write(uint8_t angle) {
+    ServoCommand c = {now, angle};
+    timeline.push_back(c);
+    attached_ = true;
+  }
+  void detach() {
+    ServoCommand c = {now, kDetached};
+    timeline.push_back(c);
+    attached_ = false;
+  }
+  bool attached() const { return attached_; }
+
+  std::vector<ServoCommand> timeline;
+
+ private:
+  bool attached_;
+};
+
+// 0 -> 90 over 300 ms in 20 ms frames, 3 s open, back over 300 ms, and
+// driven closed for 250 ms more: as the firmware dispenses.
+static const MotionProfile kProfile = {0, 90, 300, 3000, 250, 20};
+
+// Runs step() as the motion task would, `lateMs` after each deadline, and
+// records when a servo closed. Returns the time all went idle.
+static uint32_t runToIdle(ServoMotion &motion, uint32_t lateMs,
+                          std::vector<uint32_t> *closed = NULL) {
+  for (;;) {
+    uint32_t wait = motion.step(now);
+    uint8_t i;
+    while (motion.takeClosed(i)) {
+      if (closed) closed->push_back(now);
+    }
+    if (wait == ServoMotion::kNever) return now;
+    now += wait + lateMs;
+  }
+}
+
+void setUp() { now = 1000; }
+void tearDown() {}
+
+// One dispense: angles climb in frames of at most 6 degrees to 90 by 300
+// ms, nothing moves while open, they fall back to 0 by 3600 ms, and the
+// servo is detached 250 ms later.
+static void test_ramp_hold_return_detach() {
+  TimelineServo s;
+  Actuator *servos[] = {&s};
+  ServoMotion motion(servos, 1, kProfile);
+  uint32_t start = now;
+  motion.start(0, now);
+  std::vector<uint32_t> closed;
+  uint32_t idle = runToIdle(motion, 0, &closed);
+
+  const std::vector<ServoCommand> &t = s.timeline;
+  TEST_ASSERT_GREATER_THAN_UINT32(20, t.size());
+  uint8_t last = 0;
+  bool opened = false;
+  for (size_t k = 0; k + 1 < t.size(); k++) {
+    uint32_t at = t[k].at - start;
+    uint8_t a = t[k].angle;
+    uint8_t step = a > last ? a - last : last - a;
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(90 * 20 / 300, step);
+    if (at <= 300) {
+      TEST_ASSERT_TRUE(a > last);  // opening
+    } else {
+      TEST_ASSERT_TRUE(at >= 3300);  // held open, then closing
+      TEST_ASSERT_TRUE(a < last);
+    }
+    if (a == 90) {
+      TEST_ASSERT_EQUAL_UINT32(300, at);
+      opened = true;
+    }
+    last = a;
+  }
+  TEST_ASSERT_TRUE(opened);
+  TEST_ASSERT_EQUAL_UINT8(0, t[t.size() - 2].angle);
+  TEST_ASSERT_EQUAL_UINT32(3600, t[t.size() - 2].at - start);
+  TEST_ASSERT_EQUAL_UINT8(kDetached, t.back().angle);
+  TEST_ASSERT_EQUAL_UINT32(3850, t.back().at - start);
+  TEST_ASSERT_EQUAL_UINT32(3850, idle - start);
+  TEST_ASSERT_FALSE(s.attached());
+
+  TEST_ASSERT_EQUAL_UINT32(1, closed.size());
+  TEST_ASSERT_EQUAL_UINT32(3600, closed[0] - start);
+  TEST_ASSERT_EQUAL_UINT32(1, motion.durations().total());
+  TEST_ASSERT_EQUAL_UINT32(3600, motion.durations().max());
+  TEST_ASSERT_EQUAL_UINT16(1, motion.detaches());
+  TEST_ASSERT_FALSE(motion.busy());
+}
+
+static std::vector<ServoCommand> shifted(const std::vector<ServoCommand> &t,
+                                    uint32_t by) {
+  std::vector<ServoCommand> out(t);
+  for (size_t k = 0; k < out.size(); k++) out[k].at -= by;
+  return out;
+}
+
+static bool same(const std::vector<ServoCommand> &a,
+                 const std::vector<ServoCommand> &b) {
+  if (a.size() != b.size()) return false;
+  for (size_t k = 0; k < a.size(); k++) {
+    if (a[k].at != b[k].at || a[k].angle != b[k].angle) return false;
+  }
+  return true;
+}
+
+// Three servos started 0, 10 and 700 ms apart move at once, each on the
+// same timeline as a servo moving alone; the last is idle 3850 ms after it
+// started, not three dispenses later. Frames are 10 ms here so that every
+// start lands on a frame.
+static void test_servos_move_concurrently() {
+  MotionProfile fine = kProfile;
+  fine.stepMs = 10;
+  TimelineServo alone;
+  Actuator *one[] = {&alone};
+  ServoMotion solo(one, 1, fine);
+  uint32_t base = now;
+  solo.start(0, now);
+  runToIdle(solo, 0);
+  std::vector<ServoCommand> reference = shifted(alone.timeline, base);
+
+  now = 50000;
+  TimelineServo s[3];
+  Actuator *servos[] = {&s[0], &s[1], &s[2]};
+  ServoMotion motion(servos, 3, fine);
+  const uint32_t offsets[] = {0, 10, 700};
+  uint32_t start = now;
+  for (;;) {
+    for (uint8_t i = 0; i < 3; i++) {
+      if (now == start + offsets[i]) motion.start(i, now);
+    }
+    uint32_t wait = motion.step(now);
+    uint32_t next = wait == ServoMotion::kNever ? 0 : now + wait;
+    for (uint8_t i = 1; i < 3; i++) {
+      uint32_t at = start + offsets[i];
+      if (at > now && (!next || at < next)) next = at;
+    }
+    if (!next) break;
+    now = next;
+  }
+  TEST_ASSERT_EQUAL_UINT32(700 + 3850, now - start);
+  TEST_ASSERT_EQUAL_UINT32(3, motion.durations().total());
+  TEST_ASSERT_EQUAL_UINT32(3600, motion.durations().max());
+  for (uint8_t i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(
+        same(reference, shifted(s[i].timeline, start + offsets[i])));
+  }
+}
+
+// A loop that gets to the task late still ends fully open, fully closed and
+// detached; the late frames are just bigger steps.
+static void test_late_steps_still_arrive() {
+  TimelineServo s;
+  Actuator *servos[] = {&s};
+  ServoMotion motion(servos, 1, kProfile);
+  motion.start(0, now);
+  runToIdle(motion, 45);
+  const std::vector<ServoCommand> &t = s.timeline;
+  bool opened = false;
+  for (size_t k = 0; k < t.size(); k++) opened |= t[k].angle == 90;
+  TEST_ASSERT_TRUE(opened);
+  TEST_ASSERT_EQUAL_UINT8(0, t[t.size() - 2].angle);
+  TEST_ASSERT_EQUAL_UINT8(kDetached, t.back().angle);
+  TEST_ASSERT_FALSE(motion.busy());
+}
+
+// begin() drives every servo closed and lets go after the settle time; a
+// start() on a servo already moving is ignored.
+static void test_begin_and_restart() {
+  TimelineServo s[2];
+  Actuator *servos[] = {&s[0], &s[1]};
+  ServoMotion motion(servos, 2, kProfile);
+  uint32_t start = now;
+  motion.begin(now);
+  TEST_ASSERT_TRUE(motion.busy());
+  runToIdle(motion, 0);
+  for (uint8_t i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL_UINT32(2, s[i].timeline.size());
+    TEST_ASSERT_EQUAL_UINT8(0, s[i].timeline[0].angle);
+    TEST_ASSERT_EQUAL_UINT8(kDetached, s[i].timeline[1].angle);
+    TEST_ASSERT_EQUAL_UINT32(250, s[i].timeline[1].at - start);
+  }
+
+  motion.start(1, now);
+  now += 1000;
+  motion.step(now);
+  motion.start(1, now);  // still open: ignored
+  TEST_ASSERT_TRUE(motion.moving(1));
+  TEST_ASSERT_FALSE(motion.moving(0));
+  runToIdle(motion, 0);
+  TEST_ASSERT_EQUAL_UINT32(1, motion.durations().total());
+  TEST_ASSERT_EQUAL_UINT32(2, s[0].timeline.size());
+}
+
+// On the device: two doses due the same minute open both compartments at
+// once, each in 3.6 s, with no snap bigger than a ramp frame.
+static void test_device_doses_in_parallel() {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  config.provision = false;
+  ScheduleTable<kCompartments> t;
+  for (uint8_t i = 0; i < kCompartments; i++) {
+    t.setName(i, i ? "Metformin" : "Losartan");
+    t[i].iterations = 1;
+    t[i].baseHour = t[i].nextHour = 7;
+    t[i].active = true;
+  }
+  DeviceSim sim(config, NULL);
+  TEST_ASSERT_TRUE(
+      ScheduleStore<kCompartments>(sim.files()).save(t, "+639170000000"));
+  uint32_t together = 0;  // passes with both servos in flight
+  while (sim.step()) {
+    if (sim.dispenser().motion().moving(0) &&
+        sim.dispenser().motion().moving(1)) {
+      together++;
+    }
+  }
+  sim.run();  // already at the end: just totals up
+  const SimTotals &totals = sim.totals();
+  TEST_ASSERT_EQUAL_UINT32(2, totals.events[EVENT_TAKEN]);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, together);
+  const Log2Histogram<14> &d = sim.dispenser().motion().durations();
+  TEST_ASSERT_EQUAL_UINT32(2, d.total());
+  TEST_ASSERT_EQUAL_UINT32(3600, d.max());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(6, totals.servoMaxStep);
+  TEST_ASSERT_EQUAL_UINT32(2 + 2, totals.servoDetaches);  // boot + dose
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp_hold_return_detach);
+  RUN_TEST(test_servos_move_concurrently);
+  RUN_TEST(test_late_steps_still_arrive);
+  RUN_TEST(test_begin_and_restart);
+  RUN_TEST(test_device_doses_in_parallel);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+// The whole-device simulator: runs are reproducible to the byte, the trace
+// records what happened when, the scripted patient drives the outcomes, and
+// a year of virtual time costs seconds of real time at most.
+#include <unity.h>
+
+#include <time.h>
+
+#include <string>
+
+#include "native/Simulator.h"
+
+// Runs `config` with a trace and returns the trace text.
+static std::string traced(const SimConfig &config, SimTotals &totals) {
+  FILE *f = tmpfile();
+  TEST_ASSERT_NOT_NULL(f);
+  DeviceSim sim(config, f);
+  sim.run();
+  totals = sim.totals();
+  std::string text(ftell(f), '\0');
+  rewind(f);
+  TEST_ASSERT_EQUAL_UINT32(text.size(), fread(&text[0], 1, text.size(), f));
+  fclose(f);
+  return text;
+}
+
+static uint32_t countLines(const std::string &trace, const char *what) {
+  uint32_t n = 0;
+  for (size_t at = trace.find(what); at != std::string::npos;
+       at = trace.find(what, at + 1)) {
+    n++;
+  }
+  return n;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_same_config_same_run() {
+  SimConfig config = defaultSimConfig();
+  config.days = 7;
+  config.patient.jitterMs = 90000;
+  config.patient.missEvery = 5;
+  config.patient.noisePulses = 2;
+  config.patient.seed = 99;
+  SimTotals a, b;
+  std::string first = traced(config, a);
+  std::string second = traced(config, b);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, first.size());
+  TEST_ASSERT_TRUE(first == second);
+  TEST_ASSERT_EQUAL_INT(0, memcmp(a.events, b.events, sizeof(a.events)));
+  TEST_ASSERT_EQUAL_UINT32(a.sdBytes, b.sdBytes);
+  TEST_ASSERT_EQUAL_UINT32(a.eepromWrites, b.eepromWrites);
+  TEST_ASSERT_EQUAL_UINT32(a.lcdBytes, b.lcdBytes);
+  TEST_ASSERT_TRUE(a.loops == b.loops);
+
+  // A different seed gives a different run.
+  config.patient.seed = 100;
+  std::string other = traced(config, b);
+  TEST_ASSERT_FALSE(first == other);
+}
+
+// One day: four doses, each dispensed on the minute and taken 20 s after
+// the drop, with the pickup prompt and the confirmation SMS.
+static void test_trace_of_one_day() {
+  SimConfig config = defaultSimConfig();
+  config.days = 1;
+  SimTotals t;
+  std::string trace = traced(config, t);
+  TEST_ASSERT_EQUAL_UINT32(4, countLines(trace, " DISPENSED "));
+  TEST_ASSERT_EQUAL_UINT32(4, countLines(trace, " TAKEN "));
+  TEST_ASSERT_EQUAL_UINT32(8, countLines(trace, " SMS "));
+  TEST_ASSERT_EQUAL_UINT32(0, countLines(trace, " MISSED "));
+  TEST_ASSERT_EQUAL_UINT32(
+      1, countLines(trace, "2025-01-01 07:00:00 DISPENSED med1"));
+  TEST_ASSERT_EQUAL_UINT32(
+      1, countLines(trace, "2025-01-01 21:00:00 DISPENSED med2"));
+  TEST_ASSERT_GREATER_THAN_UINT32(0, countLines(trace, " SD +"));
+  TEST_ASSERT_EQUAL_UINT32(t.sms, countLines(trace, " SMS "));
+  TEST_ASSERT_GREATER_THAN_UINT32(0, t.sdBytes);
+}
+
+// Four weeks, 112 doses: every 4th never picked up, or every 7th late.
+static void test_scripted_patient_outcomes() {
+  SimConfig config = defaultSimConfig();
+  config.days = 28;
+  config.patient.missEvery = 4;
+  DeviceSim missing(config, NULL);
+  missing.run();
+  const SimTotals &m = missing.totals();
+  TEST_ASSERT_EQUAL_UINT32(112, m.events[EVENT_DISPENSED]);
+  TEST_ASSERT_EQUAL_UINT32(28, m.events[EVENT_MISSED]);
+  TEST_ASSERT_EQUAL_UINT32(84, m.events[EVENT_TAKEN]);
+
+  config.patient.missEvery = 0;
+  config.patient.lateEvery = 7;
+  DeviceSim late(config, NULL);
+  late.run();
+  const SimTotals &l = late.totals();
+  TEST_ASSERT_EQUAL_UINT32(16, l.events[EVENT_LATE]);
+  TEST_ASSERT_EQUAL_UINT32(96, l.events[EVENT_TAKEN]);
+  TEST_ASSERT_EQUAL_UINT32(0, l.events[EVENT_MISSED]);
+}
+
+// The old line-per-field handshake provisions the same schedule.
+static void test_legacy_provisioning_gives_the_same_doses() {
+  SimConfig config = defaultSimConfig();
+  config.days = 7;
+  DeviceSim framed(config, NULL);
+  framed.run();
+  config.legacyProvisioning = true;
+  DeviceSim legacy(config, NULL);
+  legacy.run();
+  TEST_ASSERT_EQUAL_INT(0, memcmp(framed.totals().events,
+                                  legacy.totals().events,
+                                  sizeof(framed.totals().events)));
+  TEST_ASSERT_EQUAL_UINT32(28, legacy.totals().events[EVENT_TAKEN]);
+}
+
+// Watchdog resets three seconds after every third dispense: the dose in
+// flight is picked up again, never dropped twice.
+static void test_resets_never_dispense_twice() {
+  SimConfig config = defaultSimConfig();
+  config.days = 28;
+  config.resetEvery = 3;
+  config.resetAfterMs = 3000;
+  DeviceSim sim(config, NULL);
+  sim.run();
+  const SimTotals &t = sim.totals();
+  TEST_ASSERT_GREATER_THAN_UINT32(30, t.resets);
+  TEST_ASSERT_EQUAL_UINT32(112, t.events[EVENT_DISPENSED]);
+  TEST_ASSERT_EQUAL_UINT32(112, t.pillsDropped);
+  TEST_ASSERT_EQUAL_UINT32(112, t.events[EVENT_TAKEN]);
+}
+
+static void test_a_year_in_seconds() {
+  SimConfig config = defaultSimConfig();
+  config.days = 365;
+  clock_t start = clock();
+  DeviceSim sim(config, NULL);
+  sim.run();
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  TEST_ASSERT_EQUAL_UINT32(365 * 4, sim.totals().events[EVENT_TAKEN]);
+  TEST_ASSERT_EQUAL_UINT32(365 * 8, sim.totals().sms);
+  TEST_ASSERT_TRUE(seconds < 10.0);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_same_config_same_run);
+  RUN_TEST(test_trace_of_one_day);
+  RUN_TEST(test_scripted_patient_outcomes);
+  RUN_TEST(test_legacy_provisioning_gives_the_same_doses);
+  RUN_TEST(test_resets_never_dispense_twice);
+  RUN_TEST(test_a_year_in_seconds);
+  return UNITY_END();
+}
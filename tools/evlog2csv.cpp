@@ -0,0 +1,44 @@
+// Host tool: converts dose-log segments (Dnnnnn.BIN) copied off the SD card
+// to CSV on stdout.
+//
+//   g++ -Iinclude tools/evlog2csv.cpp -o evlog2csv
+//   ./evlog2csv /media/sd/D*.BIN > doses.csv
+#include <stdio.h>
+#include <time.h>
+
+#include "EventLog.h"
+
+static const time_t kEpoch2000 = 946684800;  // 2000-01-01 in Unix time
+static const char *kTypeNames[EVENT_KINDS] = {"dispensed", "taken", "missed",
+                                              "late"};
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s SEGMENT...\n", argv[0]);
+    return 2;
+  }
+  printf("timestamp,compartment,event,latency_s\n");
+  int bad = 0;
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+    SegmentHeader h;
+    if (!f || fread(&h, sizeof(h), 1, f) != 1 || h.magic != kEventMagic ||
+        h.recordSize != sizeof(EventRecord)) {
+      fprintf(stderr, "%s: not a dose-log segment\n", argv[i]);
+      if (f) fclose(f);
+      bad++;
+      continue;
+    }
+    EventRecord r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+      time_t t = kEpoch2000 + (time_t)h.dayStart + r.offset;
+      char when[20];
+      strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+      printf("%s,%u,%s,%u\n", when, (unsigned)r.compartment + 1,
+             r.type < EVENT_KINDS ? kTypeNames[r.type] : "unknown",
+             (unsigned)r.latency);
+    }
+    fclose(f);
+  }
+  return bad ? 1 : 0;
+}
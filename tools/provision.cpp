@@ -0,0 +1,64 @@
+// Host tool: encodes a schedule as a Bluetooth provisioning frame (see
+// Provision.h) on stdout, for scripting or replaying to the dispenser.
+//
+//   g++ -Iinclude tools/provision.cpp src/Provision.cpp src/Crc.cpp -o provision
+//   ./provision +639170000000 Losartan,8,3,7:00,15:00,1 - > /dev/rfcomm0
+//
+// Each compartment is name,intervalHours,iterations,baseH:M,nextH:M,active.
+// Pass "-" for a compartment that is not in use. The firmware keeps intervals
+// in minutes (24 h and up repeat every N days), so at most 1092 hours.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Dispenser.h"
+#include "Provision.h"
+
+static const unsigned kMaxIntervalHours = 0xFFFF / 60;
+
+static bool parseTime(const char *s, uint8_t &h, uint8_t &m) {
+  unsigned hh, mm;
+  if (sscanf(s, "%u:%u", &hh, &mm) != 2 || hh > 23 || mm > 59) return false;
+  h = hh;
+  m = mm;
+  return true;
+}
+
+static bool parseCompartment(const char *arg, ScheduleTable<kCompartments> &t,
+                             uint8_t i) {
+  if (arg[0] == '-' && arg[1] == '\0') return true;
+  char name[32], base[8], next[8];
+  unsigned interval, iterations, active;
+  if (sscanf(arg, "%31[^,],%u,%u,%7[^,],%7[^,],%u", name, &interval,
+             &iterations, base, next, &active) != 6) {
+    return false;
+  }
+  if (interval < 1 || interval > kMaxIntervalHours) return false;
+  Compartment &c = t[i];
+  t.setName(i, name);
+  c.interval = interval * 60;
+  c.iterations = iterations;
+  c.active = active != 0;
+  return parseTime(base, c.baseHour, c.baseMinute) &&
+         parseTime(next, c.nextHour, c.nextMinute);
+}
+
+int main(int argc, char **argv) {
+  int count = argc - 2;
+  if (count < 1 || count > kCompartments) {
+    fprintf(stderr, "usage: %s CONTACT COMPARTMENT...\n", argv[0]);
+    return 2;
+  }
+  ScheduleTable<kCompartments> table;
+  for (int i = 0; i < count; i++) {
+    if (!parseCompartment(argv[i + 2], table, i)) {
+      fprintf(stderr, "bad compartment: %s\n", argv[i + 2]);
+      return 2;
+    }
+  }
+  uint8_t payload[kFrameMaxPayload];
+  uint8_t frame[kFrameMaxPayload + kFrameOverhead];
+  uint16_t len = encodeProvision(table, argv[1], payload, count);
+  size_t n = encodeFrame(FRAME_SCHEDULE, payload, len, frame);
+  fwrite(frame, 1, n, stdout);
+  return 0;
+}